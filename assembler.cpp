@@ -6,6 +6,9 @@
 #include <bitset>
 #include <stack>
 #include "assembler.h"
+#include "compressed.h"
+#include "vector_unit.h"
+#include "float_unit.h"
 using namespace std;
 
 /*
@@ -313,7 +316,7 @@ pair<int, bool> getImmediate(string str, int pc, unordered_map<string, int> labe
     return make_pair(imm, false);
 }
 
-int convert()
+int convert(bool compress)
 {
     ifstream input("input.s");
     ofstream output("output.hex");
@@ -360,6 +363,51 @@ int convert()
     opcode["slti"] = "0010011";
     opcode["sltiu"] = "0010011";
     opcode["lwu"] = "0000011";
+    opcode["addw"] = "0111011";
+    opcode["subw"] = "0111011";
+    opcode["sllw"] = "0111011";
+    opcode["srlw"] = "0111011";
+    opcode["sraw"] = "0111011";
+    opcode["addiw"] = "0011011";
+    opcode["slliw"] = "0011011";
+    opcode["srliw"] = "0011011";
+    opcode["sraiw"] = "0011011";
+    opcode["fence"] = "0001111";
+    opcode["mul"] = "0110011";
+    opcode["mulh"] = "0110011";
+    opcode["mulhsu"] = "0110011";
+    opcode["mulhu"] = "0110011";
+    opcode["div"] = "0110011";
+    opcode["divu"] = "0110011";
+    opcode["rem"] = "0110011";
+    opcode["remu"] = "0110011";
+    opcode["mulw"] = "0111011";
+    opcode["divw"] = "0111011";
+    opcode["divuw"] = "0111011";
+    opcode["remw"] = "0111011";
+    opcode["remuw"] = "0111011";
+    opcode["lr.w"] = "0101111";
+    opcode["sc.w"] = "0101111";
+    opcode["amoswap.w"] = "0101111";
+    opcode["amoadd.w"] = "0101111";
+    opcode["amoxor.w"] = "0101111";
+    opcode["amoand.w"] = "0101111";
+    opcode["amoor.w"] = "0101111";
+    opcode["amomin.w"] = "0101111";
+    opcode["amomax.w"] = "0101111";
+    opcode["amominu.w"] = "0101111";
+    opcode["amomaxu.w"] = "0101111";
+    opcode["lr.d"] = "0101111";
+    opcode["sc.d"] = "0101111";
+    opcode["amoswap.d"] = "0101111";
+    opcode["amoadd.d"] = "0101111";
+    opcode["amoxor.d"] = "0101111";
+    opcode["amoand.d"] = "0101111";
+    opcode["amoor.d"] = "0101111";
+    opcode["amomin.d"] = "0101111";
+    opcode["amomax.d"] = "0101111";
+    opcode["amominu.d"] = "0101111";
+    opcode["amomaxu.d"] = "0101111";
 
     unordered_map<string, string> funct3;
     funct3["add"] = "000";
@@ -399,6 +447,50 @@ int convert()
     funct3["slti"] = "010";
     funct3["sltiu"] = "011";
     funct3["lwu"] = "110";
+    funct3["addw"] = "000";
+    funct3["subw"] = "000";
+    funct3["sllw"] = "001";
+    funct3["srlw"] = "101";
+    funct3["sraw"] = "101";
+    funct3["addiw"] = "000";
+    funct3["slliw"] = "001";
+    funct3["srliw"] = "101";
+    funct3["sraiw"] = "101";
+    funct3["mul"] = "000";
+    funct3["mulh"] = "001";
+    funct3["mulhsu"] = "010";
+    funct3["mulhu"] = "011";
+    funct3["div"] = "100";
+    funct3["divu"] = "101";
+    funct3["rem"] = "110";
+    funct3["remu"] = "111";
+    funct3["mulw"] = "000";
+    funct3["divw"] = "100";
+    funct3["divuw"] = "101";
+    funct3["remw"] = "110";
+    funct3["remuw"] = "111";
+    funct3["lr.w"] = "010";
+    funct3["sc.w"] = "010";
+    funct3["amoswap.w"] = "010";
+    funct3["amoadd.w"] = "010";
+    funct3["amoxor.w"] = "010";
+    funct3["amoand.w"] = "010";
+    funct3["amoor.w"] = "010";
+    funct3["amomin.w"] = "010";
+    funct3["amomax.w"] = "010";
+    funct3["amominu.w"] = "010";
+    funct3["amomaxu.w"] = "010";
+    funct3["lr.d"] = "011";
+    funct3["sc.d"] = "011";
+    funct3["amoswap.d"] = "011";
+    funct3["amoadd.d"] = "011";
+    funct3["amoxor.d"] = "011";
+    funct3["amoand.d"] = "011";
+    funct3["amoor.d"] = "011";
+    funct3["amomin.d"] = "011";
+    funct3["amomax.d"] = "011";
+    funct3["amominu.d"] = "011";
+    funct3["amomaxu.d"] = "011";
 
     unordered_map<string, string> funct7;
     funct7["add"] = "0000000";
@@ -411,6 +503,146 @@ int convert()
     funct7["sra"] = "0100000";
     funct7["slt"] = "0000000";
     funct7["sltu"] = "0000000";
+    funct7["addw"] = "0000000";
+    funct7["subw"] = "0100000";
+    funct7["sllw"] = "0000000";
+    funct7["srlw"] = "0000000";
+    funct7["sraw"] = "0100000";
+    funct7["mul"] = "0000001";
+    funct7["mulh"] = "0000001";
+    funct7["mulhsu"] = "0000001";
+    funct7["mulhu"] = "0000001";
+    funct7["div"] = "0000001";
+    funct7["divu"] = "0000001";
+    funct7["rem"] = "0000001";
+    funct7["remu"] = "0000001";
+    funct7["mulw"] = "0000001";
+    funct7["divw"] = "0000001";
+    funct7["divuw"] = "0000001";
+    funct7["remw"] = "0000001";
+    funct7["remuw"] = "0000001";
+    // atomics: funct5 followed by the aq and rl bits, which are set from the .aq/.rl/.aqrl suffix
+    funct7["lr.w"] = "0001000";
+    funct7["sc.w"] = "0001100";
+    funct7["amoswap.w"] = "0000100";
+    funct7["amoadd.w"] = "0000000";
+    funct7["amoxor.w"] = "0010000";
+    funct7["amoand.w"] = "0110000";
+    funct7["amoor.w"] = "0100000";
+    funct7["amomin.w"] = "1000000";
+    funct7["amomax.w"] = "1010000";
+    funct7["amominu.w"] = "1100000";
+    funct7["amomaxu.w"] = "1110000";
+    funct7["lr.d"] = "0001000";
+    funct7["sc.d"] = "0001100";
+    funct7["amoswap.d"] = "0000100";
+    funct7["amoadd.d"] = "0000000";
+    funct7["amoxor.d"] = "0010000";
+    funct7["amoand.d"] = "0110000";
+    funct7["amoor.d"] = "0100000";
+    funct7["amomin.d"] = "1000000";
+    funct7["amomax.d"] = "1010000";
+    funct7["amominu.d"] = "1100000";
+    funct7["amomaxu.d"] = "1110000";
+
+    // F and D: funct7 holds funct5 and the format, an empty funct3 is the rounding mode field
+    opcode["flw"] = opcode["fld"] = "0000111";
+    opcode["fsw"] = opcode["fsd"] = "0100111";
+    funct3["flw"] = funct3["fsw"] = "010";
+    funct3["fld"] = funct3["fsd"] = "011";
+    string floatOps[] = {"fadd", "fsub", "fmul", "fdiv", "fsqrt", "fsgnj", "fsgnjn", "fsgnjx", "fmin", "fmax", "feq", "flt", "fle", "fclass"};
+    string floatFunct5[] = {"00000", "00001", "00010", "00011", "01011", "00100", "00100", "00100", "00101", "00101", "10100", "10100", "10100", "11100"};
+    string floatFunct3[] = {"", "", "", "", "", "000", "001", "010", "000", "001", "010", "001", "000", "001"};
+    string fusedOps[] = {"fmadd", "fmsub", "fnmsub", "fnmadd"};
+    string fusedOpcodes[] = {"1000011", "1000111", "1001011", "1001111"};
+    string intTypes[] = {"w", "wu", "l", "lu"};
+    string fmts[] = {"s", "d"};
+    string fmtCodes[] = {"00", "01"};
+    for (int i = 0; i < 2; i++)
+    {
+        string fmt = fmts[i];
+        for (int j = 0; j < 14; j++)
+        {
+            opcode[floatOps[j] + "." + fmt] = "1010011";
+            funct7[floatOps[j] + "." + fmt] = floatFunct5[j] + fmtCodes[i];
+            funct3[floatOps[j] + "." + fmt] = floatFunct3[j];
+        }
+        for (int j = 0; j < 4; j++)
+        {
+            opcode[fusedOps[j] + "." + fmt] = fusedOpcodes[j];
+            funct7[fusedOps[j] + "." + fmt] = fmtCodes[i]; // rs3 fills the rest of funct7
+            opcode["fcvt." + intTypes[j] + "." + fmt] = opcode["fcvt." + fmt + "." + intTypes[j]] = "1010011";
+            funct7["fcvt." + intTypes[j] + "." + fmt] = "11000" + fmtCodes[i];
+            funct7["fcvt." + fmt + "." + intTypes[j]] = "11010" + fmtCodes[i];
+        }
+    }
+    opcode["fcvt.s.d"] = opcode["fcvt.d.s"] = "1010011";
+    funct7["fcvt.s.d"] = "0100000";
+    funct7["fcvt.d.s"] = "0100001";
+    opcode["fmv.x.w"] = opcode["fmv.w.x"] = opcode["fmv.x.d"] = opcode["fmv.d.x"] = "1010011";
+    funct7["fmv.x.w"] = "1110000";
+    funct7["fmv.w.x"] = "1111000";
+    funct7["fmv.x.d"] = "1110001";
+    funct7["fmv.d.x"] = "1111001";
+    funct3["fmv.x.w"] = funct3["fmv.w.x"] = funct3["fmv.x.d"] = funct3["fmv.d.x"] = "000";
+
+    // SYSTEM: ecall, ebreak and Zicsr, used for fflags, frm and fcsr
+    string csrOps[] = {"csrrw", "csrrs", "csrrc", "csrrwi", "csrrsi", "csrrci", "frcsr", "fscsr", "frrm", "fsrm", "fsrmi", "frflags", "fsflags", "fsflagsi"};
+    for (string op : csrOps)
+    {
+        opcode[op] = "1110011";
+    }
+    opcode["ecall"] = opcode["ebreak"] = "1110011";
+    funct3["ecall"] = funct3["ebreak"] = "000";
+    funct3["csrrw"] = "001";
+    funct3["csrrs"] = "010";
+    funct3["csrrc"] = "011";
+    funct3["csrrwi"] = "101";
+    funct3["csrrsi"] = "110";
+    funct3["csrrci"] = "111";
+
+    // V subset: loads and stores keep the element width in funct3, OP-V instructions keep funct6 in funct7
+    opcode["vsetvli"] = "1010111";
+    funct3["vsetvli"] = "111";
+    string widths[] = {"8", "16", "32", "64"};
+    string widthCodes[] = {"000", "101", "110", "111"};
+    for (int i = 0; i < 4; i++)
+    {
+        opcode["vle" + widths[i] + ".v"] = "0000111";
+        opcode["vlse" + widths[i] + ".v"] = "0000111";
+        opcode["vse" + widths[i] + ".v"] = "0100111";
+        opcode["vsse" + widths[i] + ".v"] = "0100111";
+        funct3["vle" + widths[i] + ".v"] = funct3["vlse" + widths[i] + ".v"] = widthCodes[i];
+        funct3["vse" + widths[i] + ".v"] = funct3["vsse" + widths[i] + ".v"] = widthCodes[i];
+    }
+    string vectorOps[] = {"vadd", "vsub", "vand", "vor", "vxor", "vmul", "vredsum", "vredand", "vredor", "vredxor", "vredminu", "vredmin", "vredmaxu", "vredmax"};
+    string vectorFunct6[] = {"000000", "000010", "001001", "001010", "001011", "100101", "000000", "000001", "000010", "000011", "000100", "000101", "000110", "000111"};
+    for (int i = 0; i < 14; i++)
+    {
+        string op = vectorOps[i];
+        bool mvv = op == "vmul" || op.substr(0, 4) == "vred"; // OPMVV/OPMVX instead of OPIVV/OPIVX/OPIVI
+        string forms[] = {".vv", ".vx", ".vi", ".vs"};
+        string codes[] = {mvv ? "010" : "000", mvv ? "110" : "100", "011", "010"};
+        for (int j = 0; j < 4; j++)
+        {
+            bool reduction = op.substr(0, 4) == "vred";
+            if ((j == 3) != reduction || (j == 2 && (op == "vsub" || op == "vmul")))
+            {
+                continue;
+            }
+            opcode[op + forms[j]] = "1010111";
+            funct3[op + forms[j]] = codes[j];
+            funct7[op + forms[j]] = vectorFunct6[i];
+        }
+    }
+    opcode["vmv.v.v"] = opcode["vmv.v.x"] = opcode["vmv.v.i"] = opcode["vmv.x.s"] = opcode["vmv.s.x"] = "1010111";
+    funct7["vmv.v.v"] = funct7["vmv.v.x"] = funct7["vmv.v.i"] = "010111";
+    funct7["vmv.x.s"] = funct7["vmv.s.x"] = "010000";
+    funct3["vmv.v.v"] = "000";
+    funct3["vmv.v.x"] = "100";
+    funct3["vmv.v.i"] = "011";
+    funct3["vmv.x.s"] = "010";
+    funct3["vmv.s.x"] = "110";
 
     unordered_map<string, string> alias;
     alias["zero"] = "x0";
@@ -495,9 +727,43 @@ int convert()
         pc += 4;
     }
 
+    // RV64C layout: byte address of every line and the 16 bit encoding of the compressible ones
+    vector<vector<string> > tokens;
+    input.close();
+    input.open("input.s");
+    while (getline(input, line))
+    {
+        if (line[0] == ';')
+        {
+            continue;
+        }
+        tokens.push_back(splitInstruction(line));
+        if (tokens.back().size() > 0 && tokens.back()[0].substr(0, 2) == "c.")
+        {
+            compress = true; // explicit compressed mnemonics need the compressed layout
+        }
+    }
+    vector<long> lineAddress;
+    vector<string> encodings;
+    unordered_map<string, int> byteLabel; // labels and their byte addresses in the compressed layout
+    if (compress)
+    {
+        unordered_map<string, int> labelLine;
+        for (auto it = label.begin(); it != label.end(); it++)
+        {
+            labelLine[it->first] = it->second / 4;
+        }
+        lineAddress = layoutText(tokens, labelLine, alias, encodings);
+        for (auto it = label.begin(); it != label.end(); it++)
+        {
+            byteLabel[it->first] = lineAddress[it->second / 4];
+        }
+    }
+
     input.close();
     input.open("input.s"); // close file and again open it to move to beginning of it
     pc = 0;                // restarting from beginning
+    int index = -1;        // line index in the layout
     while (getline(input, line))
     {
         string ans = "";
@@ -505,6 +771,7 @@ int convert()
         { // starting with semicolon is treated as a comment
             continue;
         }
+        index++;
         if (comments.find(pc) != comments.end())
         {
             line = line.substr(0, comments[pc]);
@@ -539,13 +806,43 @@ int convert()
         {
             continue;
         }
+        string ordering = "00"; // aq and rl bits of the atomics
+        if (instr.length() > 5 && instr.substr(instr.length() - 5) == ".aqrl")
+        {
+            ordering = "11";
+            instr = instr.substr(0, instr.length() - 5);
+        }
+        else if (instr.length() > 3 && instr.substr(instr.length() - 3) == ".aq")
+        {
+            ordering = "10";
+            instr = instr.substr(0, instr.length() - 3);
+        }
+        else if (instr.length() > 3 && instr.substr(instr.length() - 3) == ".rl")
+        {
+            ordering = "01";
+            instr = instr.substr(0, instr.length() - 3);
+        }
+        if (compress && encodings[index] != "") // compressed form chosen by the layout
+        {
+            cout << binToHex(encodings[index]) << endl;
+            pc += 4;
+            continue;
+        }
+        if (instr.substr(0, 2) == "c.")
+        {
+            cout << "Line " << (pc / 4 + 1) << ": " << instr << " cannot be encoded with these operands" << endl;
+            break;
+        }
+        // branches and jumps measure their offsets in bytes of the compressed layout
+        int here = compress ? lineAddress[index] : pc;
+        unordered_map<string, int> &targets = compress ? byteLabel : label;
         if (opcode.find(instr) == opcode.end())
         {
             cout << "instr is " << instr << endl;
             cout << "Line " << (pc / 4 + 1) << ": instruction " << instr << " not found" << endl;
             break;
         }
-        if (opcode[instr] == "0110011") // R type instructions and,xor,or,add,sub,sll,srl,sra,slt,sltu
+        if (opcode[instr] == "0110011" || opcode[instr] == "0111011") // R type instructions and,xor,or,add,sub,sll,srl,sra,slt,sltu and the M extension
         {
             vector<string> registers;
             bool err;
@@ -571,7 +868,7 @@ int convert()
             }
             ans = funct7[instr] + bitset<5>(rs2).to_string() + bitset<5>(rs1).to_string() + funct3[instr] + bitset<5>(rd).to_string() + opcode[instr];
         }
-        else if (opcode[instr] == "0010011") // I type instructions addi, andi, ori, xori, slti, sltiu, slli, srli, srai, jalr
+        else if (opcode[instr] == "0010011" || opcode[instr] == "0011011") // I type instructions addi, andi, ori, xori, slti, sltiu, slli, srli, srai and their W forms
         {
             vector<string> arguments;
             int count = 0;
@@ -609,7 +906,15 @@ int convert()
                     return 0;
                 }
             }
-            if (instr == "srai") // special case of srai where the 6 MSB bits are always having value 16
+            if (instr == "slliw" || instr == "srliw" || instr == "sraiw")
+            {
+                if (imm > 31 || imm < 0)
+                {
+                    cout << "Line " << (pc / 4 + 1) << " :Cannot shift by " << imm << " bits" << endl;
+                    return 0;
+                }
+            }
+            if (instr == "srai" || instr == "sraiw") // special case of srai where the 6 MSB bits are always having value 16
             {
                 int imm_6_11 = hexToInt("0x10", pc / 4 + 1);
 
@@ -697,7 +1002,7 @@ int convert()
                 break;
             }
 
-            pair<int, bool> res1 = getImmediate(arguments[2], pc, label, true);
+            pair<int, bool> res1 = getImmediate(arguments[2], here, targets, true);
             int curr_label = res1.first;
             if (curr_label > 4095 || curr_label < -4096)
             {
@@ -707,7 +1012,7 @@ int convert()
             int neg = (arguments[2][0] == '-' ? 1 : 0);
             if (res1.second)
             {
-                imm = curr_label / 4 * 2;
+                imm = curr_label / 2;
             }
             else
             {
@@ -739,15 +1044,15 @@ int convert()
                 break;
             }
             int neg = (arguments[1][0] == '-' ? 1 : 0);
-            int curr_label = getImmediate(arguments[1], pc, label, true).first;
-            bool flag = getImmediate(arguments[1], pc, label, true).second;
+            int curr_label = getImmediate(arguments[1], here, targets, true).first;
+            bool flag = getImmediate(arguments[1], here, targets, true).second;
             if (curr_label > 1048575 || curr_label < -1048576)
             {
                 cout << "Line: " << (pc / 4 + 1) << " value cannot be stored in 21 bits" << endl;
                 return 0;
             }
             if (flag)
-                imm = (curr_label / 4) * 2;
+                imm = curr_label / 2;
             else
                 imm = (curr_label + (neg ? -1 : 0)) / 2;
 
@@ -843,6 +1148,203 @@ int convert()
             
             ans = bitset<20>(imm_12_31).to_string() + bitset<5>(rd).to_string() + opcode[instr];
         }
+        else if (opcode[instr] == "0001111") // fence, ordering every kind of access before every kind after
+        {
+            ans = "0000" + string("1111") + string("1111") + bitset<5>(0).to_string() + "000" + bitset<5>(0).to_string() + opcode[instr];
+        }
+        else if (opcode[instr] == "0101111") // A type lr, sc, amo
+        {
+            bool isLr = instr.substr(0, 3) == "lr.";
+            vector<string> arguments = getArguments(pc / 4 + 1, isLr ? 2 : 3, args, true).first;
+            int rd, rs1, rs2;
+            rd = getRegister(arguments[0], alias, pc / 4 + 1);
+            rs2 = isLr ? 0 : getRegister(arguments[1], alias, pc / 4 + 1);
+            rs1 = getRegister(arguments[isLr ? 1 : 2], alias, pc / 4 + 1);
+            if (rd == -1 || rs1 == -1 || rs2 == -1)
+                break;
+            if (checkRegister(rd, pc / 4 + 1) || checkRegister(rs1, pc / 4 + 1) || checkRegister(rs2, pc / 4 + 1))
+            {
+                break;
+            }
+            ans = funct7[instr].substr(0, 5) + ordering + bitset<5>(rs2).to_string() + bitset<5>(rs1).to_string() + funct3[instr] + bitset<5>(rd).to_string() + opcode[instr];
+        }
+        else if (instr == "ecall" || instr == "ebreak")
+        {
+            ans = bitset<12>(instr == "ebreak" ? 1 : 0).to_string() + bitset<5>(0).to_string() + funct3[instr] + bitset<5>(0).to_string() + opcode[instr];
+        }
+        else if (opcode[instr] == "1110011") // csrrw, csrrs, csrrc and their immediate forms, fcsr pseudo instructions
+        {
+            vector<string> tokens = expandFloatCsr(splitInstruction(instr + " " + args));
+            int line = pc / 4 + 1;
+            if (tokens.size() != 4)
+            {
+                cout << "Line " << line << ": Wrong number of arguments" << endl;
+                break;
+            }
+            string op = tokens[0];
+            int rd = getRegister(tokens[1], alias, line);
+            int csr = getFloatCsr(tokens[2]);
+            int rs1;
+            if (op[op.length() - 1] == 'i')
+            {
+                pair<int, bool> imm = getImmediate(tokens[3], pc, label, false);
+                rs1 = (imm.second || imm.first < 0 || imm.first > 31) ? -1 : imm.first;
+            }
+            else
+                rs1 = getRegister(tokens[3], alias, line);
+            if (csr == -1)
+            {
+                cout << "Line " << line << ": CSR " << tokens[2] << " not supported" << endl;
+                break;
+            }
+            if (rd == -1 || rs1 == -1)
+                break;
+            ans = bitset<12>(csr).to_string() + bitset<5>(rs1).to_string() + funct3[op] + bitset<5>(rd).to_string() + opcode[instr];
+        }
+        else if (instr[0] == 'f' && (opcode[instr] == "0000111" || opcode[instr] == "0100111" || opcode[instr] == "1010011" || opcode[instr] == "1000011" || opcode[instr] == "1000111" || opcode[instr] == "1001011" || opcode[instr] == "1001111")) // F and D
+        {
+            vector<string> tokens = splitInstruction(instr + " " + args);
+            int line = pc / 4 + 1;
+            if (opcode[instr] == "0000111" || opcode[instr] == "0100111") // flw, fld: fd, imm(rs1), fsw, fsd: fs2, imm(rs1)
+            {
+                if (tokens.size() != 4)
+                {
+                    cout << "Line " << line << ": Wrong number of arguments" << endl;
+                    break;
+                }
+                int freg = getFloatRegister(tokens[1], line);
+                int rs1 = getRegister(tokens[3], alias, line);
+                pair<int, bool> imm = getImmediate(tokens[2], pc, label, false);
+                if (freg == -1 || rs1 == -1)
+                    break;
+                if (imm.second || imm.first > 2047 || imm.first < -2048)
+                {
+                    cout << "Line: " << line << " Value cannot be stored in 12 bits" << endl;
+                    break;
+                }
+                string offset = bitset<12>(imm.first).to_string();
+                if (opcode[instr] == "0000111")
+                    ans = offset + bitset<5>(rs1).to_string() + funct3[instr] + bitset<5>(freg).to_string() + opcode[instr];
+                else
+                    ans = offset.substr(0, 7) + bitset<5>(freg).to_string() + bitset<5>(rs1).to_string() + funct3[instr] + offset.substr(7) + opcode[instr];
+            }
+            else
+            {
+                // rounding mode, dyn unless given; conversions that are always exact use rne like other assemblers
+                string rm = "111";
+                if (tokens.size() > 1 && getRoundingMode(tokens.back()) != -1)
+                {
+                    rm = bitset<3>(getRoundingMode(tokens.back())).to_string();
+                    tokens.pop_back();
+                }
+                else if (instr == "fcvt.d.s" || instr == "fcvt.d.w" || instr == "fcvt.d.wu")
+                    rm = "000";
+                string op = instr.substr(0, instr.find('.'));
+                string types = instr.substr(instr.find('.') + 1);
+                string dst = types.substr(0, types.find('.'));
+                string src = types.substr(types.find('.') + 1);
+                bool fused = opcode[instr] != "1010011";
+                int count = (op == "fsqrt" || op == "fclass" || op == "fmv" || op == "fcvt") ? 2 : fused ? 4 : 3;
+                if (tokens.size() != count + 1)
+                {
+                    cout << "Line " << line << ": Wrong number of arguments" << endl;
+                    break;
+                }
+                bool intDst = op == "feq" || op == "flt" || op == "fle" || op == "fclass" || (op == "fmv" && dst == "x") || (op == "fcvt" && dst != "s" && dst != "d");
+                bool intSrc = (op == "fmv" && src == "x") || (op == "fcvt" && src != "s" && src != "d");
+                int regs[4] = {0, 0, 0, 0};
+                bool valid = true;
+                for (int i = 0; i < count; i++)
+                {
+                    bool isInt = (i == 0 && intDst) || (i == 1 && intSrc);
+                    regs[i] = isInt ? getRegister(tokens[i + 1], alias, line) : getFloatRegister(tokens[i + 1], line);
+                    valid = valid && regs[i] != -1;
+                }
+                if (!valid)
+                    break;
+                // unary operations select their variant with rs2
+                if (op == "fcvt" && (intDst || intSrc))
+                {
+                    string type = intDst ? dst : src;
+                    regs[2] = (type == "w") ? 0 : (type == "wu") ? 1 : (type == "l") ? 2 : 3;
+                }
+                else if (instr == "fcvt.s.d")
+                    regs[2] = 1;
+                else if (count == 2)
+                    regs[2] = 0;
+                string field3 = funct3[instr] == "" ? rm : funct3[instr];
+                string funct = fused ? bitset<5>(regs[3]).to_string() + funct7[instr] : funct7[instr];
+                ans = funct + bitset<5>(regs[2]).to_string() + bitset<5>(regs[1]).to_string() + field3 + bitset<5>(regs[0]).to_string() + opcode[instr];
+            }
+        }
+        else if (opcode[instr] == "1010111" || opcode[instr] == "0000111" || opcode[instr] == "0100111") // V subset, unmasked
+        {
+            vector<string> tokens = splitInstruction(instr + " " + args);
+            int line = pc / 4 + 1;
+            if (instr == "vsetvli")
+            {
+                int vtypei = tokens.size() >= 4 ? vtypeImmediate(vector<string>(tokens.begin() + 3, tokens.end())) : -1;
+                if (vtypei == -1)
+                {
+                    cout << "Line " << line << ": Invalid vector type" << endl;
+                    break;
+                }
+                int rd = getRegister(tokens[1], alias, line);
+                int rs1 = getRegister(tokens[2], alias, line);
+                if (rd == -1 || rs1 == -1)
+                    break;
+                ans = "0" + bitset<11>(vtypei).to_string() + bitset<5>(rs1).to_string() + funct3[instr] + bitset<5>(rd).to_string() + opcode[instr];
+            }
+            else if (opcode[instr] != "1010111") // vle, vlse, vse, vsse: vd, (rs1)[, rs2]
+            {
+                bool strided = instr[2] == 's' || instr[3] == 's';
+                if (tokens.size() != (strided ? 4 : 3))
+                {
+                    cout << "Line " << line << ": Wrong number of arguments" << endl;
+                    break;
+                }
+                int vd = getVectorRegister(tokens[1], line);
+                int rs1 = getRegister(tokens[2], alias, line);
+                int rs2 = strided ? getRegister(tokens[3], alias, line) : 0;
+                if (vd == -1 || rs1 == -1 || rs2 == -1)
+                    break;
+                ans = "000" + string("0") + (strided ? "10" : "00") + "1" + bitset<5>(rs2).to_string() + bitset<5>(rs1).to_string() + funct3[instr] + bitset<5>(vd).to_string() + opcode[instr];
+            }
+            else
+            {
+                // vmv.v.* and vmv.s.x have no vs2, vmv.x.s writes a scalar register
+                bool noVs2 = instr.substr(0, 5) == "vmv.v" || instr == "vmv.s.x";
+                if (tokens.size() != (noVs2 || instr == "vmv.x.s" ? 3 : 4))
+                {
+                    cout << "Line " << line << ": Wrong number of arguments" << endl;
+                    break;
+                }
+                int vd = instr == "vmv.x.s" ? getRegister(tokens[1], alias, line) : getVectorRegister(tokens[1], line);
+                int vs2 = noVs2 ? 0 : getVectorRegister(tokens[2], line);
+                string source = tokens[tokens.size() - 1];
+                int field = 0;
+                char form = instr[instr.length() - 1];
+                if (instr == "vmv.x.s")
+                    field = 0;
+                else if (form == 'v' || form == 's')
+                    field = getVectorRegister(source, line);
+                else if (form == 'x')
+                    field = getRegister(source, alias, line);
+                else
+                {
+                    pair<int, bool> imm = getImmediate(source, pc, label, false);
+                    if (imm.second || imm.first < -16 || imm.first > 15)
+                    {
+                        cout << "Line " << line << ": Immediate value cannot be stored in 5 bits" << endl;
+                        break;
+                    }
+                    field = imm.first & 31;
+                }
+                if (vd == -1 || vs2 == -1 || field == -1)
+                    break;
+                ans = funct7[instr] + "1" + bitset<5>(vs2).to_string() + bitset<5>(field).to_string() + funct3[instr] + bitset<5>(vd).to_string() + opcode[instr];
+            }
+        }
         cout << binToHex(ans) << endl;
         pc += 4;
     }
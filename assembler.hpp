@@ -75,4 +75,11 @@ pair<vector<string>, bool> getArguments(int line, int count, string args, bool f
 
 pair<int, bool> getImmediate(string str, int pc, unordered_map<string, int> label, bool flag);
 
-int convert();
\ No newline at end of file
+/*
+    Function to assemble input.s. With compress set (or when the file uses c.* mnemonics)
+    instructions with an RV64C form are emitted as 16 bit codes and the text is laid out
+    in bytes, branch and jump offsets included
+    params: {bool} compress
+    return: {int}
+*/
+int convert(bool compress = false);
\ No newline at end of file
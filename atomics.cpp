@@ -0,0 +1,126 @@
+/**
+ * This file contains the LR/SC reservation tracking and the contention
+ * statistics of the RV64A atomic instructions
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include "atomics.h"
+
+using namespace std;
+
+thread_local atomic_domain localAtomics;
+thread_local atomic_domain *atomics = &localAtomics;
+
+void setReservation(int hart, unsigned long address)
+{
+    lock_guard<recursive_mutex> guard(atomics->lock);
+    if (!atomics->reserved[hart])
+    {
+        atomics->reserved[hart] = true;
+        atomics->active++;
+    }
+    atomics->reservations[hart] = address & ~7UL;
+}
+
+bool takeReservation(int hart, unsigned long address)
+{
+    lock_guard<recursive_mutex> guard(atomics->lock);
+    if (!atomics->reserved[hart])
+    {
+        return false;
+    }
+    bool valid = atomics->reservations[hart] == (address & ~7UL);
+    atomics->reserved[hart] = false;
+    atomics->active--;
+    return valid;
+}
+
+void clearReservations(unsigned long address, int size, int writer)
+{
+    if (atomics->active == 0)
+    {
+        return;
+    }
+    lock_guard<recursive_mutex> guard(atomics->lock);
+    for (int i = 0; i < 64; i++)
+    {
+        if (i == writer || !atomics->reserved[i])
+        {
+            continue;
+        }
+        if (address < atomics->reservations[i] + 8 && address + size > atomics->reservations[i])
+        {
+            atomics->reserved[i] = false;
+            atomics->active--;
+        }
+    }
+}
+
+unique_lock<recursive_mutex> lockMemory()
+{
+    if (!atomics->parallel)
+    {
+        return unique_lock<recursive_mutex>();
+    }
+    return unique_lock<recursive_mutex>(atomics->lock);
+}
+
+void recordAmo(unsigned long address)
+{
+    lock_guard<recursive_mutex> guard(atomics->lock);
+    atomics->stats[address].amos++;
+}
+
+void recordLr(unsigned long address)
+{
+    lock_guard<recursive_mutex> guard(atomics->lock);
+    atomics->stats[address].lrs++;
+}
+
+void recordSc(unsigned long address, bool success)
+{
+    lock_guard<recursive_mutex> guard(atomics->lock);
+    if (success)
+    {
+        atomics->stats[address].scSuccess++;
+    }
+    else
+    {
+        atomics->stats[address].scFail++;
+    }
+}
+
+void printAtomicStats(int count)
+{
+    lock_guard<recursive_mutex> guard(atomics->lock);
+    vector<pair<unsigned long, atomic_stats> > sorted(atomics->stats.begin(), atomics->stats.end());
+    sort(sorted.begin(), sorted.end(), [](const pair<unsigned long, atomic_stats> &a, const pair<unsigned long, atomic_stats> &b)
+         {
+             long x = a.second.amos + a.second.scFail;
+             long y = b.second.amos + b.second.scFail;
+             return x != y ? x > y : a.first < b.first; });
+    cout << "Atomic contention (top " << count << " addresses):" << endl;
+    for (int i = 0; i < sorted.size() && i < count; i++)
+    {
+        atomic_stats &curr = sorted[i].second;
+        long scTotal = curr.scSuccess + curr.scFail;
+        cout << "Address: 0x" << hex << sorted[i].first << dec;
+        cout << " ,AMO=" << curr.amos;
+        cout << " ,LR=" << curr.lrs;
+        cout << " ,SC Success=" << curr.scSuccess;
+        cout << " ,SC Fail=" << curr.scFail;
+        cout << " ,SC Fail Rate=" << fixed << setprecision(2) << (scTotal != 0 ? (float)curr.scFail / scTotal : 0) << endl;
+    }
+}
+
+void resetAtomics()
+{
+    lock_guard<recursive_mutex> guard(atomics->lock);
+    for (int i = 0; i < 64; i++)
+    {
+        atomics->reserved[i] = false;
+    }
+    atomics->active = 0;
+    atomics->stats.clear();
+}
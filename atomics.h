@@ -0,0 +1,101 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+using namespace std;
+
+/*
+    Contention counters of one address used by the atomic instructions
+*/
+class atomic_stats
+{
+public:
+    long amos;
+    long lrs;
+    long scSuccess;
+    long scFail;
+
+    atomic_stats()
+    {
+        amos = 0;
+        lrs = 0;
+        scSuccess = 0;
+        scFail = 0;
+    }
+};
+
+/*
+    Reservations and contention counters of every hart sharing one memory. The lock
+    serialises the atomic instructions of all harts so every AMO and LR/SC pair sees a
+    consistent view of the reservations and memory. While the harts run in parallel the
+    stores take it as well, so none lands inside an AMO or between an SC and the
+    reservation it checks
+*/
+class atomic_domain
+{
+public:
+    recursive_mutex lock;
+    unsigned long reservations[64]; // reserved doubleword of each hart
+    bool reserved[64];              // whether the hart holds a reservation
+    atomic<int> active;             // number of harts holding a reservation
+    bool parallel;                  // harts run at the same time rather than taking turns
+    unordered_map<unsigned long, atomic_stats> stats;
+
+    atomic_domain()
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            reservations[i] = 0;
+            reserved[i] = false;
+        }
+        active = 0;
+        parallel = false;
+    }
+};
+
+/*
+    Domain used by this thread, harts point it at one shared domain
+*/
+extern thread_local atomic_domain *atomics;
+
+/*
+    Places the reservation of hart on the doubleword holding address
+*/
+void setReservation(int hart, unsigned long address);
+
+/*
+    Checks and clears the reservation of hart, true if it still covers address
+*/
+bool takeReservation(int hart, unsigned long address);
+
+/*
+    Drops the reservation of every hart other than writer overlapping the written bytes.
+    Called on every store, it returns immediately while no reservation is held
+*/
+void clearReservations(unsigned long address, int size, int writer);
+
+/*
+    Returns the domain lock, held while the harts run in parallel and empty otherwise. Guest
+    memory accesses hold it so they are atomic with respect to the AMOs and SCs
+*/
+unique_lock<recursive_mutex> lockMemory();
+
+/*
+    Counters used by the contention report
+*/
+void recordAmo(unsigned long address);
+void recordLr(unsigned long address);
+void recordSc(unsigned long address, bool success);
+
+/*
+    Prints the addresses with the most AMOs and failed SCs
+*/
+void printAtomicStats(int count);
+
+/*
+    Clears the reservations and the contention counters of this thread's domain
+*/
+void resetAtomics();
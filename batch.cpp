@@ -0,0 +1,235 @@
+/**
+ * This file contains the batch mode which runs many programs from a manifest
+ * on a pool of host threads, each thread owning one reusable simulator instance
+ */
+
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <chrono>
+#include <iomanip>
+#include "batch.h"
+
+using namespace std;
+
+string decToHex(long int num);
+
+/*
+    Queue of job indices owned by one worker. The owner pops from the back,
+    the other workers steal from the front
+*/
+class worker_queue
+{
+public:
+    mutex lock;
+    deque<int> jobs;
+};
+
+bool readManifest(string file, vector<batch_job> &jobs)
+{
+    ifstream input(file);
+    if (!input.is_open())
+    {
+        cout << "Manifest " << file << " not found" << endl;
+        return false;
+    }
+    string line;
+    while (getline(input, line))
+    {
+        if (line.length() == 0 || line[0] == ';')
+        {
+            continue;
+        }
+        stringstream ss(line);
+        string program = "";
+        string config = "";
+        ss >> program >> config;
+        if (program == "")
+        {
+            continue;
+        }
+        jobs.push_back(batch_job(program, config));
+    }
+    input.close();
+    return true;
+}
+
+/*
+    FNV-1a hash of the whole guest memory, used to compare final memory states cheaply
+*/
+unsigned long long hashMemory()
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (unsigned long i = 0; i < memsize; i++)
+    {
+        hash ^= memory[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*
+    Takes the next job for worker id, first from its own queue and otherwise by stealing from another worker.
+    Returns -1 once every queue is empty
+*/
+int nextJob(vector<worker_queue> &queues, int id)
+{
+    {
+        lock_guard<mutex> guard(queues[id].lock);
+        if (!queues[id].jobs.empty())
+        {
+            int job = queues[id].jobs.back();
+            queues[id].jobs.pop_back();
+            return job;
+        }
+    }
+    for (int i = 1; i < queues.size(); i++)
+    {
+        int victim = (id + i) % queues.size();
+        lock_guard<mutex> guard(queues[victim].lock);
+        if (!queues[victim].jobs.empty())
+        {
+            int job = queues[victim].jobs.front();
+            queues[victim].jobs.pop_front();
+            return job;
+        }
+    }
+    return -1;
+}
+
+/*
+    Body of one worker thread. The simulator globals are thread_local, so the thread reuses its
+    own registers and memory for every job, and keeps one cache per configuration file
+*/
+void batchWorker(vector<worker_queue> &queues, vector<batch_job> &jobs, int id)
+{
+    unordered_map<string, cache *> caches;
+    int job;
+    while ((job = nextJob(queues, id)) != -1)
+    {
+        batch_job &curr = jobs[job];
+        auto start = chrono::steady_clock::now();
+
+        cache *newCache = NULL;
+        if (curr.cache_config != "")
+        {
+            if (caches.find(curr.cache_config) == caches.end())
+            {
+                caches[curr.cache_config] = enableCache(curr.cache_config);
+            }
+            newCache = caches[curr.cache_config];
+            if (newCache != NULL)
+            {
+                resetCache(newCache);
+            }
+        }
+
+        ifstream check(curr.program);
+        if (check.is_open())
+        {
+            check.close();
+            curr.loaded = loadProgram(curr.program);
+        }
+        if (curr.loaded)
+        {
+            run(false, newCache != NULL, newCache);
+            curr.completed = mainPC >= 0 && (mainPC / 4) >= lines.size();
+            for (int i = 0; i < 32; i++)
+            {
+                curr.regs[i] = registers[i];
+            }
+            curr.memHash = hashMemory();
+            if (newCache != NULL)
+            {
+                curr.hits = newCache->hits;
+                curr.misses = newCache->misses;
+            }
+        }
+        curr.wallTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    for (auto it = caches.begin(); it != caches.end(); it++)
+    {
+        delete it->second;
+    }
+}
+
+bool runBatch(string manifest, string outputFile, int numThreads)
+{
+    vector<batch_job> jobs;
+    if (!readManifest(manifest, jobs))
+    {
+        return false;
+    }
+    if (numThreads <= 0)
+    {
+        numThreads = thread::hardware_concurrency();
+        if (numThreads <= 0)
+        {
+            numThreads = 1;
+        }
+    }
+    if (numThreads > jobs.size() && jobs.size() > 0)
+    {
+        numThreads = jobs.size();
+    }
+
+    // jobs are dealt round robin, idle workers balance the rest by stealing
+    vector<worker_queue> queues(numThreads);
+    for (int i = 0; i < jobs.size(); i++)
+    {
+        queues[i % numThreads].jobs.push_back(i);
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int i = 0; i < numThreads; i++)
+    {
+        workers.push_back(thread(batchWorker, ref(queues), ref(jobs), i));
+    }
+    for (int i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+    double totalTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    ofstream file(outputFile);
+    if (!file.is_open())
+    {
+        cout << "Cannot open " << outputFile << endl;
+        return false;
+    }
+    double simTime = 0;
+    int completed = 0;
+    for (int i = 0; i < jobs.size(); i++)
+    {
+        batch_job &curr = jobs[i];
+        simTime += curr.wallTime;
+        file << "Program: " << curr.program << endl;
+        if (!curr.loaded)
+        {
+            file << "Status: Load Failed" << endl
+                 << endl;
+            continue;
+        }
+        completed += curr.completed;
+        file << "Status: " << (curr.completed ? "OK" : "Error") << endl;
+        file << "Wall Time: " << fixed << setprecision(6) << curr.wallTime << "s" << endl;
+        file << "Registers:";
+        for (int j = 0; j < 32; j++)
+        {
+            file << " 0x" << decToHex(curr.regs[j]);
+        }
+        file << endl;
+        file << "Memory Hash: 0x" << hex << curr.memHash << dec << endl;
+        if (curr.cache_config != "")
+        {
+            file << "D-cache statistics: Accesses=" << curr.hits + curr.misses << " ,Hit=" << curr.hits << " ,Miss=" << curr.misses << endl;
+        }
+        file << endl;
+    }
+    file << "Programs: " << jobs.size() << " ,Completed: " << completed << " ,Threads: " << numThreads << endl;
+    file << "Total Wall Time: " << fixed << setprecision(6) << totalTime << "s" << endl;
+    file << "Simulation Time: " << fixed << setprecision(6) << simTime << "s" << endl;
+    file.close();
+    return true;
+}
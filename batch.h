@@ -0,0 +1,55 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include "simulator.h"
+
+using namespace std;
+
+/*
+    One program of the batch along with its (optional) cache configuration
+    and the results collected after running it
+*/
+class batch_job
+{
+public:
+    string program;
+    string cache_config; // empty if the program runs without cache
+    bool loaded;
+    bool completed;
+    long int regs[32];
+    unsigned long long memHash;
+    int hits;
+    int misses;
+    double wallTime; // seconds spent inside loadProgram() + run()
+
+    batch_job(string program, string cache_config)
+    {
+        this->program = program;
+        this->cache_config = cache_config;
+        loaded = false;
+        completed = false;
+        for (int i = 0; i < 32; i++)
+        {
+            regs[i] = 0;
+        }
+        memHash = 0;
+        hits = 0;
+        misses = 0;
+        wallTime = 0;
+    }
+};
+
+/*
+    Reads the manifest, one program per line followed by an optional cache config file.
+    Lines starting with ';' are comments
+*/
+bool readManifest(string file, vector<batch_job> &jobs);
+
+/*
+    Runs every program of the manifest on a work stealing pool of numThreads host threads
+    (0 uses all cores) and writes the aggregated results to outputFile
+*/
+bool runBatch(string manifest, string outputFile, int numThreads = 0);
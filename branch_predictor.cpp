@@ -0,0 +1,680 @@
+/**
+ * This file contains the branch predictors. They follow the retired branches of the functional
+ * simulator, predict the next pc of every branch before learning its outcome and count the
+ * mispredictions. The first predictor runs in step with the simulator so the timing models can
+ * charge its mispredictions, the others catch up in batches on host threads
+ */
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <functional>
+#include <unordered_map>
+#include "simulator.h"
+#include "pipeline.h"
+#include "branch_predictor.h"
+
+using namespace std;
+
+#define BRANCH_BATCH 65536       // branches recorded before the other predictors catch up
+#define HISTORY_BUFFER 2048      // global outcomes kept for TAGE, a power of two
+#define TAGE_MAX_HISTORY 1024    // longest TAGE history
+#define TAGE_MIN_HISTORY 4       // history of the first tagged table
+#define TAGE_TAG_BITS 9          // tag width of the tagged tables
+#define TAGE_AGING_PERIOD 262144 // branches between two halvings of the useful counters
+
+/*
+    A retired branch as handed to the predictors
+*/
+class branch_record
+{
+public:
+    int pc;
+    int target; // pc reached when taken
+    int kind;
+    bool taken;
+};
+
+/*
+    Set associative table of the targets of taken branches, replaced LRU
+*/
+class branch_target_buffer
+{
+public:
+    int sets;
+    int ways;
+    vector<int> pcs;
+    vector<int> targets;
+    vector<long> used;
+    long now;
+
+    void reset(int entries, int ways)
+    {
+        this->ways = ways;
+        sets = entries / ways;
+        pcs.assign(entries, -1);
+        targets.assign(entries, 0);
+        used.assign(entries, 0);
+        now = 0;
+    }
+
+    // target of the branch at pc, -1 on a miss
+    int lookup(int pc)
+    {
+        int base = (pc / 4) % sets * ways;
+        for (int i = base; i < base + ways; i++)
+        {
+            if (pcs[i] == pc)
+            {
+                used[i] = ++now;
+                return targets[i];
+            }
+        }
+        return -1;
+    }
+
+    void update(int pc, int target)
+    {
+        int base = (pc / 4) % sets * ways;
+        int victim = base;
+        for (int i = base; i < base + ways; i++)
+        {
+            if (pcs[i] == pc)
+            {
+                victim = i;
+                break;
+            }
+            if (used[i] < used[victim])
+            {
+                victim = i;
+            }
+        }
+        pcs[victim] = pc;
+        targets[victim] = target;
+        used[victim] = ++now;
+    }
+};
+
+/*
+    Circular return address stack, a push onto a full stack overwrites the oldest entry
+*/
+class return_stack
+{
+public:
+    vector<int> entries;
+    int top;
+    int count;
+
+    void reset(int depth)
+    {
+        entries.assign(depth, 0);
+        top = 0;
+        count = 0;
+    }
+
+    void push(int pc)
+    {
+        top = (top + 1) % entries.size();
+        entries[top] = pc;
+        count = min(count + 1, (int)entries.size());
+    }
+
+    // predicted return address, -1 when empty
+    int pop()
+    {
+        if (count == 0)
+        {
+            return -1;
+        }
+        int pc = entries[top];
+        top = (top + entries.size() - 1) % entries.size();
+        count--;
+        return pc;
+    }
+};
+
+/*
+    The last length outcomes of the global history folded into width bits by xor, updated as
+    one outcome enters the window and one leaves it
+*/
+class folded_history
+{
+public:
+    unsigned int value;
+    int length;
+    int width;
+
+    void reset(int length, int width)
+    {
+        value = 0;
+        this->length = length;
+        this->width = width;
+    }
+
+    void update(int newest, int oldest)
+    {
+        value = (value << 1) | newest;
+        value ^= oldest << (length % width);
+        value ^= value >> width;
+        value &= (1u << width) - 1;
+    }
+};
+
+class tage_entry
+{
+public:
+    int tag;           // -1 while unallocated
+    signed char count; // 3-bit signed counter, taken when non-negative
+    unsigned char useful;
+};
+
+/*
+    One predictor configuration: a direction predictor with its own BTB and RAS
+*/
+class branch_predictor
+{
+public:
+    string name; // the configuration as written
+    string kind;
+    int entries;
+    int historyBits;
+    int tables;
+    int tableEntries;
+    int maxHistory;
+    int btbEntries;
+    int btbWays;
+    int rasDepth;
+
+    vector<unsigned char> counters; // bimodal, gshare, the bimodal side of tournament and the TAGE base
+    vector<unsigned char> global;   // the gshare side of tournament
+    vector<unsigned char> chooser;  // tournament: 2 or more picks the gshare side
+    unsigned long ghr;
+    vector<vector<tage_entry> > tagged;
+    vector<int> lengths;
+    vector<folded_history> indexFold, tagFold, tagFold2;
+    vector<unsigned char> history;
+    int head;
+    long updates;
+    // TAGE lookup of the branch being predicted
+    vector<int> indices, tags;
+    int provider, alternate;
+    bool providerTaken, alternateTaken;
+
+    branch_target_buffer btb;
+    return_stack ras;
+
+    long branches;
+    long conditional;
+    long directionMisses;
+    long targetMisses;
+    unordered_map<int, pair<long, long> > lineMisses; // pc -> executions, mispredictions
+
+    void reset()
+    {
+        counters.assign(entries, 1);
+        global.assign(kind == "tournament" ? entries : 0, 1);
+        chooser.assign(kind == "tournament" ? entries : 0, 1);
+        ghr = 0;
+        tagged.assign(tables, vector<tage_entry>(tableEntries, tage_entry{-1, 0, 0}));
+        lengths.assign(tables, 0);
+        indexFold.assign(tables, folded_history());
+        tagFold.assign(tables, folded_history());
+        tagFold2.assign(tables, folded_history());
+        int indexBits = log2(max(tableEntries, 1));
+        for (int i = 0; i < tables; i++)
+        {
+            // history lengths grow geometrically from TAGE_MIN_HISTORY to maxHistory
+            double ratio = tables == 1 ? 1 : (double)i / (tables - 1);
+            lengths[i] = tables == 1 ? maxHistory : (int)(TAGE_MIN_HISTORY * pow((double)maxHistory / TAGE_MIN_HISTORY, ratio) + 0.5);
+            indexFold[i].reset(lengths[i], max(indexBits, 1));
+            tagFold[i].reset(lengths[i], TAGE_TAG_BITS);
+            tagFold2[i].reset(lengths[i], TAGE_TAG_BITS - 1);
+        }
+        history.assign(HISTORY_BUFFER, 0);
+        head = 0;
+        updates = 0;
+        indices.assign(tables, 0);
+        tags.assign(tables, 0);
+        btb.reset(btbEntries, btbWays);
+        ras.reset(rasDepth);
+        branches = conditional = directionMisses = targetMisses = 0;
+        lineMisses.clear();
+    }
+
+    bool predictDirection(int pc)
+    {
+        unsigned long index = pc / 4;
+        if (kind == "bimodal")
+        {
+            return counters[index & (entries - 1)] >= 2;
+        }
+        if (kind == "gshare")
+        {
+            return counters[(index ^ ghr) & (entries - 1)] >= 2;
+        }
+        if (kind == "tournament")
+        {
+            bool local = counters[index & (entries - 1)] >= 2;
+            bool shared = global[(index ^ ghr) & (entries - 1)] >= 2;
+            return chooser[index & (entries - 1)] >= 2 ? shared : local;
+        }
+        if (kind == "tage")
+        {
+            // the longest history that hits provides the prediction, the next one is the alternate
+            int indexBits = log2(tableEntries);
+            provider = alternate = -1;
+            for (int i = tables - 1; i >= 0; i--)
+            {
+                indices[i] = (index ^ (index >> indexBits) ^ indexFold[i].value) & (tableEntries - 1);
+                tags[i] = (index ^ tagFold[i].value ^ (tagFold2[i].value << 1)) & ((1 << TAGE_TAG_BITS) - 1);
+                if (tagged[i][indices[i]].tag == tags[i])
+                {
+                    if (provider == -1)
+                        provider = i;
+                    else if (alternate == -1)
+                        alternate = i;
+                }
+            }
+            bool base = counters[index & (entries - 1)] >= 2;
+            providerTaken = provider != -1 ? tagged[provider][indices[provider]].count >= 0 : base;
+            alternateTaken = alternate != -1 ? tagged[alternate][indices[alternate]].count >= 0 : base;
+            return providerTaken;
+        }
+        return false; // static
+    }
+
+    // trains the tables read by the last predictDirection
+    void updateDirection(int pc, bool taken)
+    {
+        unsigned long index = pc / 4;
+        if (kind == "bimodal")
+        {
+            train(counters[index & (entries - 1)], taken);
+        }
+        else if (kind == "gshare")
+        {
+            train(counters[(index ^ ghr) & (entries - 1)], taken);
+        }
+        else if (kind == "tournament")
+        {
+            unsigned char &local = counters[index & (entries - 1)];
+            unsigned char &shared = global[(index ^ ghr) & (entries - 1)];
+            if ((local >= 2) != (shared >= 2))
+            {
+                train(chooser[index & (entries - 1)], (shared >= 2) == taken);
+            }
+            train(local, taken);
+            train(shared, taken);
+        }
+        else if (kind == "tage")
+        {
+            updateTage(index, taken);
+        }
+        ghr = ((ghr << 1) | taken) & ((1UL << historyBits) - 1);
+    }
+
+    void updateTage(unsigned long index, bool taken)
+    {
+        if (provider != -1)
+        {
+            tage_entry &entry = tagged[provider][indices[provider]];
+            if (providerTaken != alternateTaken)
+            {
+                if (providerTaken == taken && entry.useful < 3)
+                    entry.useful++;
+                else if (providerTaken != taken && entry.useful > 0)
+                    entry.useful--;
+            }
+            entry.count = taken ? min(entry.count + 1, 3) : max(entry.count - 1, -4);
+        }
+        else
+        {
+            train(counters[index & (entries - 1)], taken);
+        }
+        // a misprediction allocates an entry in a longer history table whose entry is not useful
+        if (providerTaken != taken && provider < tables - 1)
+        {
+            bool allocated = false;
+            for (int i = provider + 1; i < tables && !allocated; i++)
+            {
+                tage_entry &entry = tagged[i][indices[i]];
+                if (entry.useful == 0)
+                {
+                    entry.tag = tags[i];
+                    entry.count = taken ? 0 : -1;
+                    allocated = true;
+                }
+            }
+            for (int i = provider + 1; i < tables && !allocated; i++)
+            {
+                tage_entry &entry = tagged[i][indices[i]];
+                entry.useful -= entry.useful > 0;
+            }
+        }
+        if (++updates % TAGE_AGING_PERIOD == 0)
+        {
+            for (int i = 0; i < tables; i++)
+            {
+                for (tage_entry &entry : tagged[i])
+                {
+                    entry.useful >>= 1;
+                }
+            }
+        }
+        head = (head + 1) & (HISTORY_BUFFER - 1);
+        history[head] = taken;
+        for (int i = 0; i < tables; i++)
+        {
+            int oldest = history[(head - lengths[i]) & (HISTORY_BUFFER - 1)];
+            indexFold[i].update(taken, oldest);
+            tagFold[i].update(taken, oldest);
+            tagFold2[i].update(taken, oldest);
+        }
+    }
+
+    static void train(unsigned char &counter, bool taken)
+    {
+        if (taken && counter < 3)
+            counter++;
+        else if (!taken && counter > 0)
+            counter--;
+    }
+
+    /*
+        Predicts the next pc of the branch, learns its outcome and returns whether the
+        prediction was wrong
+    */
+    bool resolve(const branch_record &branch)
+    {
+        int next = branch.pc + 4;
+        int predicted = next;
+        bool direction = true;
+        if (branch.kind == BRANCH_CONDITIONAL)
+        {
+            direction = predictDirection(branch.pc);
+        }
+        if (direction)
+        {
+            // without a target the front end keeps fetching sequentially
+            int target = branch.kind == BRANCH_RETURN ? ras.pop() : -1;
+            if (target == -1)
+            {
+                target = btb.lookup(branch.pc);
+            }
+            if (target != -1)
+            {
+                predicted = target;
+            }
+        }
+        bool mispredicted = predicted != (branch.taken ? branch.target : next);
+
+        if (branch.kind == BRANCH_CONDITIONAL)
+        {
+            conditional++;
+            updateDirection(branch.pc, branch.taken);
+            if (direction != branch.taken)
+                directionMisses++;
+            else if (mispredicted)
+                targetMisses++;
+        }
+        else if (mispredicted)
+        {
+            targetMisses++;
+        }
+        if (branch.taken)
+        {
+            btb.update(branch.pc, branch.target);
+        }
+        if (branch.kind == BRANCH_CALL)
+        {
+            ras.push(next);
+        }
+        branches++;
+        pair<long, long> &line = lineMisses[branch.pc];
+        line.first++;
+        line.second += mispredicted;
+        return mispredicted;
+    }
+};
+
+thread_local bool predictorsEnabled = false;
+thread_local vector<branch_predictor> predictors;
+thread_local vector<branch_record> pendingBranches; // branches the predictors after the first have not seen yet
+thread_local long branchInstructions;               // retired instructions, for MPKI
+
+/*
+    Reads the numbers after the name of a line, false if one of them is not a positive integer
+*/
+bool readNumbers(stringstream &ss, vector<int> &numbers)
+{
+    string value;
+    while (ss >> value)
+    {
+        int num = -1;
+        try
+        {
+            size_t pos = 0;
+            num = stoi(value, &pos);
+            num = pos == value.length() ? num : -1;
+        }
+        catch (exception e)
+        {
+            num = -1;
+        }
+        if (num < 1)
+        {
+            return false;
+        }
+        numbers.push_back(num);
+    }
+    return true;
+}
+
+bool powerOfTwo(int num)
+{
+    return (num & (num - 1)) == 0;
+}
+
+bool enableBranchPredictors(string file)
+{
+    vector<string> configs;
+    if (file == "")
+    {
+        configs.push_back("gshare 4096 12");
+    }
+    else
+    {
+        ifstream input(file);
+        if (!input.is_open())
+        {
+            cout << "Predictor file " << file << " not found" << endl;
+            return false;
+        }
+        string line;
+        while (getline(input, line))
+        {
+            configs.push_back(line);
+        }
+        input.close();
+    }
+
+    vector<branch_predictor> configured;
+    int btbEntries = 512, btbWays = 4, rasDepth = 16;
+    for (int lineNum = 1; lineNum <= configs.size(); lineNum++)
+    {
+        stringstream ss(configs[lineNum - 1]);
+        string kind;
+        vector<int> numbers;
+        if (!(ss >> kind) || kind[0] == ';')
+        {
+            continue;
+        }
+        bool valid = readNumbers(ss, numbers);
+        int count = numbers.size();
+        if (kind == "btb" && valid && count == 2 && numbers[0] % numbers[1] == 0)
+        {
+            btbEntries = numbers[0];
+            btbWays = numbers[1];
+            continue;
+        }
+        if (kind == "ras" && valid && count == 1)
+        {
+            rasDepth = numbers[0];
+            continue;
+        }
+        if (kind == "static")
+            valid = valid && count == 0;
+        else if (kind == "bimodal")
+            valid = valid && count == 1 && powerOfTwo(numbers[0]);
+        else if (kind == "gshare" || kind == "tournament")
+            valid = valid && count == 2 && powerOfTwo(numbers[0]) && numbers[1] <= 30;
+        else if (kind == "tage")
+            valid = valid && count == 4 && powerOfTwo(numbers[0]) && numbers[1] <= 16 && powerOfTwo(numbers[2]) && numbers[3] >= TAGE_MIN_HISTORY && numbers[3] <= TAGE_MAX_HISTORY;
+        else
+            valid = false;
+        if (!valid)
+        {
+            cout << "Line " << lineNum << ": Invalid predictor" << endl;
+            return false;
+        }
+
+        branch_predictor predictor;
+        predictor.kind = kind;
+        predictor.entries = count > 0 ? numbers[0] : 1;
+        predictor.historyBits = count == 2 ? numbers[1] : 0;
+        predictor.tables = count == 4 ? numbers[1] : 0;
+        predictor.tableEntries = count == 4 ? numbers[2] : 0;
+        predictor.maxHistory = count == 4 ? numbers[3] : 0;
+        predictor.btbEntries = btbEntries;
+        predictor.btbWays = btbWays;
+        predictor.rasDepth = rasDepth;
+        predictor.name = kind;
+        for (int num : numbers)
+        {
+            predictor.name += " " + to_string(num);
+        }
+        predictor.name += " (BTB " + to_string(btbEntries) + "x" + to_string(btbWays) + ", RAS " + to_string(rasDepth) + ")";
+        configured.push_back(predictor);
+    }
+    if (configured.empty())
+    {
+        cout << "No predictor in " << file << endl;
+        return false;
+    }
+    predictors = configured;
+    predictorsEnabled = true;
+    resetBranchPredictors();
+    return true;
+}
+
+void disableBranchPredictors()
+{
+    predictorsEnabled = false;
+}
+
+void resetBranchPredictors()
+{
+    for (branch_predictor &predictor : predictors)
+    {
+        predictor.reset();
+    }
+    pendingBranches.clear();
+    branchInstructions = 0;
+}
+
+/*
+    Runs the recorded branches through predictors first, first + step, ... up to the end
+*/
+void catchUp(vector<branch_predictor> &all, vector<branch_record> &branches, int first, int step)
+{
+    for (int i = first; i < all.size(); i += step)
+    {
+        for (const branch_record &branch : branches)
+        {
+            all[i].resolve(branch);
+        }
+    }
+}
+
+/*
+    Brings every predictor after the first up to date, splitting them between host threads
+*/
+void runPendingBranches()
+{
+    int others = predictors.size() - 1;
+    if (others > 0 && !pendingBranches.empty())
+    {
+        int numThreads = min(others, max((int)thread::hardware_concurrency(), 1));
+        vector<thread> workers;
+        for (int i = 1; i < numThreads; i++)
+        {
+            workers.push_back(thread(catchUp, ref(predictors), ref(pendingBranches), 1 + i, numThreads));
+        }
+        catchUp(predictors, pendingBranches, 1, numThreads);
+        for (thread &worker : workers)
+        {
+            worker.join();
+        }
+    }
+    pendingBranches.clear();
+}
+
+void branchRetire(timing_instruction &inst)
+{
+    branchInstructions++;
+    if (!inst.isBranch || predictors.empty())
+    {
+        return;
+    }
+    branch_record branch;
+    branch.pc = inst.pc;
+    branch.target = inst.target;
+    branch.kind = inst.branchKind;
+    branch.taken = inst.taken;
+    inst.mispredicted = predictors[0].resolve(branch);
+    if (predictors.size() > 1)
+    {
+        pendingBranches.push_back(branch);
+        if (pendingBranches.size() >= BRANCH_BATCH)
+        {
+            runPendingBranches();
+        }
+    }
+}
+
+void printBranchStats(int count)
+{
+    runPendingBranches();
+    cout << "Branch predictor statistics: Instructions=" << branchInstructions << endl;
+    for (branch_predictor &predictor : predictors)
+    {
+        long misses = predictor.directionMisses + predictor.targetMisses;
+        cout << predictor.name << ":";
+        cout << " Branches=" << predictor.branches << " ,Conditional=" << predictor.conditional;
+        cout << " ,Accuracy=" << fixed << setprecision(2) << (predictor.branches != 0 ? 100.0 * (predictor.branches - misses) / predictor.branches : 100) << "%";
+        cout << " ,MPKI=" << (branchInstructions != 0 ? 1000.0 * misses / branchInstructions : 0);
+        cout << " ,Direction mispredictions=" << predictor.directionMisses;
+        cout << " ,Target mispredictions=" << predictor.targetMisses << endl;
+
+        vector<pair<long, int> > order;
+        for (auto it = predictor.lineMisses.begin(); it != predictor.lineMisses.end(); it++)
+        {
+            if (it->second.second != 0)
+            {
+                order.push_back(make_pair(it->second.second, it->first));
+            }
+        }
+        sort(order.rbegin(), order.rend());
+        for (int i = 0; i < order.size() && i < count; i++)
+        {
+            int pc = order[i].second;
+            pair<long, long> line = predictor.lineMisses[pc];
+            cout << "  Line " << pc / 4 + 1 << ": " << (pc / 4 < lines.size() ? lines[pc / 4].second : "");
+            cout << " ,Executions=" << line.first << " ,Mispredictions=" << line.second;
+            cout << " ,Accuracy=" << fixed << setprecision(2) << 100.0 * (line.first - line.second) / line.first << "%" << endl;
+        }
+    }
+}
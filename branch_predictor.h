@@ -0,0 +1,48 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+class timing_instruction;
+
+extern thread_local bool predictorsEnabled;
+
+/*
+    Turns on the branch predictors. Every predictor sees the same retired branch stream, so one
+    execution compares any number of configurations. The optional file lists one predictor per
+    line, lines starting with ';' are comments:
+        static                                        always not taken
+        bimodal entries                               2-bit counters indexed by pc
+        gshare entries history                        2-bit counters indexed by pc xor the global history
+        tournament entries history                    bimodal and gshare picked by a table of entries 2-bit counters
+        tage entries tables table_entries max_history bimodal base and tagged tables with geometric
+                                                      history lengths from 4 to max_history
+    and the target predictors used by the predictors listed after them:
+        btb entries ways                              branch target buffer (default 512 4)
+        ras depth                                     return address stack (default 16)
+    Table sizes are powers of two. The first predictor steers the pipeline and out-of-order
+    models, the others run on host threads over batches of the recorded branches.
+    Without a file a single gshare 4096 12 is used.
+    Returns false if the file cannot be read or holds an invalid line
+*/
+bool enableBranchPredictors(string file);
+
+void disableBranchPredictors();
+
+/*
+    Clears the predictor tables and statistics, called when a program is loaded
+*/
+void resetBranchPredictors();
+
+/*
+    Runs one retired instruction through the predictors and sets mispredicted for branches
+    from the first predictor
+*/
+void branchRetire(timing_instruction &inst);
+
+/*
+    Prints the accuracy, MPKI and mispredictions by cause of every predictor followed by its
+    count most mispredicted static branches
+*/
+void printBranchStats(int count);
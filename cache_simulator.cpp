@@ -1,5 +1,14 @@
 #include "cache_simulator.h"
+#include "prefetcher.h"
+#include "dram.h"
 #include <iomanip>
+#include <algorithm>
+#include <math.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 using namespace std;
 
 cache *enableCache(string file_name)
@@ -11,9 +20,43 @@ cache *enableCache(string file_name)
     int block_size;
     int associativity;
     string write_back_policy;
+    string write_miss_policy = "";
     string replacement_policy;
+    string coherence_protocol = "MESI";
+    bool protocolRead = false;
+    unordered_map<string, int> settings = {{"victim_cache", 0}, {"write_buffer", 0}, {"write_buffer_drain", 8}, {"seed", 1}, {"heatmap_window", 0}};
     while (getline(file, line))
     {
+        if (i >= 6)
+        {
+            // coherence protocol and settings
+            stringstream ss(line);
+            string setting, rest;
+            int value = -1;
+            ss >> setting;
+            bool protocol = setting == "MESI" || setting == "MOESI" || setting == "NONE";
+            if (setting == "")
+            {
+                i++;
+                continue;
+            }
+            else if (protocol && !protocolRead && !(ss >> rest))
+            {
+                coherence_protocol = setting;
+                protocolRead = true;
+            }
+            else if (settings.find(setting) == settings.end() || !(ss >> value) || ss >> rest || value < 0)
+            {
+                cout << "Invalid file format" << endl;
+                return NULL;
+            }
+            else
+            {
+                settings[setting] = value;
+            }
+            i++;
+            continue;
+        }
         switch (i)
         {
         case 1:
@@ -29,11 +72,16 @@ cache *enableCache(string file_name)
             replacement_policy = line;
             break;
         case 5:
-            write_back_policy = line;
+        {
+            stringstream ss(line);
+            ss >> write_back_policy >> write_miss_policy;
+            if (write_miss_policy != "" && write_miss_policy != "WA" && write_miss_policy != "NWA")
+            {
+                cout << "Invalid file format" << endl;
+                return NULL;
+            }
             break;
-        default:
-            cout << "Invalid file format" << endl;
-            return NULL;
+        }
         }
         i++;
     }
@@ -43,18 +91,52 @@ cache *enableCache(string file_name)
     {
         associativity = cache_size / block_size;
     }
+    vector<string> policies = {"LRU", "FIFO", "RANDOM", "TREE_PLRU", "BIT_PLRU", "SRRIP", "BRRIP", "LFU"};
+    if (find(policies.begin(), policies.end(), replacement_policy) == policies.end())
+    {
+        cout << "Unknown replacement policy " << replacement_policy << endl;
+        return NULL;
+    }
+    bool bitPolicy = replacement_policy != "LRU" && replacement_policy != "FIFO" && replacement_policy != "RANDOM" && replacement_policy != "LFU";
+    if ((bitPolicy && associativity > 64) || (replacement_policy == "TREE_PLRU" && (associativity & (associativity - 1)) != 0))
+    {
+        cout << "Replacement policy " << replacement_policy << " cannot handle " << associativity << " ways" << endl;
+        return NULL;
+    }
     cache *newCache = new cache(cache_size, block_size, associativity, write_back_policy, replacement_policy);
+    newCache->coherence_protocol = coherence_protocol;
+    if (write_miss_policy != "")
+    {
+        newCache->write_allocate = write_miss_policy == "WA";
+    }
+    newCache->victim_entries = settings["victim_cache"];
+    newCache->write_buffer_entries = settings["write_buffer"];
+    newCache->write_buffer_drain = settings["write_buffer_drain"];
+    newCache->replacement.seed = settings["seed"];
+    newCache->heatmap_window = settings["heatmap_window"];
     int num_sets = cache_size / (block_size * associativity);
+    newCache->offset_bits = (int)log2(block_size);
+    newCache->index_bits = (int)log2(num_sets);
+    newCache->table.resize(num_sets);
     for (int i = 0; i < num_sets; i++)
     {
         vector<cache_line *> temp;
         for (int j = 0; j < associativity; j++)
         {
             cache_line *newLine = new cache_line(block_size);
+            newLine->way = j;
             temp.push_back(newLine);
         }
         newCache->table[i] = temp;
     }
+    newCache->tags.assign(num_sets * associativity, INVALID_TAG);
+    resetReplacement(newCache);
+    newCache->set_misses.assign(num_sets * 3, 0);
+    newCache->set_stats.assign(num_sets * 4, 0);
+    newCache->utilisation.assign(block_size + 1, 0);
+    newCache->reuse.assign(REUSE_BUCKETS, 0);
+    newCache->shadow.capacity = cache_size / block_size;
+    resetShadow(newCache);
 
     return newCache;
 }
@@ -70,38 +152,198 @@ void printCacheStatus(cache *newCache)
 
 void invalidateCache(cache *newCache)
 {
-    for (auto it = newCache->table.begin(); it != newCache->table.end(); it++)
+    for (auto &set : newCache->table)
+    {
+        for (int i = 0; i < set.size(); i++)
+        {
+            set[i]->setValid(false);
+        }
+    }
+    newCache->tags.assign(newCache->tags.size(), INVALID_TAG);
+}
+
+void resetCache(cache *newCache)
+{
+    for (auto &set : newCache->table)
     {
-        for (int i = 0; i < it->second.size(); i++)
+        for (int i = 0; i < set.size(); i++)
         {
-            it->second[i]->setValid(false);
+            set[i]->setValid(false);
+            set[i]->setDirty(false);
+            set[i]->setTag(0);
+            set[i]->state = 'I';
+            set[i]->prefetched = false;
+            set[i]->touched.assign(newCache->block_size, false);
+            set[i]->uses = 0;
         }
     }
+    newCache->tags.assign(newCache->tags.size(), INVALID_TAG);
+    newCache->hits = 0;
+    newCache->misses = 0;
+    newCache->invalidations = 0;
+    newCache->upgrades = 0;
+    newCache->interventions = 0;
+    newCache->coherence_misses = 0;
+    newCache->false_sharing_misses = 0;
+    newCache->lost.clear();
+    newCache->compulsory_misses = 0;
+    newCache->capacity_misses = 0;
+    newCache->conflict_misses = 0;
+    newCache->set_misses.assign(newCache->set_misses.size(), 0);
+    resetShadow(newCache);
+    newCache->pc_stats.clear();
+    newCache->set_stats.assign(newCache->set_stats.size(), 0);
+    newCache->heatmap.clear();
+    newCache->utilisation.assign(newCache->utilisation.size(), 0);
+    newCache->reuse.assign(REUSE_BUCKETS, 0);
+    newCache->memory_writes = 0;
+    newCache->memory_latency = 0;
+    newCache->victims.clear();
+    newCache->victim_hits = 0;
+    newCache->write_buffer.clear();
+    newCache->coalesced_writes = 0;
+    newCache->last_drain = 0;
+    resetReplacement(newCache);
+    newCache->prefetches = 0;
+    newCache->useful_prefetches = 0;
+    newCache->late_prefetches = 0;
+    newCache->unused_prefetches = 0;
+    if (newCache->prefetch != NULL)
+    {
+        resetPrefetcher(newCache);
+    }
 }
 
-void printCacheStats(cache *newCache)
+void printCacheStats(cache *newCache, string name)
 {
-    cout << "D-cache statistics:";
+    cout << name << " statistics:";
     cout << " Accesses=" << newCache->hits + newCache->misses;
     cout << " ,Hit=" << newCache->hits;
     cout << " ,Miss=" << newCache->misses;
     cout << " ,Hit Rate=" << fixed << setprecision(2) << (((newCache->hits + newCache->misses) != 0) ? ((float)(newCache->hits) / (newCache->hits + newCache->misses)) : 0) << endl;
+    cout << "Miss classification: Compulsory=" << newCache->compulsory_misses;
+    cout << " ,Capacity=" << newCache->capacity_misses;
+    cout << " ,Conflict=" << newCache->conflict_misses << endl;
+    if (dramEnabled)
+    {
+        // one cycle per hit plus the DRAM latency of the fills
+        int accesses = newCache->hits + newCache->misses;
+        cout << "Memory latency: Fill Cycles=" << newCache->memory_latency;
+        cout << " ,Average Fill Latency=" << (newCache->misses != 0 ? (float)newCache->memory_latency / newCache->misses : 0);
+        cout << " ,AMAT=" << (accesses != 0 ? 1 + (float)newCache->memory_latency / accesses : 0) << " cycles" << endl;
+    }
+    cout << "Write statistics (" << newCache->write_back_policy << ", " << (newCache->write_allocate ? "write allocate" : "no write allocate") << "):";
+    cout << " Memory Writes=" << newCache->memory_writes;
+    if (newCache->write_buffer_entries > 0)
+    {
+        cout << " ,Coalesced Stores=" << newCache->coalesced_writes;
+        cout << " ,Buffered=" << newCache->write_buffer.size();
+    }
+    if (newCache->victim_entries > 0)
+    {
+        cout << " ,Victim Cache Hits=" << newCache->victim_hits;
+    }
+    cout << endl;
+    if (newCache->bus != NULL)
+    {
+        cout << "Coherence statistics (core " << newCache->core << ", " << newCache->bus->protocol << "):";
+        cout << " Invalidations=" << newCache->invalidations;
+        cout << " ,Upgrades=" << newCache->upgrades;
+        cout << " ,Interventions=" << newCache->interventions;
+        cout << " ,Coherence Misses=" << newCache->coherence_misses;
+        cout << " ,False Sharing Misses=" << newCache->false_sharing_misses << endl;
+    }
+    if (newCache->prefetch != NULL)
+    {
+        printPrefetchStats(newCache);
+    }
+}
+
+void printSetMisses(cache *newCache, int count)
+{
+    vector<pair<int, int> > order;
+    for (int idx = 0; idx < newCache->table.size(); idx++)
+    {
+        int *misses = &newCache->set_misses[idx * 3];
+        order.push_back(make_pair(misses[MISS_COMPULSORY] + misses[MISS_CAPACITY] + misses[MISS_CONFLICT], -idx));
+    }
+    // most misses first, lower sets first among equals
+    sort(order.rbegin(), order.rend());
+    cout << "Misses per set:" << endl;
+    for (int i = 0; i < order.size() && (count == 0 || i < count); i++)
+    {
+        int idx = -order[i].second;
+        int *misses = &newCache->set_misses[idx * 3];
+        cout << "Set 0x" << hex << idx << dec << ": Misses=" << order[i].first;
+        cout << " ,Compulsory=" << misses[MISS_COMPULSORY];
+        cout << " ,Capacity=" << misses[MISS_CAPACITY];
+        cout << " ,Conflict=" << misses[MISS_CONFLICT] << endl;
+    }
+}
+
+void printLineUtilisation(cache *newCache)
+{
+    long lines = 0, bytes = 0;
+    for (int used = 0; used < newCache->utilisation.size(); used++)
+    {
+        lines += newCache->utilisation[used];
+        bytes += newCache->utilisation[used] * used;
+    }
+    cout << "Line utilisation: Lines Evicted=" << lines;
+    cout << " ,Average Bytes Used=" << fixed << setprecision(2) << (lines != 0 ? (float)bytes / lines : 0) << " of " << newCache->block_size << endl;
+    // eighths of the block, or single bytes for blocks under 8 bytes
+    int step = max(newCache->block_size / 8, 1);
+    cout << "Bytes used:" << endl;
+    cout << "  0: " << newCache->utilisation[0] << " (" << (lines != 0 ? 100.0 * newCache->utilisation[0] / lines : 0) << "%)" << endl;
+    for (int low = 1; low <= newCache->block_size; low += step)
+    {
+        int high = min(low + step - 1, newCache->block_size);
+        long count = 0;
+        for (int used = low; used <= high; used++)
+        {
+            count += newCache->utilisation[used];
+        }
+        cout << "  " << low;
+        if (high != low)
+        {
+            cout << "-" << high;
+        }
+        cout << ": " << count << " (" << (lines != 0 ? 100.0 * count / lines : 0) << "%)" << endl;
+    }
+    cout << "Demand accesses before eviction:" << endl;
+    for (int bucket = 0; bucket < REUSE_BUCKETS; bucket++)
+    {
+        long count = newCache->reuse[bucket];
+        int low = bucket == 0 ? 0 : 1 << (bucket - 1);
+        int high = bucket == 0 ? 0 : (1 << bucket) - 1;
+        cout << "  " << low;
+        if (bucket == REUSE_BUCKETS - 1)
+        {
+            cout << "+";
+        }
+        else if (high != low)
+        {
+            cout << "-" << high;
+        }
+        cout << ": " << count << " (" << (lines != 0 ? 100.0 * count / lines : 0) << "%)" << endl;
+    }
 }
 
 void dumpCache(cache *newCache, string file_name)
 {
     ofstream file(file_name);
 
-    for (auto it = newCache->table.begin(); it != newCache->table.end(); it++)
+    for (int idx = 0; idx < newCache->table.size(); idx++)
     {
-        for (int i = 0; i < it->second.size(); i++)
+        vector<cache_line *> &set = newCache->table[idx];
+        for (int i = 0; i < set.size(); i++)
         {
-            if (it->second[i]->valid)
+            if (set[i]->valid)
             {
-                file << "Set: 0x" << hex << it->first;
+                file << "Set: 0x" << hex << idx;
                 file << " ,Tag: 0x";
-                file << hex << stoul(it->second[i]->tag, 0, 2);
-                if (it->second[i]->dirty)
+                file << hex << set[i]->tag;
+                if (set[i]->dirty)
                 {
                     file << ", Dirty";
                 }
@@ -114,4 +356,1059 @@ void dumpCache(cache *newCache, string file_name)
         }
     }
     file.close();
-}
\ No newline at end of file
+}
+
+bool exportSetStats(cache *newCache, string file_name)
+{
+    ofstream file(file_name);
+    if (!file.is_open())
+    {
+        cout << "Cannot write " << file_name << endl;
+        return false;
+    }
+    // every window holds the difference between consecutive snapshots, the last one may be partial
+    vector<vector<int> > snapshots = newCache->heatmap;
+    if (snapshots.empty() || snapshots.back() != newCache->set_stats)
+    {
+        snapshots.push_back(newCache->set_stats);
+    }
+    vector<int> previous(newCache->set_stats.size(), 0);
+    int sets = newCache->table.size();
+    bool json = file_name.size() >= 5 && file_name.substr(file_name.size() - 5) == ".json";
+    const char *names[] = {"accesses", "misses", "evictions", "writebacks"};
+    // the records are built in memory and written at once
+    string out;
+    if (json)
+    {
+        out += "{\"sets\": " + to_string(sets) + ", \"window\": " + to_string(newCache->heatmap_window) + ", \"windows\": [";
+    }
+    else
+    {
+        out += "window,set,accesses,misses,evictions,writebacks\n";
+    }
+    for (int w = 0; w < snapshots.size(); w++)
+    {
+        vector<int> &current = snapshots[w];
+        if (json)
+        {
+            out += w == 0 ? "\n  {" : ",\n  {";
+            out += "\"window\": " + to_string(w);
+            for (int k = 0; k < 4; k++)
+            {
+                out += string(", \"") + names[k] + "\": [";
+                for (int idx = 0; idx < sets; idx++)
+                {
+                    out += (idx == 0 ? "" : ",") + to_string(current[idx * 4 + k] - previous[idx * 4 + k]);
+                }
+                out += "]";
+            }
+            out += "}";
+        }
+        else
+        {
+            for (int idx = 0; idx < sets; idx++)
+            {
+                out += to_string(w) + "," + to_string(idx);
+                for (int k = 0; k < 4; k++)
+                {
+                    out += "," + to_string(current[idx * 4 + k] - previous[idx * 4 + k]);
+                }
+                out += "\n";
+            }
+        }
+        previous = current;
+    }
+    if (json)
+    {
+        out += "\n]}\n";
+    }
+    file.write(out.data(), out.size());
+    file.close();
+    return true;
+}
+
+/*
+    Splits the address into the tag bits, the set index and the block offset
+*/
+void splitAddress(cache *newCache, unsigned long address, unsigned long &tag, int &idx, int &offset)
+{
+    tag = address >> (newCache->offset_bits + newCache->index_bits);
+    idx = (address >> newCache->offset_bits) & ((1UL << newCache->index_bits) - 1);
+    offset = address & (newCache->block_size - 1);
+}
+
+/*
+    Rebuilds the base address of the block stored with tag in set idx
+*/
+unsigned long blockAddress(cache *newCache, unsigned long tag, int idx)
+{
+    return (tag << (newCache->index_bits + newCache->offset_bits)) | ((unsigned long)idx << newCache->offset_bits);
+}
+
+/*
+    Way of set idx holding tag, -1 if none. All ways are compared at once, eight per
+    instruction with AVX2 and four with SSE2, and the first bit of the hit mask is the way
+*/
+int findWay(cache *newCache, int idx, unsigned int tag)
+{
+    int ways = newCache->associativity;
+    const unsigned int *tags = &newCache->tags[(long)idx * ways];
+    int i = 0;
+#if defined(__AVX2__)
+    __m256i key8 = _mm256_set1_epi32(tag);
+    for (; i + 8 <= ways; i += 8)
+    {
+        __m256i hits = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(tags + i)), key8);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(hits));
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i key4 = _mm_set1_epi32(tag);
+    for (; i + 4 <= ways; i += 4)
+    {
+        __m128i hits = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(tags + i)), key4);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(hits));
+        if (mask != 0)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    // portable loop for the remaining ways and the hosts without SIMD
+    for (; i < ways; i++)
+    {
+        if (tags[i] == tag)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+cache_line *findLine(cache *newCache, int idx, unsigned long tag)
+{
+    int way = findWay(newCache, idx, tag);
+    return way == -1 ? NULL : newCache->table[idx][way];
+}
+
+/*
+    Copies the tag and valid bit of the line into the tag array after either changed
+*/
+void updateTag(cache *newCache, int idx, cache_line *line)
+{
+    newCache->tags[(long)idx * newCache->associativity + line->way] = line->valid ? line->tag : INVALID_TAG;
+}
+
+void resetReplacement(cache *newCache)
+{
+    replacement_state &state = newCache->replacement;
+    int sets = newCache->table.size();
+    int ways = newCache->associativity;
+    state.next.assign(sets * ways, -1);
+    state.prev.assign(sets * ways, -1);
+    state.head.assign(sets, 0);
+    state.tail.assign(sets, ways - 1);
+    for (int i = 0; i < sets; i++)
+    {
+        for (int j = 0; j < ways; j++)
+        {
+            state.next[i * ways + j] = j + 1 < ways ? j + 1 : -1;
+            state.prev[i * ways + j] = j - 1;
+        }
+    }
+    state.bits.assign(sets, 0);
+    state.rrpv.assign(sets * 4, 0);
+    for (int i = 0; i < sets; i++)
+    {
+        state.rrpv[i * 4 + 3] = ways == 64 ? ~0UL : (1UL << ways) - 1;
+    }
+    state.counts.assign(sets * ways, 0);
+    state.random = state.seed != 0 ? state.seed : 0x9e3779b97f4a7c15UL;
+}
+
+unsigned long nextRandom(replacement_state &state)
+{
+    state.random ^= state.random << 13;
+    state.random ^= state.random >> 7;
+    state.random ^= state.random << 17;
+    return state.random;
+}
+
+/*
+    Moves the way to the front of the list of set idx
+*/
+void moveToFront(cache *newCache, int idx, int way)
+{
+    replacement_state &state = newCache->replacement;
+    int base = idx * newCache->associativity;
+    if (state.head[idx] == way)
+    {
+        return;
+    }
+    int before = state.prev[base + way], after = state.next[base + way];
+    state.next[base + before] = after;
+    if (after != -1)
+        state.prev[base + after] = before;
+    else
+        state.tail[idx] = before;
+    state.prev[base + way] = -1;
+    state.next[base + way] = state.head[idx];
+    state.prev[base + state.head[idx]] = way;
+    state.head[idx] = way;
+}
+
+void setRrpv(cache *newCache, int idx, int way, int value)
+{
+    unsigned long *masks = &newCache->replacement.rrpv[idx * 4];
+    for (int v = 0; v < 4; v++)
+    {
+        masks[v] &= ~(1UL << way);
+    }
+    masks[value] |= 1UL << way;
+}
+
+/*
+    Updates the replacement state of set idx for a hit (fill false) or a fill of the way
+*/
+void touchLine(cache *newCache, int idx, int way, bool fill)
+{
+    replacement_state &state = newCache->replacement;
+    string &policy = newCache->replacement_policy;
+    int ways = newCache->associativity;
+    if (policy == "LRU" || (policy == "FIFO" && fill))
+    {
+        moveToFront(newCache, idx, way);
+    }
+    else if (policy == "TREE_PLRU")
+    {
+        // every node on the path points to the half the way is not in
+        int node = 1;
+        for (int half = ways / 2; half >= 1; half /= 2)
+        {
+            bool right = way & half;
+            state.bits[idx] = right ? state.bits[idx] & ~(1UL << node) : state.bits[idx] | (1UL << node);
+            node = 2 * node + right;
+        }
+    }
+    else if (policy == "BIT_PLRU")
+    {
+        unsigned long all = ways == 64 ? ~0UL : (1UL << ways) - 1;
+        state.bits[idx] |= 1UL << way;
+        if (state.bits[idx] == all)
+        {
+            state.bits[idx] = 1UL << way;
+        }
+    }
+    else if (policy == "SRRIP" || policy == "BRRIP")
+    {
+        int value = 0;
+        if (fill)
+        {
+            value = policy == "BRRIP" && nextRandom(state) % 32 != 0 ? 3 : 2;
+        }
+        setRrpv(newCache, idx, way, value);
+    }
+    else if (policy == "LFU")
+    {
+        unsigned int &count = state.counts[idx * ways + way];
+        count = fill ? 1 : (count == UINT_MAX ? count : count + 1);
+    }
+}
+
+/*
+    Chooses the way of set idx to fill, an invalid way if there is one and otherwise
+    the one picked by the replacement policy
+*/
+int chooseVictim(cache *newCache, int idx)
+{
+    int invalid = findWay(newCache, idx, INVALID_TAG);
+    if (invalid != -1)
+    {
+        return invalid;
+    }
+    replacement_state &state = newCache->replacement;
+    string &policy = newCache->replacement_policy;
+    int ways = newCache->associativity;
+    if (ways == 1)
+    {
+        return 0;
+    }
+    if (policy == "RANDOM")
+    {
+        return nextRandom(state) % ways;
+    }
+    if (policy == "TREE_PLRU")
+    {
+        int node = 1;
+        while (node < ways)
+        {
+            node = 2 * node + ((state.bits[idx] >> node) & 1);
+        }
+        return node - ways;
+    }
+    if (policy == "BIT_PLRU")
+    {
+        return __builtin_ctzl(~state.bits[idx]);
+    }
+    if (policy == "SRRIP" || policy == "BRRIP")
+    {
+        // age every way until one is predicted to be re-referenced in the distant future
+        unsigned long *masks = &state.rrpv[idx * 4];
+        while (masks[3] == 0)
+        {
+            masks[3] = masks[2];
+            masks[2] = masks[1];
+            masks[1] = masks[0];
+            masks[0] = 0;
+        }
+        return __builtin_ctzl(masks[3]);
+    }
+    if (policy == "LFU")
+    {
+        unsigned int *counts = &state.counts[idx * ways];
+        return min_element(counts, counts + ways) - counts;
+    }
+    return state.tail[idx]; // LRU and FIFO
+}
+
+/*
+    Counts a write transaction of the block at baseaddress reaching memory and queues it in the DRAM model
+*/
+void writeTransaction(cache *newCache, unsigned long baseaddress)
+{
+    newCache->memory_writes++;
+    if (dramEnabled)
+    {
+        dramAccess(baseaddress, newCache->block_size, DRAM_WRITE);
+    }
+}
+
+/*
+    Moves a line evicted from set idx into the victim cache, writing back the dirty block the
+    victim cache drops in turn
+*/
+void evictToVictimCache(cache *newCache, cache_line *line, int idx, unsigned char *memory)
+{
+    // hits leave the victim cache, so the first entry is also the least recently used one
+    if (newCache->victims.size() == newCache->victim_entries)
+    {
+        victim_line &dropped = newCache->victims[0];
+        if (dropped.dirty)
+        {
+            for (int k = 0; k < newCache->block_size; k++)
+            {
+                memory[dropped.address + k] = dropped.data[k];
+            }
+            writeTransaction(newCache, dropped.address);
+        }
+        newCache->victims.erase(newCache->victims.begin());
+    }
+    victim_line entry;
+    entry.address = blockAddress(newCache, line->tag, idx);
+    entry.dirty = line->dirty;
+    entry.data = line->data;
+    newCache->victims.push_back(entry);
+}
+
+/*
+    Records the bytes used and the demand accesses of a line leaving the cache
+*/
+void retireLine(cache *newCache, cache_line *line)
+{
+    newCache->utilisation[count(line->touched.begin(), line->touched.end(), true)]++;
+    int bucket = 0;
+    while (bucket < REUSE_BUCKETS - 1 && line->uses >= (1 << bucket))
+    {
+        bucket++;
+    }
+    newCache->reuse[bucket]++;
+}
+
+/*
+    Marks the bytes of a demand access in the line
+*/
+void markUsed(cache_line *line, int offset, int size)
+{
+    line->uses++;
+    for (int k = offset; k < offset + size; k++)
+    {
+        line->touched[k] = true;
+    }
+}
+
+/*
+    Replaces a line of set idx with the block at baseaddress, writing the old block back if it is dirty
+*/
+cache_line *allocateLine(cache *newCache, int idx, unsigned long tag, unsigned long baseaddress, unsigned char *memory)
+{
+    int way = chooseVictim(newCache, idx);
+    cache_line *line = newCache->table[idx][way];
+    if (line->valid && line->prefetched)
+    {
+        newCache->unused_prefetches++;
+    }
+    if (line->valid)
+    {
+        newCache->set_stats[idx * 4 + SET_EVICTIONS]++;
+        newCache->set_stats[idx * 4 + SET_WRITEBACKS] += line->dirty;
+        retireLine(newCache, line);
+    }
+    if (line->valid && newCache->victim_entries > 0 && newCache->bus == NULL)
+    {
+        evictToVictimCache(newCache, line, idx, memory);
+    }
+    else if (line->valid && line->dirty)
+    {
+        unsigned long currBaseAddress = blockAddress(newCache, line->tag, idx);
+        for (int k = 0; k < newCache->block_size; k++)
+        {
+            memory[currBaseAddress + k] = line->data[k];
+        }
+        writeTransaction(newCache, currBaseAddress);
+    }
+    for (int k = 0; k < newCache->block_size; k++)
+    {
+        line->data[k] = memory[baseaddress + k];
+    }
+    line->tag = tag;
+    line->valid = true;
+    updateTag(newCache, idx, line);
+    line->dirty = false;
+    line->prefetched = false;
+    line->state = 'E';
+    line->touched.assign(newCache->block_size, false);
+    line->uses = 0;
+    touchLine(newCache, idx, way, true);
+    return line;
+}
+
+/*
+    Finds the line holding the block at baseaddress in a cache other than the requesting one
+*/
+cache_line *snoopLine(cache *other, unsigned long baseaddress, int &idx)
+{
+    unsigned long tag;
+    int offset;
+    splitAddress(other, baseaddress, tag, idx, offset);
+    return findLine(other, idx, tag);
+}
+
+/*
+    Counts a miss as a coherence miss if the block was lost to an invalidation, and as false sharing
+    if the invalidating write touched none of the bytes accessed now. Returns whether it was one
+*/
+bool classifyCoherenceMiss(cache *newCache, unsigned long baseaddress, int offset, int size)
+{
+    auto it = newCache->lost.find(baseaddress);
+    if (it == newCache->lost.end())
+    {
+        return false;
+    }
+    newCache->coherence_misses++;
+    bool overlap = false;
+    for (int k = offset; k < offset + size && k < newCache->block_size; k++)
+    {
+        overlap = overlap || it->second[k];
+    }
+    if (!overlap)
+    {
+        newCache->false_sharing_misses++;
+    }
+    newCache->lost.erase(it);
+    return true;
+}
+
+void resetShadow(cache *newCache)
+{
+    shadow_cache &shadow = newCache->shadow;
+    shadow.next.clear();
+    shadow.prev.clear();
+    shadow.state.clear();
+    shadow.head = shadow.tail = -1;
+    shadow.size = 0;
+}
+
+/*
+    Runs a demand access to the block through the shadow cache
+    return: {int} 0 on the first access to the block, 1 on a miss, 2 on a hit
+*/
+int shadowAccess(cache *newCache, int block)
+{
+    shadow_cache &shadow = newCache->shadow;
+    if (block >= shadow.state.size())
+    {
+        shadow.next.resize(block + 1, -1);
+        shadow.prev.resize(block + 1, -1);
+        shadow.state.resize(block + 1, 0);
+    }
+    int result = shadow.state[block];
+    if (result == 2)
+    {
+        // unlink before moving to the front
+        if (shadow.head == block)
+        {
+            return result;
+        }
+        shadow.next[shadow.prev[block]] = shadow.next[block];
+        if (shadow.next[block] != -1)
+            shadow.prev[shadow.next[block]] = shadow.prev[block];
+        else
+            shadow.tail = shadow.prev[block];
+    }
+    else if (shadow.size == shadow.capacity)
+    {
+        int evicted = shadow.tail;
+        shadow.tail = shadow.prev[evicted];
+        if (shadow.tail != -1)
+            shadow.next[shadow.tail] = -1;
+        else
+            shadow.head = -1; // the evicted block was the only one
+        shadow.state[evicted] = 1;
+    }
+    else
+    {
+        shadow.size++;
+    }
+    shadow.prev[block] = -1;
+    shadow.next[block] = shadow.head;
+    if (shadow.head != -1)
+        shadow.prev[shadow.head] = block;
+    shadow.head = block;
+    if (shadow.tail == -1)
+        shadow.tail = block;
+    shadow.state[block] = 2;
+    return result;
+}
+
+/*
+    Counts a demand access of set idx and closes the time window of the set statistics when it is full
+*/
+void countSetAccess(cache *newCache, int idx, bool miss)
+{
+    newCache->set_stats[idx * 4 + SET_ACCESSES]++;
+    newCache->set_stats[idx * 4 + SET_MISSES] += miss;
+    if (newCache->heatmap_window > 0 && (newCache->hits + newCache->misses) % newCache->heatmap_window == 0)
+    {
+        newCache->heatmap.push_back(newCache->set_stats);
+    }
+}
+
+/*
+    Feeds a demand access to the shadow cache and sorts a miss into compulsory, capacity or
+    conflict. Coherence misses are left to the coherence statistics
+*/
+void classifyAccess(cache *newCache, unsigned long baseaddress, int idx, bool miss, bool coherence)
+{
+    int shadow = shadowAccess(newCache, baseaddress >> newCache->offset_bits);
+    if (!miss || coherence)
+    {
+        return;
+    }
+    int kind;
+    if (shadow == 0)
+    {
+        kind = MISS_COMPULSORY;
+        newCache->compulsory_misses++;
+    }
+    else if (shadow == 1)
+    {
+        kind = MISS_CAPACITY;
+        newCache->capacity_misses++;
+    }
+    else
+    {
+        kind = MISS_CONFLICT;
+        newCache->conflict_misses++;
+    }
+    newCache->set_misses[idx * 3 + kind]++;
+}
+
+/*
+    Bus read: the other caches see a read miss of the block. A modified copy is written back (MESI)
+    or kept as owner (MOESI), every copy ends up shared. Returns the line supplying the data
+    cache to cache, NULL when the data comes from memory
+*/
+cache_line *busRead(cache *newCache, unsigned long baseaddress, bool &shared, unsigned char *memory)
+{
+    cache_line *supplier = NULL;
+    shared = false;
+    for (auto other : newCache->bus->caches)
+    {
+        int idx;
+        cache_line *line = (other == newCache) ? NULL : snoopLine(other, baseaddress, idx);
+        if (line == NULL)
+        {
+            continue;
+        }
+        shared = true;
+        if (line->state == 'M' && newCache->bus->protocol == "MOESI")
+        {
+            other->interventions++;
+            line->state = 'O';
+            supplier = line;
+        }
+        else if (line->state == 'M')
+        {
+            other->interventions++;
+            for (int k = 0; k < other->block_size; k++)
+            {
+                memory[baseaddress + k] = line->data[k];
+            }
+            line->dirty = false;
+            line->state = 'S';
+        }
+        else if (line->state == 'O')
+        {
+            other->interventions++;
+            supplier = line;
+        }
+        else
+        {
+            line->state = 'S';
+        }
+    }
+    return supplier;
+}
+
+/*
+    Bus invalidation: the other caches drop their copy of the block before it is written, a dirty
+    copy is written back first. The written bytes are remembered to classify the later misses
+*/
+void busInvalidate(cache *newCache, unsigned long baseaddress, int offset, int size, unsigned char *memory)
+{
+    for (auto other : newCache->bus->caches)
+    {
+        int idx;
+        cache_line *line = (other == newCache) ? NULL : snoopLine(other, baseaddress, idx);
+        if (line == NULL)
+        {
+            continue;
+        }
+        if (line->dirty)
+        {
+            other->interventions++;
+            for (int k = 0; k < other->block_size; k++)
+            {
+                memory[baseaddress + k] = line->data[k];
+            }
+        }
+        retireLine(other, line);
+        line->valid = false;
+        line->dirty = false;
+        line->state = 'I';
+        updateTag(other, idx, line);
+        other->invalidations++;
+        vector<bool> &written = other->lost[baseaddress];
+        written.assign(other->block_size, false);
+        for (int k = offset; k < offset + size && k < other->block_size; k++)
+        {
+            written[k] = true;
+        }
+    }
+}
+
+/*
+    On a miss, swaps the block at baseaddress back from the victim cache into set idx. Returns the
+    filled line, NULL if the victim cache does not hold the block
+*/
+cache_line *victimLookup(cache *newCache, int idx, unsigned long tag, unsigned long baseaddress, unsigned char *memory)
+{
+    for (int i = 0; i < newCache->victims.size(); i++)
+    {
+        if (newCache->victims[i].address != baseaddress)
+        {
+            continue;
+        }
+        victim_line entry = newCache->victims[i];
+        newCache->victims.erase(newCache->victims.begin() + i);
+        cache_line *line = allocateLine(newCache, idx, tag, baseaddress, memory);
+        line->data = entry.data;
+        line->dirty = entry.dirty;
+        line->state = entry.dirty ? 'M' : 'E';
+        newCache->victim_hits++;
+        return line;
+    }
+    return NULL;
+}
+
+/*
+    Counts a write transaction of the block at baseaddress, merged into a pending write buffer
+    entry when there is one. A full buffer first writes out its oldest entry
+*/
+void memoryWrite(cache *newCache, unsigned long baseaddress)
+{
+    deque<unsigned long> &buffer = newCache->write_buffer;
+    if (newCache->write_buffer_entries == 0 || newCache->bus != NULL)
+    {
+        writeTransaction(newCache, baseaddress);
+        return;
+    }
+    if (find(buffer.begin(), buffer.end(), baseaddress) != buffer.end())
+    {
+        newCache->coalesced_writes++;
+        return;
+    }
+    if (buffer.size() == newCache->write_buffer_entries)
+    {
+        writeTransaction(newCache, buffer.front());
+        buffer.pop_front();
+    }
+    buffer.push_back(baseaddress);
+}
+
+/*
+    Writes out the oldest write buffer entry every write_buffer_drain accesses. A fill of the
+    block at baseaddress first writes out the entries up to a pending write of that block
+*/
+void drainWriteBuffer(cache *newCache, unsigned long baseaddress, bool fill)
+{
+    deque<unsigned long> &buffer = newCache->write_buffer;
+    int now = newCache->hits + newCache->misses;
+    if (buffer.empty())
+    {
+        newCache->last_drain = now;
+        return;
+    }
+    if (newCache->write_buffer_drain > 0 && now - newCache->last_drain >= newCache->write_buffer_drain)
+    {
+        writeTransaction(newCache, buffer.front());
+        buffer.pop_front();
+        newCache->last_drain = now;
+    }
+    auto pending = find(buffer.begin(), buffer.end(), baseaddress);
+    if (fill && pending != buffer.end())
+    {
+        for (auto it = buffer.begin(); it <= pending; it++)
+        {
+            writeTransaction(newCache, *it);
+        }
+        buffer.erase(buffer.begin(), pending + 1);
+    }
+}
+
+/*
+    Looks up the block for a demand access, letting the victim cache and the stream buffers supply
+    it on a miss, and counts the first demand of a prefetched block
+*/
+cache_line *demandLine(cache *newCache, int idx, unsigned long tag, unsigned long baseaddress, unsigned char *memory, bool &prefetchHit)
+{
+    cache_line *line = findLine(newCache, idx, tag);
+    if (line == NULL && newCache->victim_entries > 0 && newCache->bus == NULL)
+    {
+        line = victimLookup(newCache, idx, tag, baseaddress, memory);
+    }
+    if (line == NULL && newCache->prefetch != NULL && prefetchLookup(newCache, baseaddress, memory))
+    {
+        line = findLine(newCache, idx, tag);
+    }
+    prefetchHit = line != NULL && line->prefetched;
+    if (prefetchHit)
+    {
+        newCache->useful_prefetches++;
+        if (newCache->hits + newCache->misses < line->ready)
+        {
+            newCache->late_prefetches++;
+        }
+        line->prefetched = false;
+    }
+    return line;
+}
+
+bool cacheReadBlock(cache *newCache, unsigned long address, int size, unsigned char *memory, unsigned char *data)
+{
+    unique_lock<mutex> guard;
+    if (newCache->bus != NULL)
+    {
+        guard = unique_lock<mutex>(newCache->bus->lock);
+    }
+    unsigned long tag;
+    int idx, offset;
+    splitAddress(newCache, address, tag, idx, offset);
+    unsigned long baseaddress = address - offset;
+    if (offset + size > newCache->block_size)
+    {
+        cout << "Unaligned Memory Access" << endl;
+        return false;
+    }
+
+    bool prefetchHit;
+    cache_line *line = demandLine(newCache, idx, tag, baseaddress, memory, prefetchHit);
+    bool miss = line == NULL;
+    bool coherence = false;
+    drainWriteBuffer(newCache, baseaddress, miss);
+    if (line != NULL)
+    {
+        newCache->hits++;
+        touchLine(newCache, idx, line->way, false);
+    }
+    else
+    {
+        newCache->misses++;
+        cache_line *supplier = NULL;
+        bool shared = false;
+        if (newCache->bus != NULL)
+        {
+            coherence = classifyCoherenceMiss(newCache, baseaddress, offset, size);
+            supplier = busRead(newCache, baseaddress, shared, memory);
+        }
+        line = allocateLine(newCache, idx, tag, baseaddress, memory);
+        if (supplier != NULL)
+        {
+            line->data = supplier->data;
+        }
+        else if (dramEnabled)
+        {
+            newCache->memory_latency += dramAccess(baseaddress, newCache->block_size, DRAM_READ);
+        }
+        line->state = shared ? 'S' : 'E';
+    }
+
+    for (int k = 0; k < size; k++)
+    {
+        data[k] = line->data[offset + k];
+    }
+    markUsed(line, offset, size);
+    countSetAccess(newCache, idx, miss);
+    classifyAccess(newCache, baseaddress, idx, miss, coherence);
+    if (newCache->prefetch != NULL)
+    {
+        prefetchTrain(newCache, address, miss, prefetchHit, memory);
+    }
+    return true;
+}
+
+bool cacheRead(cache *newCache, unsigned long address, int size, unsigned char *memory, unsigned long &value)
+{
+    unsigned char data[8];
+    if (!cacheReadBlock(newCache, address, size, memory, data))
+    {
+        return false;
+    }
+    value = 0;
+    for (int k = 0; k < size; k++)
+    {
+        value = value | ((unsigned long)data[k] << (k * 8));
+    }
+    return true;
+}
+
+bool cacheWriteBlock(cache *newCache, unsigned long address, int size, const unsigned char *data, unsigned char *memory)
+{
+    unique_lock<mutex> guard;
+    if (newCache->bus != NULL)
+    {
+        guard = unique_lock<mutex>(newCache->bus->lock);
+    }
+    unsigned long tag;
+    int idx, offset;
+    splitAddress(newCache, address, tag, idx, offset);
+    unsigned long baseaddress = address - offset;
+    if (offset + size > newCache->block_size)
+    {
+        cout << "Unaligned Memory Access" << endl;
+        return false;
+    }
+
+    bool prefetchHit;
+    cache_line *line = demandLine(newCache, idx, tag, baseaddress, memory, prefetchHit);
+    bool miss = line == NULL;
+    bool coherence = false;
+    drainWriteBuffer(newCache, baseaddress, miss && newCache->write_allocate);
+    if (line != NULL)
+    {
+        newCache->hits++;
+        touchLine(newCache, idx, line->way, false);
+        if (newCache->bus != NULL && (line->state == 'S' || line->state == 'O'))
+        {
+            newCache->upgrades++;
+            busInvalidate(newCache, baseaddress, offset, size, memory);
+        }
+    }
+    else
+    {
+        newCache->misses++;
+        if (newCache->bus != NULL)
+        {
+            coherence = classifyCoherenceMiss(newCache, baseaddress, offset, size);
+            busInvalidate(newCache, baseaddress, offset, size, memory);
+        }
+        if (newCache->write_allocate)
+        {
+            line = allocateLine(newCache, idx, tag, baseaddress, memory);
+            if (dramEnabled)
+            {
+                newCache->memory_latency += dramAccess(baseaddress, newCache->block_size, DRAM_READ);
+            }
+        }
+    }
+
+    if (newCache->write_back_policy == "WT" || line == NULL)
+    {
+        // write through replaces the value in memory at the same time, a miss without write allocate writes around the cache
+        for (int k = 0; k < size; k++)
+        {
+            memory[address + k] = data[k];
+        }
+        memoryWrite(newCache, baseaddress);
+    }
+    if (line != NULL)
+    {
+        for (int k = 0; k < size; k++)
+        {
+            line->data[offset + k] = data[k];
+        }
+        markUsed(line, offset, size);
+        if (newCache->write_back_policy == "WB")
+        {
+            line->dirty = true;
+            line->state = 'M';
+        }
+        else
+        {
+            line->state = 'E';
+        }
+    }
+    countSetAccess(newCache, idx, miss);
+    classifyAccess(newCache, baseaddress, idx, miss, coherence);
+    if (newCache->prefetch != NULL)
+    {
+        prefetchTrain(newCache, address, miss, prefetchHit, memory);
+    }
+    return true;
+}
+
+bool cacheWrite(cache *newCache, unsigned long address, int size, unsigned long value, unsigned char *memory)
+{
+    unsigned char data[8];
+    for (int k = 0; k < size; k++)
+    {
+        data[k] = (value >> (k * 8)) & 0xff; // little endian format
+    }
+    return cacheWriteBlock(newCache, address, size, data, memory);
+}
+
+bool cacheContains(cache *newCache, unsigned long address)
+{
+    unique_lock<mutex> guard;
+    if (newCache->bus != NULL)
+    {
+        guard = unique_lock<mutex>(newCache->bus->lock);
+    }
+    unsigned long tag;
+    int idx, offset;
+    splitAddress(newCache, address, tag, idx, offset);
+    return findLine(newCache, idx, tag) != NULL;
+}
+
+unsigned long cachePeek(cache *newCache, unsigned long address, int size, unsigned char *memory)
+{
+    unsigned long tag;
+    int idx, offset;
+    splitAddress(newCache, address, tag, idx, offset);
+    unsigned char *bytes = &memory[address - offset];
+    cache_line *line = findLine(newCache, idx, tag);
+    if (line != NULL)
+    {
+        bytes = line->data.data();
+    }
+    for (victim_line &entry : newCache->victims)
+    {
+        if (line == NULL && entry.address == address - offset)
+        {
+            bytes = entry.data.data();
+        }
+    }
+    unsigned long value = 0;
+    for (int i = 0; i < size; i++)
+    {
+        value |= (unsigned long)bytes[offset + i] << (i * 8);
+    }
+    return value;
+}
+
+bool prefetchBlock(cache *newCache, unsigned long baseaddress, int ready, unsigned char *memory)
+{
+    unsigned long tag;
+    int idx, offset;
+    splitAddress(newCache, baseaddress, tag, idx, offset);
+    if (findLine(newCache, idx, tag) != NULL)
+    {
+        return false;
+    }
+    for (victim_line &entry : newCache->victims)
+    {
+        if (entry.address == baseaddress)
+        {
+            return false;
+        }
+    }
+    cache_line *supplier = NULL;
+    bool shared = false;
+    if (newCache->bus != NULL)
+    {
+        supplier = busRead(newCache, baseaddress, shared, memory);
+    }
+    cache_line *line = allocateLine(newCache, idx, tag, baseaddress, memory);
+    if (supplier != NULL)
+    {
+        line->data = supplier->data;
+    }
+    line->state = shared ? 'S' : 'E';
+    line->prefetched = true;
+    line->ready = ready;
+    return true;
+}
+
+void flushCache(cache *newCache, unsigned char *memory)
+{
+    for (int idx = 0; idx < newCache->table.size(); idx++)
+    {
+        for (auto line : newCache->table[idx])
+        {
+            if (line->valid && line->dirty)
+            {
+                unsigned long baseaddress = blockAddress(newCache, line->tag, idx);
+                for (int k = 0; k < newCache->block_size; k++)
+                {
+                    memory[baseaddress + k] = line->data[k];
+                }
+                line->dirty = false;
+                line->state = (line->state == 'M') ? 'E' : 'S';
+                writeTransaction(newCache, baseaddress);
+            }
+        }
+    }
+    for (victim_line &entry : newCache->victims)
+    {
+        if (entry.dirty)
+        {
+            for (int k = 0; k < newCache->block_size; k++)
+            {
+                memory[entry.address + k] = entry.data[k];
+            }
+            entry.dirty = false;
+            writeTransaction(newCache, entry.address);
+        }
+    }
+    for (unsigned long baseaddress : newCache->write_buffer)
+    {
+        writeTransaction(newCache, baseaddress);
+    }
+    newCache->write_buffer.clear();
+}
+
+coherence_bus *connectCaches(vector<cache *> caches, string protocol)
+{
+    coherence_bus *bus = new coherence_bus(protocol);
+    bus->caches = caches;
+    for (int i = 0; i < caches.size(); i++)
+    {
+        caches[i]->bus = bus;
+        caches[i]->core = i;
+    }
+    return bus;
+}
@@ -4,10 +4,27 @@
 #include <fstream>
 #include <sstream>
 #include <climits>
+#include <deque>
 #include <unordered_map>
+#include <mutex>
 
 using namespace std;
 
+class cache;
+class prefetcher;
+
+#define INVALID_TAG 0xffffffffu // tag kept for invalid ways, above any tag of the simulated memory
+// kinds of miss, indexes of the per set miss counts
+#define MISS_COMPULSORY 0
+#define MISS_CAPACITY 1
+#define MISS_CONFLICT 2
+// per set counters, indexes of the set statistics
+#define SET_ACCESSES 0
+#define SET_MISSES 1
+#define SET_EVICTIONS 2
+#define SET_WRITEBACKS 3
+#define REUSE_BUCKETS 12 // demand accesses before eviction: 0, 1, 2-3, 4-7, ... and 1024 or more
+
 class cache_line
 {
 public:
@@ -15,19 +32,29 @@ public:
     bool dirty;
 
     vector<unsigned char> data;
-    string tag;
-    int toa; // most recent time of access
+    unsigned long tag;
+    int way;    // position in its set
+    char state; // coherence state M, O, E, S or I, only used when the cache is on a bus
+    bool prefetched; // filled by the prefetcher and not demanded yet
+    int ready;       // access count at which a prefetched block arrives
+    vector<bool> touched; // bytes demanded since the block was filled
+    int uses;             // demand accesses since the block was filled
 
     cache_line(int size)
     {
         valid = false;
         dirty = false;
-        toa = 0;
+        way = 0;
+        state = 'I';
+        prefetched = false;
+        ready = 0;
+        uses = 0;
         this->data.resize(size);
-        tag = "";
+        this->touched.assign(size, false);
+        tag = 0;
     }
 
-    void setTag(string tag)
+    void setTag(unsigned long tag)
     {
         this->tag = tag;
     }
@@ -43,17 +70,132 @@ public:
     }
 };
 
+/*
+    Block held by the victim cache together with its base address
+*/
+class victim_line
+{
+public:
+    unsigned long address;
+    bool dirty;
+    vector<unsigned char> data;
+};
+
+/*
+    Per set state of the replacement policy, kept so that picking a victim takes constant time
+    or a scan of the ways of one set:
+        LRU, FIFO      doubly linked list of the ways, most recently used (or filled) first
+        TREE_PLRU      tree of ways - 1 bits pointing away from the recent accesses
+        BIT_PLRU       one MRU bit per way, all but the newest cleared once every bit is set
+        SRRIP, BRRIP   2-bit re-reference prediction values kept as one way mask per value.
+                       SRRIP fills at 2, BRRIP at 3 and at 2 once every 32 fills
+        LFU            access count of every line
+        RANDOM         xorshift generator of the cache
+    The bit based policies handle up to 64 ways, TREE_PLRU a power of two of them. The
+    generator is seeded from the configuration, so runs repeat exactly on any thread
+*/
+class replacement_state
+{
+public:
+    vector<int> next, prev;          // LRU and FIFO lists, indexed by set * ways + way
+    vector<int> head, tail;          // first and last way of the list of every set
+    vector<unsigned long> bits;      // PLRU tree or MRU bits of every set
+    vector<unsigned long> rrpv;      // ways with each of the 4 values, indexed by set * 4 + value
+    vector<unsigned int> counts;     // LFU counts, indexed by set * ways + way
+    unsigned long seed;
+    unsigned long random;            // xorshift state
+};
+
+/*
+    Fully associative LRU cache of the same capacity fed with the same demand accesses. A miss
+    it shares is a capacity miss, one it avoids a conflict miss. Blocks are numbered by address
+    over block size and the LRU list lives in arrays indexed by block number, grown as needed
+*/
+class shadow_cache
+{
+public:
+    vector<int> next, prev; // LRU list, most recently used first
+    vector<char> state;     // 0 never accessed, 1 accessed and evicted, 2 resident
+    int head;
+    int tail;
+    int size;
+    int capacity; // blocks
+};
+
+/*
+    Snooping bus connecting the L1 caches of the harts. Every access of a cache on the bus
+    is one bus transaction, serialised by the lock
+*/
+class coherence_bus
+{
+public:
+    string protocol; // MESI or MOESI
+    vector<cache *> caches;
+    mutex lock;
+
+    coherence_bus(string protocol)
+    {
+        this->protocol = protocol;
+    }
+};
+
 class cache
 {
 public:
     int hits;
     int misses;
-    unordered_map<int, vector<cache_line *> > table;
+    // coherence statistics, counted when the cache is attached to a bus
+    int invalidations;        // lines of this cache invalidated by other cores
+    int upgrades;             // S or O to M transitions requested by this cache
+    int interventions;        // times this cache supplied or flushed a dirty block for another core
+    int coherence_misses;     // misses on blocks lost to an invalidation, not counted again as conflict misses
+    int false_sharing_misses; // coherence misses where the invalidating write touched none of the accessed bytes
+    unordered_map<unsigned long, vector<bool> > lost; // invalidated block -> bytes written by the invalidating core
+    coherence_bus *bus;
+    int core;
+    // 3C classification of the misses
+    int compulsory_misses; // first access to the block
+    int capacity_misses;   // also missing in the fully associative shadow cache
+    int conflict_misses;   // every other miss
+    vector<int> set_misses; // indexed by set * 3 + the MISS_ kind
+    shadow_cache shadow;
+    unordered_map<int, pair<long, long> > pc_stats; // pc of the issuing instruction -> accesses, misses
+    vector<int> set_stats;         // indexed by set * 4 + the SET_ counter
+    int heatmap_window;            // accesses per time window of the set statistics, 0 for the whole run only
+    vector<vector<int> > heatmap;  // set_stats at the end of every closed window
+    // spatial locality of the lines leaving the cache by eviction or invalidation
+    vector<long> utilisation; // lines by bytes demanded while resident, 0 to block_size
+    vector<long> reuse;       // lines by demand accesses while resident, in REUSE_BUCKETS buckets
+    // prefetch statistics, counted when a prefetcher is attached
+    prefetcher *prefetch;  // NULL when blocks are only filled on demand
+    int prefetches;        // blocks fetched ahead of demand
+    int useful_prefetches; // prefetched blocks later demanded
+    int late_prefetches;   // useful prefetches demanded before they arrived
+    int unused_prefetches; // prefetched blocks evicted or dropped without being demanded
+    vector<vector<cache_line *> > table; // ways of every set
+    vector<unsigned int> tags;            // tags of all ways set after set, INVALID_TAG where the line is invalid
+    int offset_bits;
+    int index_bits;
     int cache_size;
     int block_size;
     int associativity;
     string write_back_policy;
     string replacement_policy;
+    replacement_state replacement;
+    bool write_allocate; // write misses fill a line, otherwise they write around the cache
+    int memory_writes;   // write transactions reaching memory: write backs, stores sent to memory, drained write buffer entries
+    long memory_latency; // DRAM cycles waited for demand fills, when the DRAM model is on
+    // victim cache, used when the cache is not on a bus
+    int victim_entries; // 0 when there is none
+    vector<victim_line> victims;
+    int victim_hits;    // misses served by the victim cache
+    // coalescing write buffer for the stores sent to memory, used when the cache is not on a bus
+    int write_buffer_entries;          // 0 when every store is its own write transaction
+    int write_buffer_drain;            // accesses between two entries leaving, 0 to drain only when full
+    deque<unsigned long> write_buffer; // blocks with pending stores, oldest first
+    int coalesced_writes;              // stores merged into a pending entry
+    int last_drain;                    // access count of the last drained entry
+    string coherence_protocol; // MESI, MOESI or NONE, used when harts share memory
 
     cache(int cache_size, int block_size, int associativity, string write_back_policy, string replacement_policy)
     {
@@ -62,17 +204,143 @@ public:
         this->associativity = associativity;
         this->write_back_policy = write_back_policy;
         this->replacement_policy = replacement_policy;
+        this->write_allocate = write_back_policy == "WB";
         this->hits = 0;
         this->misses = 0;
+        this->coherence_protocol = "MESI";
+        invalidations = 0;
+        upgrades = 0;
+        interventions = 0;
+        coherence_misses = 0;
+        false_sharing_misses = 0;
+        compulsory_misses = 0;
+        capacity_misses = 0;
+        conflict_misses = 0;
+        heatmap_window = 0;
+        bus = NULL;
+        core = 0;
+        memory_writes = 0;
+        memory_latency = 0;
+        victim_entries = 0;
+        victim_hits = 0;
+        write_buffer_entries = 0;
+        write_buffer_drain = 8;
+        coalesced_writes = 0;
+        last_drain = 0;
+        prefetch = NULL;
+        prefetches = 0;
+        useful_prefetches = 0;
+        late_prefetches = 0;
+        unused_prefetches = 0;
     }
 };
 
+/*
+    Reads the cache configuration: size, block size, associativity (0 for fully associative),
+    replacement policy (LRU, FIFO, RANDOM, TREE_PLRU, BIT_PLRU, SRRIP, BRRIP or LFU) and write
+    policy, one per line. The write policy is WB or WT optionally
+    followed by WA or NWA, by default WB allocates on a write miss and WT writes around. The
+    optional lines after it are the coherence protocol (MESI, MOESI or NONE, default MESI) and
+    "setting value" pairs:
+        victim_cache n         fully associative victim cache of n blocks
+        write_buffer n         coalescing write buffer of n blocks for the stores sent to memory
+        write_buffer_drain n   accesses between two entries leaving the buffer, 0 to drain only
+                               when it is full (default 8)
+        seed n                 seed of the RANDOM and BRRIP generator (default 1)
+        heatmap_window n       accesses per time window of the per set statistics, 0 to keep only
+                               the totals (default 0)
+    The victim cache and write buffer are not used while the cache is on a coherence bus
+*/
 cache *enableCache(string file_name);
 
 void printCacheStatus(cache *newCache);
 
+/*
+    Puts the replacement state of every set back to its initial order and reseeds the generator
+*/
+void resetReplacement(cache *newCache);
+
+/*
+    Empties the fully associative shadow cache used to classify misses
+*/
+void resetShadow(cache *newCache);
+
 void invalidateCache(cache *newCache);
 
-void printCacheStats(cache *newCache);
+/*
+    Brings the cache back to its freshly enabled state (all lines invalid, statistics zeroed)
+    so the same object can be reused for another program
+*/
+void resetCache(cache *newCache);
+
+/*
+    Prints the cache statistics, name tells which cache they belong to
+*/
+void printCacheStats(cache *newCache, string name = "D-cache");
+
+/*
+    Prints the count sets with the most misses (every set when count is 0) and the kinds of
+    their misses
+*/
+void printSetMisses(cache *newCache, int count = 0);
+
+/*
+    Prints the histograms of the bytes used and of the demand accesses of the lines that left the cache
+*/
+void printLineUtilisation(cache *newCache);
+
+/*
+    Reads size bytes at address through the cache, filling the block from memory on a miss.
+    Returns false on an access crossing a block boundary
+*/
+bool cacheRead(cache *newCache, unsigned long address, int size, unsigned char *memory, unsigned long &value);
+
+/*
+    Writes the low size bytes of value at address through the cache following the write policy
+    and the write allocate policy. Returns false on an access crossing a block boundary
+*/
+bool cacheWrite(cache *newCache, unsigned long address, int size, unsigned long value, unsigned char *memory);
+
+/*
+    Same as cacheRead and cacheWrite for up to a whole block of bytes, counted as one access.
+    Used by the vector loads and stores to move data at cache line granularity
+*/
+bool cacheReadBlock(cache *newCache, unsigned long address, int size, unsigned char *memory, unsigned char *data);
+
+bool cacheWriteBlock(cache *newCache, unsigned long address, int size, const unsigned char *data, unsigned char *memory);
+
+/*
+    Checks whether the block holding address is in the cache without counting an access
+*/
+bool cacheContains(cache *newCache, unsigned long address);
+
+/*
+    Reads size bytes at address from the cache, its victim cache or memory without counting an
+    access or changing the replacement state. The bytes must lie in one block
+*/
+unsigned long cachePeek(cache *newCache, unsigned long address, int size, unsigned char *memory);
+
+/*
+    Fills the block at baseaddress ahead of demand, the block counts as arriving once the cache
+    has seen ready accesses. Returns false if the block is already cached
+*/
+bool prefetchBlock(cache *newCache, unsigned long baseaddress, int ready, unsigned char *memory);
+
+/*
+    Writes every dirty line back to memory and drains the write buffer
+*/
+void flushCache(cache *newCache, unsigned char *memory);
+
+/*
+    Connects the caches with a snooping bus running protocol (MESI or MOESI)
+*/
+coherence_bus *connectCaches(vector<cache *> caches, string protocol);
+
+void dumpCache(cache *newCache, string file_name);
 
-void dumpCache(cache *newCache, string file_name);
\ No newline at end of file
+/*
+    Writes the accesses, misses, evictions and dirty write backs of every set, one record per set
+    and time window, as JSON if the file name ends in .json and as CSV otherwise.
+    Returns false if the file cannot be written
+*/
+bool exportSetStats(cache *newCache, string file_name);
\ No newline at end of file
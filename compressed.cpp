@@ -0,0 +1,412 @@
+/**
+ * This file contains the RV64C support shared by the assembler and the simulator:
+ * choosing the compressed form of an instruction, encoding it and laying out
+ * the byte addresses of a text section mixing 16 and 32 bit instructions
+ */
+
+#include <bitset>
+#include "compressed.h"
+
+using namespace std;
+
+vector<string> splitInstruction(string line)
+{
+    vector<string> tokens;
+    size_t comment = line.find(';');
+    if (comment != string::npos)
+    {
+        line = line.substr(0, comment);
+    }
+    size_t colon = line.find(':');
+    if (colon != string::npos)
+    {
+        line = line.substr(colon + 1);
+    }
+    string curr = "";
+    for (int i = 0; i <= line.length(); i++)
+    {
+        if (i == line.length() || line[i] == ' ' || line[i] == '\t' || line[i] == ',' || line[i] == '(' || line[i] == ')')
+        {
+            if (curr != "")
+            {
+                tokens.push_back(curr);
+            }
+            curr = "";
+        }
+        else
+        {
+            curr += line[i];
+        }
+    }
+    return tokens;
+}
+
+/*
+    Register number of the operand, -1 if it is not a register
+*/
+int compressedRegister(string reg, unordered_map<string, string> &alias)
+{
+    if (alias.find(reg) != alias.end())
+    {
+        reg = alias[reg];
+    }
+    if (reg.length() < 2 || reg.length() > 3 || reg[0] != 'x')
+    {
+        return -1;
+    }
+    for (int i = 1; i < reg.length(); i++)
+    {
+        if (reg[i] < '0' || reg[i] > '9')
+        {
+            return -1;
+        }
+    }
+    int num = stoi(reg.substr(1));
+    return num > 31 ? -1 : num;
+}
+
+/*
+    Value of a decimal, hex or binary operand, ok is false if the operand is not a number
+*/
+long compressedImmediate(string imm, bool &ok)
+{
+    ok = false;
+    bool neg = imm.length() > 0 && imm[0] == '-';
+    string digits = neg ? imm.substr(1) : imm;
+    int base = 10;
+    if (digits.length() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X'))
+    {
+        base = 16;
+        digits = digits.substr(2);
+    }
+    else if (digits.length() > 2 && digits[0] == '0' && (digits[1] == 'b' || digits[1] == 'B'))
+    {
+        base = 2;
+        digits = digits.substr(2);
+    }
+    try
+    {
+        size_t pos = 0;
+        long value = stol(digits, &pos, base);
+        if (pos != digits.length())
+        {
+            return 0;
+        }
+        ok = true;
+        return neg ? -value : value;
+    }
+    catch (exception e)
+    {
+        return 0;
+    }
+}
+
+/*
+    Low n bits of v as a binary string
+*/
+string field(long v, int n)
+{
+    return bitset<32>(v).to_string().substr(32 - n);
+}
+
+/*
+    Bits hi..lo of v as a binary string
+*/
+string slice(long v, int hi, int lo)
+{
+    return field(v >> lo, hi - lo + 1);
+}
+
+bool isPrime(int reg) // x8-x15, the registers reachable by the 3 bit fields
+{
+    return reg >= 8 && reg <= 15;
+}
+
+string prime(int reg)
+{
+    return field(reg - 8, 3);
+}
+
+vector<string> expandCompressed(vector<string> tokens)
+{
+    vector<string> none;
+    if (tokens.size() == 0)
+    {
+        return none;
+    }
+    string instr = tokens[0];
+    int count = tokens.size() - 1;
+    vector<string> ans;
+    if (instr == "c.nop" && count == 0)
+    {
+        ans = {"addi", "x0", "x0", "0"};
+    }
+    else if ((instr == "c.addi" || instr == "c.addiw" || instr == "c.slli" || instr == "c.srli" || instr == "c.srai" || instr == "c.andi") && count == 2)
+    {
+        ans = {instr.substr(2), tokens[1], tokens[1], tokens[2]};
+    }
+    else if (instr == "c.li" && count == 2)
+    {
+        ans = {"addi", tokens[1], "x0", tokens[2]};
+    }
+    else if (instr == "c.lui" && count == 2)
+    {
+        ans = {"lui", tokens[1], tokens[2]};
+    }
+    else if (instr == "c.addi16sp" && count == 2)
+    {
+        ans = {"addi", tokens[1], tokens[1], tokens[2]};
+    }
+    else if (instr == "c.addi4spn" && count == 3)
+    {
+        ans = {"addi", tokens[1], tokens[2], tokens[3]};
+    }
+    else if (instr == "c.mv" && count == 2)
+    {
+        ans = {"add", tokens[1], "x0", tokens[2]};
+    }
+    else if ((instr == "c.add" || instr == "c.sub" || instr == "c.xor" || instr == "c.or" || instr == "c.and" || instr == "c.subw" || instr == "c.addw") && count == 2)
+    {
+        ans = {instr.substr(2), tokens[1], tokens[1], tokens[2]};
+    }
+    else if ((instr == "c.lw" || instr == "c.ld" || instr == "c.sw" || instr == "c.sd") && count == 3)
+    {
+        ans = {instr.substr(2), tokens[1], tokens[2], tokens[3]};
+    }
+    else if ((instr == "c.lwsp" || instr == "c.ldsp" || instr == "c.swsp" || instr == "c.sdsp") && count == 3)
+    {
+        ans = {instr.substr(2, 2), tokens[1], tokens[2], tokens[3]};
+    }
+    else if (instr == "c.j" && count == 1)
+    {
+        ans = {"jal", "x0", tokens[1]};
+    }
+    else if (instr == "c.jr" && count == 1)
+    {
+        ans = {"jalr", "x0", "0", tokens[1]};
+    }
+    else if (instr == "c.jalr" && count == 1)
+    {
+        ans = {"jalr", "x1", "0", tokens[1]};
+    }
+    else if ((instr == "c.beqz" || instr == "c.bnez") && count == 2)
+    {
+        ans = {instr == "c.beqz" ? "beq" : "bne", tokens[1], "x0", tokens[2]};
+    }
+    return ans;
+}
+
+string compressInstruction(vector<string> tokens, unordered_map<string, string> &alias, long address, unordered_map<string, long> &targets)
+{
+    if (tokens.size() == 0)
+    {
+        return "";
+    }
+    string instr = tokens[0];
+    int count = tokens.size() - 1;
+    bool ok = true;
+
+    if ((instr == "addi" || instr == "addiw" || instr == "andi" || instr == "slli" || instr == "srli" || instr == "srai") && count == 3)
+    {
+        int rd = compressedRegister(tokens[1], alias);
+        int rs1 = compressedRegister(tokens[2], alias);
+        long imm = compressedImmediate(tokens[3], ok);
+        if (rd == -1 || rs1 == -1 || !ok)
+        {
+            return "";
+        }
+        bool fits6 = imm >= -32 && imm <= 31;
+        if (instr == "addi")
+        {
+            if (rd == 0 && rs1 == 0 && imm == 0) // c.nop
+                return "000" + field(0, 1) + field(0, 5) + field(0, 5) + "01";
+            if (rd == rs1 && rd != 0 && imm != 0 && fits6) // c.addi
+                return "000" + slice(imm, 5, 5) + field(rd, 5) + slice(imm, 4, 0) + "01";
+            if (rs1 == 0 && rd != 0 && fits6) // c.li
+                return "010" + slice(imm, 5, 5) + field(rd, 5) + slice(imm, 4, 0) + "01";
+            if (rd == 2 && rs1 == 2 && imm != 0 && imm % 16 == 0 && imm >= -512 && imm <= 496) // c.addi16sp
+                return "011" + slice(imm, 9, 9) + "00010" + slice(imm, 4, 4) + slice(imm, 6, 6) + slice(imm, 8, 7) + slice(imm, 5, 5) + "01";
+            if (isPrime(rd) && rs1 == 2 && imm > 0 && imm % 4 == 0 && imm <= 1020) // c.addi4spn
+                return "000" + slice(imm, 5, 4) + slice(imm, 9, 6) + slice(imm, 2, 2) + slice(imm, 3, 3) + prime(rd) + "00";
+            if (rd != 0 && rs1 != 0 && imm == 0) // c.mv
+                return "1000" + field(rd, 5) + field(rs1, 5) + "10";
+        }
+        else if (instr == "addiw" && rd == rs1 && rd != 0 && fits6)
+        {
+            return "001" + slice(imm, 5, 5) + field(rd, 5) + slice(imm, 4, 0) + "01";
+        }
+        else if (instr == "andi" && rd == rs1 && isPrime(rd) && fits6)
+        {
+            return "100" + slice(imm, 5, 5) + "10" + prime(rd) + slice(imm, 4, 0) + "01";
+        }
+        else if (instr == "slli" && rd == rs1 && rd != 0 && imm > 0 && imm < 64)
+        {
+            return "000" + slice(imm, 5, 5) + field(rd, 5) + slice(imm, 4, 0) + "10";
+        }
+        else if ((instr == "srli" || instr == "srai") && rd == rs1 && isPrime(rd) && imm > 0 && imm < 64)
+        {
+            return "100" + slice(imm, 5, 5) + (instr == "srli" ? "00" : "01") + prime(rd) + slice(imm, 4, 0) + "01";
+        }
+    }
+    else if (instr == "lui" && count == 2)
+    {
+        int rd = compressedRegister(tokens[1], alias);
+        long imm = compressedImmediate(tokens[2], ok);
+        // the 6 bit field is sign extended to the 20 bit upper immediate
+        if (ok && rd != -1 && rd != 0 && rd != 2 && ((imm >= 1 && imm <= 31) || (imm >= 0xfffe0 && imm <= 0xfffff)))
+        {
+            return "011" + slice(imm, 5, 5) + field(rd, 5) + slice(imm, 4, 0) + "01";
+        }
+    }
+    else if ((instr == "add" || instr == "sub" || instr == "xor" || instr == "or" || instr == "and" || instr == "addw" || instr == "subw") && count == 3)
+    {
+        int rd = compressedRegister(tokens[1], alias);
+        int rs1 = compressedRegister(tokens[2], alias);
+        int rs2 = compressedRegister(tokens[3], alias);
+        if (rd == -1 || rs1 == -1 || rs2 == -1)
+        {
+            return "";
+        }
+        bool commutative = instr != "sub" && instr != "subw";
+        if (rd != rs1 && commutative && rd == rs2) // rd = rs2 op rs1 is the same instruction
+        {
+            rs2 = rs1;
+            rs1 = rd;
+        }
+        if (instr == "add" && rd != 0)
+        {
+            if (rs1 == 0 && rs2 != 0) // c.mv
+                return "1000" + field(rd, 5) + field(rs2, 5) + "10";
+            if (rd == rs1 && rs2 != 0) // c.add
+                return "1001" + field(rd, 5) + field(rs2, 5) + "10";
+        }
+        else if (instr != "add" && rd == rs1 && isPrime(rd) && isPrime(rs2))
+        {
+            string funct = (instr == "sub" || instr == "subw") ? "00" : (instr == "xor" || instr == "addw") ? "01"
+                                                                    : (instr == "or")                       ? "10"
+                                                                                                            : "11";
+            string word = (instr == "subw" || instr == "addw") ? "1" : "0";
+            return "100" + word + "11" + prime(rd) + funct + prime(rs2) + "01";
+        }
+    }
+    else if ((instr == "lw" || instr == "ld" || instr == "sw" || instr == "sd") && count == 3)
+    {
+        int reg = compressedRegister(tokens[1], alias);
+        long off = compressedImmediate(tokens[2], ok);
+        int rs1 = compressedRegister(tokens[3], alias);
+        if (reg == -1 || rs1 == -1 || !ok || off < 0)
+        {
+            return "";
+        }
+        bool word = instr == "lw" || instr == "sw";
+        bool load = instr == "lw" || instr == "ld";
+        if (rs1 == 2 && (reg != 0 || !load)) // stack pointer relative forms
+        {
+            if (word && off % 4 == 0 && off <= 252)
+                return load ? "010" + slice(off, 5, 5) + field(reg, 5) + slice(off, 4, 2) + slice(off, 7, 6) + "10"
+                            : "110" + slice(off, 5, 2) + slice(off, 7, 6) + field(reg, 5) + "10";
+            if (!word && off % 8 == 0 && off <= 504)
+                return load ? "011" + slice(off, 5, 5) + field(reg, 5) + slice(off, 4, 3) + slice(off, 8, 6) + "10"
+                            : "111" + slice(off, 5, 3) + slice(off, 8, 6) + field(reg, 5) + "10";
+        }
+        if (isPrime(reg) && isPrime(rs1))
+        {
+            string funct = string(load ? "0" : "1") + (word ? "10" : "11");
+            if (word && off % 4 == 0 && off <= 124)
+                return funct + slice(off, 5, 3) + prime(rs1) + slice(off, 2, 2) + slice(off, 6, 6) + prime(reg) + "00";
+            if (!word && off % 8 == 0 && off <= 248)
+                return funct + slice(off, 5, 3) + prime(rs1) + slice(off, 7, 6) + prime(reg) + "00";
+        }
+    }
+    else if (instr == "jal" && count == 2)
+    {
+        int rd = compressedRegister(tokens[1], alias);
+        if (rd == 0 && targets.find(tokens[2]) != targets.end())
+        {
+            long off = targets[tokens[2]] - address;
+            if (off % 2 == 0 && off >= -2048 && off <= 2046) // c.j
+                return "101" + slice(off, 11, 11) + slice(off, 4, 4) + slice(off, 9, 8) + slice(off, 10, 10) + slice(off, 6, 6) + slice(off, 7, 7) + slice(off, 3, 1) + slice(off, 5, 5) + "01";
+        }
+    }
+    else if (instr == "jalr" && count == 3)
+    {
+        int rd = compressedRegister(tokens[1], alias);
+        long imm = compressedImmediate(tokens[2], ok);
+        int rs1 = compressedRegister(tokens[3], alias);
+        if (ok && imm == 0 && rs1 > 0 && (rd == 0 || rd == 1)) // c.jr and c.jalr
+        {
+            return string(rd == 0 ? "1000" : "1001") + field(rs1, 5) + "00000" + "10";
+        }
+    }
+    else if ((instr == "beq" || instr == "bne") && count == 3)
+    {
+        int rs1 = compressedRegister(tokens[1], alias);
+        int rs2 = compressedRegister(tokens[2], alias);
+        if (rs1 == 0 && isPrime(rs2)) // beq x0, rs is the same test
+        {
+            rs1 = rs2;
+            rs2 = 0;
+        }
+        if (isPrime(rs1) && rs2 == 0 && targets.find(tokens[3]) != targets.end())
+        {
+            long off = targets[tokens[3]] - address;
+            if (off % 2 == 0 && off >= -256 && off <= 254) // c.beqz and c.bnez
+                return string(instr == "beq" ? "110" : "111") + slice(off, 8, 8) + slice(off, 4, 3) + prime(rs1) + slice(off, 7, 6) + slice(off, 2, 1) + slice(off, 5, 5) + "01";
+        }
+    }
+    return "";
+}
+
+vector<long> layoutText(vector<vector<string> > &tokens, unordered_map<string, int> &labels, unordered_map<string, string> &alias, vector<string> &encodings)
+{
+    int n = tokens.size();
+    vector<int> size(n, 4);
+    vector<long> address(n + 1, 0);
+    unordered_map<string, long> targets;
+    vector<vector<string> > base(n); // explicit c.* lines are laid out as the instruction they expand to
+    for (int i = 0; i < n; i++)
+    {
+        base[i] = tokens[i];
+        if (tokens[i].size() == 0)
+        {
+            size[i] = 0;
+        }
+        else if (tokens[i][0].substr(0, 2) == "c.")
+        {
+            base[i] = expandCompressed(tokens[i]);
+            size[i] = 2;
+        }
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            address[i + 1] = address[i] + size[i];
+        }
+        for (auto it = labels.begin(); it != labels.end(); it++)
+        {
+            targets[it->first] = address[it->second];
+        }
+        changed = false;
+        for (int i = 0; i < n; i++)
+        {
+            if (size[i] == 4 && compressInstruction(base[i], alias, address[i], targets) != "")
+            {
+                size[i] = 2;
+                changed = true;
+            }
+        }
+    }
+
+    encodings.assign(n, "");
+    for (int i = 0; i < n; i++)
+    {
+        if (size[i] == 2)
+        {
+            encodings[i] = compressInstruction(base[i], alias, address[i], targets);
+        }
+    }
+    return address;
+}
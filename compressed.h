@@ -0,0 +1,44 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+/*
+    Function to split an instruction line into the mnemonic followed by its operands,
+    dropping the label, the comment and the separators (spaces, commas and brackets).
+    An empty vector is returned for a line without instruction
+    params: {string} line
+    return: {vector<string>}
+*/
+vector<string> splitInstruction(string line);
+
+/*
+    Function to rewrite an explicit c.* mnemonic as the base instruction it expands to,
+    e.g. c.addi x5, 3 gives addi x5, x5, 3. Returns an empty vector if the mnemonic is unknown
+    or the operands do not match
+    params: {vector<string>} tokens
+    return: {vector<string>}
+*/
+vector<string> expandCompressed(vector<string> tokens);
+
+/*
+    Function to find the RV64C form of an instruction. Returns the 16 bit binary encoding,
+    or an empty string when the instruction or its operands have no compressed form.
+    Branch and jump targets must be labels, their offset is taken from targets (label -> byte address)
+    params: {vector<string>} tokens, {unordered_map<string, string>} alias, {long} address, {unordered_map<string, long>} targets
+    return: {string}
+*/
+string compressInstruction(vector<string> tokens, unordered_map<string, string> &alias, long address, unordered_map<string, long> &targets);
+
+/*
+    Function to lay out the text section with compressed instructions. tokens[i] is line i split by
+    splitInstruction() and labels maps every label to its line. Compressible lines take 2 bytes,
+    empty lines none and the rest 4; branches are retried until no more lines shrink since
+    shrinking brings their targets closer. Returns the byte address of every line followed by
+    the end address, encodings receives the 16 bit encoding of the compressed lines ("" otherwise)
+    params: {vector<vector<string>>} tokens, {unordered_map<string, int>} labels, {unordered_map<string, string>} alias, {vector<string>} encodings
+    return: {vector<long>}
+*/
+vector<long> layoutText(vector<vector<string> > &tokens, unordered_map<string, int> &labels, unordered_map<string, string> &alias, vector<string> &encodings);
@@ -0,0 +1,258 @@
+/**
+ * This file contains the main memory timing model. The caches send it their fills and write
+ * backs; it tracks the open row of every bank and the data bus of every channel and serves the
+ * queued requests in FR-FCFS order
+ */
+
+#include <iomanip>
+#include <deque>
+#include <unordered_map>
+#include "dram.h"
+#include "settings.h"
+
+using namespace std;
+
+class dram_request
+{
+public:
+    int channel;
+    int bank; // index over all banks of all channels and ranks
+    long row;
+    long arrival;
+    int size;
+    int kind;
+};
+
+class dram_bank
+{
+public:
+    long row;   // open row, -1 when precharged
+    long ready; // cycle the bank accepts its next command
+};
+
+class dram_model
+{
+public:
+    int channels;
+    int ranks;
+    int banks;
+    int rowSize;
+    bool openPage;
+    int tCAS;
+    int tRCD;
+    int tRP;
+    int tBurst;
+    int queueSize;
+    vector<dram_bank> bankState;
+    vector<long> busFree; // cycle the data bus of every channel is free
+    deque<dram_request> queue;
+    long now;
+    long instructions;
+    long stallCycles; // cycles spent waiting for demand fills
+    long requests[3]; // by kind
+    long rowHits;
+    long rowMisses;    // row buffer empty
+    long rowConflicts; // another row open
+    long bytes;
+
+    dram_model()
+    {
+        channels = 1;
+        ranks = 1;
+        banks = 8;
+        rowSize = 8192;
+        openPage = true;
+        tCAS = 14;
+        tRCD = 14;
+        tRP = 14;
+        tBurst = 4;
+        queueSize = 32;
+    }
+};
+
+thread_local bool dramEnabled = false;
+thread_local dram_model dram;
+
+bool enableDram(string file)
+{
+    dram_model config;
+    unordered_map<string, int *> settings = {
+        {"channels", &config.channels}, {"ranks", &config.ranks}, {"banks", &config.banks},
+        {"row_size", &config.rowSize}, {"tCAS", &config.tCAS}, {"tRCD", &config.tRCD},
+        {"tRP", &config.tRP}, {"tBurst", &config.tBurst}, {"queue", &config.queueSize}};
+    auto apply = [&](string setting, const vector<string> &values)
+    {
+        if (setting == "page" && values.size() == 1 && (values[0] == "open" || values[0] == "closed"))
+        {
+            config.openPage = values[0] == "open";
+            return true;
+        }
+        bool timing = setting[0] == 't';
+        return setNumber(settings, setting, values, timing ? 0 : 1);
+    };
+    if (file != "" && !readSettings(file, "DRAM", apply))
+    {
+        return false;
+    }
+    dram = config;
+    dramEnabled = true;
+    resetDram();
+    return true;
+}
+
+void disableDram()
+{
+    dramEnabled = false;
+}
+
+void resetDram()
+{
+    dram.bankState.assign(dram.channels * dram.ranks * dram.banks, dram_bank{-1, 0});
+    dram.busFree.assign(dram.channels, 0);
+    dram.queue.clear();
+    dram.now = 0;
+    dram.instructions = 0;
+    dram.stallCycles = 0;
+    dram.requests[DRAM_READ] = dram.requests[DRAM_WRITE] = dram.requests[DRAM_PREFETCH] = 0;
+    dram.rowHits = 0;
+    dram.rowMisses = 0;
+    dram.rowConflicts = 0;
+    dram.bytes = 0;
+}
+
+/*
+    FR-FCFS: the oldest request to an open row, otherwise the oldest request
+*/
+int pickRequest()
+{
+    for (int i = 0; dram.openPage && i < dram.queue.size(); i++)
+    {
+        if (dram.bankState[dram.queue[i].bank].row == dram.queue[i].row)
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/*
+    Cycle at which the bank of the request can start serving it
+*/
+long startCycle(dram_request &request)
+{
+    return max(request.arrival, dram.bankState[request.bank].ready);
+}
+
+/*
+    Serves the request and returns the cycle its last byte is transferred
+*/
+long serveRequest(dram_request &request)
+{
+    dram_bank &bank = dram.bankState[request.bank];
+    long start = startCycle(request);
+    int latency;
+    if (dram.openPage && bank.row == request.row)
+    {
+        latency = dram.tCAS;
+        dram.rowHits++;
+    }
+    else if (bank.row == -1)
+    {
+        latency = dram.tRCD + dram.tCAS;
+        dram.rowMisses++;
+    }
+    else
+    {
+        latency = dram.tRP + dram.tRCD + dram.tCAS;
+        dram.rowConflicts++;
+    }
+    long finish = max(start + latency, dram.busFree[request.channel]) + dram.tBurst;
+    dram.busFree[request.channel] = finish;
+    // an open row takes the next column command right away, a closed page precharges first
+    bank.row = dram.openPage ? request.row : -1;
+    bank.ready = dram.openPage ? start + latency : finish + dram.tRP;
+    dram.bytes += request.size;
+    return finish;
+}
+
+int dramAccess(unsigned long address, int size, int kind)
+{
+    dram.requests[kind]++;
+    // requests whose bank frees up before now were served while the core was busy
+    while (!dram.queue.empty())
+    {
+        int i = pickRequest();
+        if (startCycle(dram.queue[i]) >= dram.now)
+        {
+            break;
+        }
+        serveRequest(dram.queue[i]);
+        dram.queue.erase(dram.queue.begin() + i);
+    }
+
+    dram_request request;
+    unsigned long rest = address / dram.rowSize;
+    request.channel = rest % dram.channels;
+    rest /= dram.channels;
+    int bank = rest % dram.banks;
+    rest /= dram.banks;
+    int rank = rest % dram.ranks;
+    request.row = rest / dram.ranks;
+    request.bank = (request.channel * dram.ranks + rank) * dram.banks + bank;
+    request.arrival = dram.now;
+    request.size = size;
+    request.kind = kind;
+    dram.queue.push_back(request);
+
+    if (kind != DRAM_READ)
+    {
+        while (dram.queue.size() > dram.queueSize)
+        {
+            int i = pickRequest();
+            serveRequest(dram.queue[i]);
+            dram.queue.erase(dram.queue.begin() + i);
+        }
+        return 0;
+    }
+    // the core waits until the read is served, older requests and row hits may go first
+    while (true)
+    {
+        int i = pickRequest();
+        bool own = i == dram.queue.size() - 1;
+        long finish = serveRequest(dram.queue[i]);
+        dram.queue.erase(dram.queue.begin() + i);
+        if (own)
+        {
+            int latency = finish - dram.now;
+            dram.stallCycles += latency;
+            dram.now = finish;
+            return latency;
+        }
+    }
+}
+
+void dramInstruction()
+{
+    dram.instructions++;
+    dram.now++;
+}
+
+void printDramStats()
+{
+    long reads = dram.requests[DRAM_READ];
+    long served = dram.rowHits + dram.rowMisses + dram.rowConflicts;
+    cout << "DRAM statistics (" << dram.channels << " channels, " << dram.ranks << " ranks, " << dram.banks << " banks, ";
+    cout << (dram.openPage ? "open" : "closed") << " page):";
+    cout << " Reads=" << reads;
+    cout << " ,Writes=" << dram.requests[DRAM_WRITE];
+    cout << " ,Prefetches=" << dram.requests[DRAM_PREFETCH];
+    cout << " ,Queued=" << dram.queue.size() << endl;
+    cout << "Row buffer: Hits=" << dram.rowHits;
+    cout << " ,Empty=" << dram.rowMisses;
+    cout << " ,Conflicts=" << dram.rowConflicts;
+    cout << " ,Hit Rate=" << fixed << setprecision(2) << (served != 0 ? (float)dram.rowHits / served : 0) << endl;
+    cout << "Memory timing: Average Read Latency=" << (reads != 0 ? (float)dram.stallCycles / reads : 0) << " cycles";
+    cout << " ,Bandwidth=" << (dram.now != 0 ? (float)dram.bytes / dram.now : 0) << " B/cycle";
+    cout << " ,Stall Cycles=" << dram.stallCycles;
+    cout << " ,CPI=" << (dram.instructions != 0 ? (float)dram.now / dram.instructions : 0) << endl;
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+// kinds of DRAM request
+#define DRAM_READ 0     // demand fill, the requesting core waits for the data
+#define DRAM_WRITE 1    // write back or store sent to memory, queued
+#define DRAM_PREFETCH 2 // prefetch fill, queued
+
+extern thread_local bool dramEnabled;
+
+/*
+    Turns on the main memory timing model behind the caches of this thread. Requests are mapped
+    to channel, bank, rank and row from the low address bits up, queued, and served by an FR-FCFS
+    scheduler: requests to an open row first, then the oldest. Its clock advances one cycle per
+    retired instruction and by the latency of every demand fill. The optional file holds
+    "setting value" lines, timings in core cycles:
+        channels n     independent channels, each with its own data bus (default 1)
+        ranks n        ranks per channel (default 1)
+        banks n        banks per rank (default 8)
+        row_size n     bytes of a row, the row buffer of a bank (default 8192)
+        page open|closed   open keeps the last row of a bank in its row buffer, closed
+                           precharges after every access (default open)
+        tCAS n         column access (default 14)
+        tRCD n         row activation (default 14)
+        tRP n          precharge (default 14)
+        tBurst n       data bus cycles of one transfer (default 4)
+        queue n        requests that may wait before writes are forced out (default 32)
+    Returns false if the file cannot be read or holds an invalid setting
+*/
+bool enableDram(string file);
+
+void disableDram();
+
+/*
+    Closes every row and clears the queue and statistics, called when a program is loaded
+*/
+void resetDram();
+
+/*
+    Sends a request of size bytes at address to memory. Returns the cycles until the data of a
+    read arrives, 0 for queued requests
+*/
+int dramAccess(unsigned long address, int size, int kind);
+
+/*
+    Advances the clock by one retired instruction
+*/
+void dramInstruction();
+
+/*
+    Prints the requests, the row buffer hit rate, the average read latency, the bandwidth used
+    and the cycles per instruction including the memory stalls
+*/
+void printDramStats();
\ No newline at end of file
@@ -0,0 +1,459 @@
+/**
+ * This file contains the F and D extension state and arithmetic. Operations run on the
+ * host FPU; the rounding mode and the exception flags are only managed exactly for the
+ * programs that can observe them
+ */
+
+#include <cmath>
+#include <cfenv>
+#include <cstring>
+#include "float_unit.h"
+
+using namespace std;
+
+thread_local unsigned long fregs[32];
+thread_local int frm = 0;
+thread_local int fflags = 0;
+thread_local bool fpExact = false;
+
+void resetFloat()
+{
+    for (int i = 0; i < 32; i++)
+    {
+        fregs[i] = 0;
+    }
+    frm = 0;
+    fflags = 0;
+    fpExact = false;
+}
+
+void raiseFlags(int flags)
+{
+    if (fpExact)
+    {
+        fflags |= flags;
+    }
+}
+
+/*
+    Value of a string made only of decimal digits, -1 otherwise
+*/
+int digitsValue(string s)
+{
+    if (s.length() == 0 || s.length() > 2)
+    {
+        return -1;
+    }
+    for (int i = 0; i < s.length(); i++)
+    {
+        if (s[i] < '0' || s[i] > '9')
+        {
+            return -1;
+        }
+    }
+    return stoi(s);
+}
+
+int floatRegisterNumber(string reg)
+{
+    int num = -1;
+    if (reg.length() > 2 && reg.substr(0, 2) == "ft")
+    {
+        num = digitsValue(reg.substr(2));
+        num = (num >= 0 && num <= 7) ? num : (num >= 8 && num <= 11) ? num + 20 : -1;
+    }
+    else if (reg.length() > 2 && reg.substr(0, 2) == "fs")
+    {
+        num = digitsValue(reg.substr(2));
+        num = (num >= 0 && num <= 1) ? num + 8 : (num >= 2 && num <= 11) ? num + 16 : -1;
+    }
+    else if (reg.length() > 2 && reg.substr(0, 2) == "fa")
+    {
+        num = digitsValue(reg.substr(2));
+        num = (num >= 0 && num <= 7) ? num + 10 : -1;
+    }
+    else if (reg.length() > 1 && reg[0] == 'f')
+    {
+        num = digitsValue(reg.substr(1));
+        num = (num >= 0 && num <= 31) ? num : -1;
+    }
+    return num;
+}
+
+int getFloatRegister(string reg, int line)
+{
+    int num = floatRegisterNumber(reg);
+    if (num == -1)
+    {
+        cout << "Line " << line << ": Floating point register " << reg << " not found" << endl;
+    }
+    return num;
+}
+
+int getRoundingMode(string rm)
+{
+    string modes[] = {"rne", "rtz", "rdn", "rup", "rmm"};
+    for (int i = 0; i < 5; i++)
+    {
+        if (rm == modes[i])
+        {
+            return i;
+        }
+    }
+    return rm == "dyn" ? 7 : -1;
+}
+
+int getFloatCsr(string csr)
+{
+    if (csr == "fflags")
+        return 1;
+    if (csr == "frm")
+        return 2;
+    if (csr == "fcsr")
+        return 3;
+    try
+    {
+        size_t pos = 0;
+        int num = stoi(csr, &pos, 0);
+        if (pos == csr.length() && num >= 1 && num <= 3)
+        {
+            return num;
+        }
+    }
+    catch (exception e)
+    {
+    }
+    return -1;
+}
+
+vector<string> expandFloatCsr(vector<string> tokens)
+{
+    if (tokens.size() == 0)
+    {
+        return tokens;
+    }
+    string instr = tokens[0];
+    string csr = (instr == "frcsr" || instr == "fscsr") ? "fcsr" : (instr == "frrm" || instr == "fsrm" || instr == "fsrmi") ? "frm"
+                                                               : (instr == "frflags" || instr == "fsflags" || instr == "fsflagsi") ? "fflags"
+                                                                                                                                  : "";
+    if (csr == "")
+    {
+        return tokens;
+    }
+    if (instr[1] == 'r' && tokens.size() == 2) // frcsr rd, frrm rd, frflags rd
+    {
+        return {"csrrs", tokens[1], csr, "x0"};
+    }
+    bool immediate = instr[instr.length() - 1] == 'i';
+    string op = immediate ? "csrrwi" : "csrrw";
+    if (tokens.size() == 2) // fscsr rs, fsrm rs, fsflags rs
+    {
+        return {op, "x0", csr, tokens[1]};
+    }
+    if (tokens.size() == 3)
+    {
+        return {op, tokens[1], csr, tokens[2]};
+    }
+    return tokens;
+}
+
+bool usesFloatCsr(vector<string> tokens)
+{
+    tokens = expandFloatCsr(tokens);
+    return tokens.size() >= 3 && tokens[0].substr(0, 4) == "csrr" && getFloatCsr(tokens[2]) != -1;
+}
+
+float getSingle(int reg)
+{
+    unsigned long bits = fregs[reg];
+    unsigned int low = (bits >> 32) == 0xffffffff ? (unsigned int)bits : 0x7fc00000; // an unboxed value reads as the canonical NaN
+    float value;
+    memcpy(&value, &low, 4);
+    return value;
+}
+
+void setSingle(int reg, float value)
+{
+    unsigned int low;
+    memcpy(&low, &value, 4);
+    fregs[reg] = 0xffffffff00000000UL | low;
+}
+
+double getDouble(int reg)
+{
+    double value;
+    memcpy(&value, &fregs[reg], 8);
+    return value;
+}
+
+void setDouble(int reg, double value)
+{
+    memcpy(&fregs[reg], &value, 8);
+}
+
+/*
+    Arithmetic results that are NaN are replaced by the canonical NaN
+*/
+template <typename T>
+T canonical(T value)
+{
+    return isnan(value) ? (T)NAN : value;
+}
+
+template <typename T>
+T hostOp(char op, T a, T b, T c)
+{
+    // volatile keeps the operation after the rounding mode switch
+    volatile T x = a, y = b, z = c;
+    volatile T r;
+    if (op == '+')
+        r = x + y;
+    else if (op == '-')
+        r = x - y;
+    else if (op == '*')
+        r = x * y;
+    else if (op == '/')
+        r = x / y;
+    else if (op == 's')
+        r = sqrt((T)x);
+    else
+        r = fma((T)x, (T)y, (T)z);
+    return r;
+}
+
+/*
+    Exact value minus the round to nearest result r, from error free transformations.
+    Quotients and square roots never land exactly between two floating point numbers so
+    cannot tie, and the fused multiply add is left at round to nearest
+*/
+template <typename T>
+long double roundingError(char op, T a, T b, T c, T r)
+{
+    if (op == '+' || op == '-')
+    {
+        T y = (op == '+') ? b : -b;
+        T bb = r - a;
+        return (long double)((a - (r - bb)) + (y - bb));
+    }
+    if (op == '*')
+    {
+        return (long double)fma(a, b, -r);
+    }
+    return 0;
+}
+
+/*
+    Turns a round to nearest result into the round to nearest, ties to max magnitude one
+    given the exact error of the rounding
+*/
+template <typename T>
+T tiesAway(T r, long double err)
+{
+    if (err == 0 || isnan(r) || isinf(r))
+    {
+        return r;
+    }
+    T other = nextafter(r, err > 0 ? (T)INFINITY : (T)-INFINITY);
+    if ((long double)other - (long double)r == 2 * err && fabs(other) > fabs(r))
+    {
+        return other;
+    }
+    return r;
+}
+
+int hostFlags(int raised)
+{
+    return ((raised & FE_INVALID) ? 16 : 0) | ((raised & FE_DIVBYZERO) ? 8 : 0) | ((raised & FE_OVERFLOW) ? 4 : 0) | ((raised & FE_UNDERFLOW) ? 2 : 0) | ((raised & FE_INEXACT) ? 1 : 0);
+}
+
+/*
+    Runs op with rounding mode rm. The fast path is round to nearest with no flags to track,
+    anything else switches the host rounding mode and samples the host exception flags
+*/
+template <typename T, typename Op, typename Err>
+T rounded(int rm, Op op, Err error)
+{
+    if (rm == 7)
+    {
+        rm = frm;
+    }
+    if (rm == 0 && !fpExact)
+    {
+        return canonical<T>(op());
+    }
+    int old = fegetround();
+    fesetround(rm == 1 ? FE_TOWARDZERO : rm == 2 ? FE_DOWNWARD : rm == 3 ? FE_UPWARD : FE_TONEAREST);
+    feclearexcept(FE_ALL_EXCEPT);
+    T r = op();
+    int raised = fetestexcept(FE_ALL_EXCEPT);
+    if (rm == 4)
+    {
+        r = tiesAway(r, error(r));
+    }
+    fesetround(old);
+    raiseFlags(hostFlags(raised));
+    return canonical(r);
+}
+
+float computeSingle(char op, float a, float b, float c, int rm)
+{
+    return rounded<float>(rm, [&]()
+                          { return hostOp(op, a, b, c); }, [&](float r)
+                          { return roundingError(op, a, b, c, r); });
+}
+
+double computeDouble(char op, double a, double b, double c, int rm)
+{
+    return rounded<double>(rm, [&]()
+                           { return hostOp(op, a, b, c); }, [&](double r)
+                           { return roundingError(op, a, b, c, r); });
+}
+
+float narrowDouble(double value, int rm)
+{
+    return rounded<float>(rm, [&]()
+                          { volatile double v = value; return (float)v; }, [&](float r)
+                          { return (long double)value - r; });
+}
+
+// long double holds every 64 bit integer exactly on x86, so the rounding error below is exact there
+float intToSingle(long value, bool isUnsigned, int rm)
+{
+    long double exact = isUnsigned ? (long double)(unsigned long)value : (long double)value;
+    return rounded<float>(rm, [&]()
+                          { volatile long v = value; return isUnsigned ? (float)(unsigned long)v : (float)v; }, [&](float r)
+                          { return exact - r; });
+}
+
+double intToDouble(long value, bool isUnsigned, int rm)
+{
+    long double exact = isUnsigned ? (long double)(unsigned long)value : (long double)value;
+    return rounded<double>(rm, [&]()
+                           { volatile long v = value; return isUnsigned ? (double)(unsigned long)v : (double)v; }, [&](double r)
+                           { return exact - r; });
+}
+
+long floatToInt(double value, int bits, bool isUnsigned, int rm)
+{
+    if (rm == 7)
+    {
+        rm = frm;
+    }
+    double limit = ldexp(1.0, isUnsigned ? bits : bits - 1);
+    unsigned long maxValue = isUnsigned ? (bits == 64 ? ~0UL : (1UL << bits) - 1) : (1UL << (bits - 1)) - 1;
+    unsigned long minValue = isUnsigned ? 0 : ~maxValue;
+    unsigned long result;
+    if (isnan(value))
+    {
+        raiseFlags(16);
+        result = maxValue;
+    }
+    else
+    {
+        double whole = (rm == 1) ? trunc(value) : (rm == 2) ? floor(value) : (rm == 3) ? ceil(value) : (rm == 4) ? round(value) : nearbyint(value);
+        if (whole >= limit)
+        {
+            raiseFlags(16);
+            result = maxValue;
+        }
+        else if (isUnsigned ? whole < 0 : whole < -limit)
+        {
+            raiseFlags(16);
+            result = minValue;
+        }
+        else
+        {
+            result = isUnsigned ? (unsigned long)whole : (unsigned long)(long)whole;
+            if (whole != value)
+            {
+                raiseFlags(1);
+            }
+        }
+    }
+    if (bits == 32)
+    {
+        return (long)(int)result;
+    }
+    return result;
+}
+
+double floatMinMax(double a, double b, bool isMax)
+{
+    if (isnan(a) && isnan(b))
+    {
+        return NAN;
+    }
+    if (isnan(a))
+    {
+        return b;
+    }
+    if (isnan(b))
+    {
+        return a;
+    }
+    if (a == b) // only the zeros differ, -0 is the smaller one
+    {
+        return (signbit(a) == isMax) ? b : a;
+    }
+    return isMax ? (a > b ? a : b) : (a < b ? a : b);
+}
+
+bool floatCompare(string op, double a, double b)
+{
+    if (isnan(a) || isnan(b))
+    {
+        if (op != "feq")
+        {
+            raiseFlags(16);
+        }
+        return false;
+    }
+    if (op == "feq")
+        return a == b;
+    if (op == "flt")
+        return a < b;
+    return a <= b;
+}
+
+int floatClass(unsigned long bits, bool isDouble)
+{
+    int expBits = isDouble ? 11 : 8;
+    int mantBits = isDouble ? 52 : 23;
+    bool sign = (bits >> (expBits + mantBits)) & 1;
+    unsigned long exp = (bits >> mantBits) & ((1UL << expBits) - 1);
+    unsigned long mant = bits & ((1UL << mantBits) - 1);
+    int cls;
+    if (exp == (1UL << expBits) - 1)
+    {
+        if (mant == 0)
+            cls = sign ? 0 : 7;
+        else
+            cls = ((mant >> (mantBits - 1)) & 1) ? 9 : 8;
+    }
+    else if (exp == 0)
+    {
+        if (mant == 0)
+            cls = sign ? 3 : 4;
+        else
+            cls = sign ? 2 : 5;
+    }
+    else
+    {
+        cls = sign ? 1 : 6;
+    }
+    return 1 << cls;
+}
+
+unsigned long rawBits(int reg, bool isDouble)
+{
+    if (isDouble)
+    {
+        return fregs[reg];
+    }
+    return (fregs[reg] >> 32) == 0xffffffff ? fregs[reg] & 0xffffffff : 0x7fc00000;
+}
+
+bool isSignalingNan(unsigned long bits, bool isDouble)
+{
+    return floatClass(bits, isDouble) == (1 << 8);
+}
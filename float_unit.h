@@ -0,0 +1,122 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+extern thread_local unsigned long fregs[32]; // F/D registers, singles are NaN-boxed in the low 32 bits
+extern thread_local int frm;                 // dynamic rounding mode
+extern thread_local int fflags;              // accrued exception flags NV DZ OF UF NX
+extern thread_local bool fpExact;            // track rounding modes and flags exactly, set for programs using frm or fflags
+
+/*
+    Zeroes the floating point registers and fcsr
+*/
+void resetFloat();
+
+/*
+    Accrues exception flags (NV 16, DZ 8, OF 4, UF 2, NX 1) in fflags when flags are tracked
+*/
+void raiseFlags(int flags);
+
+/*
+    Function to get the number of a floating point register f0-f31 or its ABI name (ft0, fa0, fs0, ...)
+    params: {string} reg, {int} line
+    return: {int} -1 if it is not a floating point register
+*/
+int getFloatRegister(string reg, int line);
+
+/*
+    Same as getFloatRegister without reporting an error
+*/
+int floatRegisterNumber(string reg);
+
+/*
+    Function to get the rounding mode of an rm operand (rne, rtz, rdn, rup, rmm, dyn)
+    params: {string} rm
+    return: {int} -1 if the operand is not a rounding mode
+*/
+int getRoundingMode(string rm);
+
+/*
+    Function to get the number of an fcsr CSR given by name (fflags, frm, fcsr) or number
+    params: {string} csr
+    return: {int} -1 if the CSR is not supported
+*/
+int getFloatCsr(string csr);
+
+/*
+    Function to rewrite the fcsr pseudo instructions (frcsr, fscsr, frrm, fsrm, frflags, fsflags)
+    as the csrrs/csrrw instruction they stand for. Other instructions are returned unchanged
+    params: {vector<string>} tokens
+    return: {vector<string>}
+*/
+vector<string> expandFloatCsr(vector<string> tokens);
+
+/*
+    Whether an instruction (split by splitInstruction) reads or writes frm or fflags, which makes
+    the program need the exact path
+*/
+bool usesFloatCsr(vector<string> tokens);
+
+float getSingle(int reg);
+
+void setSingle(int reg, float value);
+
+double getDouble(int reg);
+
+void setDouble(int reg, double value);
+
+/*
+    Computes op (+ - * / s for sqrt, f for a * b + c) with rounding mode rm (7 for frm).
+    Round to nearest without flag tracking runs directly on the host FPU; other modes switch
+    the host rounding mode and, when fpExact is set, accrue the raised exceptions in fflags.
+    RMM has no host mode and is derived from the round to nearest result by tie detection
+*/
+float computeSingle(char op, float a, float b, float c, int rm);
+
+double computeDouble(char op, double a, double b, double c, int rm);
+
+/*
+    Rounds a double to single precision with rounding mode rm
+*/
+float narrowDouble(double value, int rm);
+
+/*
+    Converts an integer to single or double precision with rounding mode rm, value is read as
+    unsigned when isUnsigned is set
+*/
+float intToSingle(long value, bool isUnsigned, int rm);
+
+double intToDouble(long value, bool isUnsigned, int rm);
+
+/*
+    Converts to an integer of bits 32 or 64 with rounding mode rm, saturating out of range values
+    and NaN as the F extension specifies. 32 bit results are sign extended
+*/
+long floatToInt(double value, int bits, bool isUnsigned, int rm);
+
+/*
+    fmin/fmax, returning the non-NaN operand when only one is NaN and ordering -0 below +0
+*/
+double floatMinMax(double a, double b, bool isMax);
+
+/*
+    feq (quiet), flt and fle (signaling) comparisons
+*/
+bool floatCompare(string op, double a, double b);
+
+/*
+    fclass mask of the raw bits of a single or double
+*/
+int floatClass(unsigned long bits, bool isDouble);
+
+/*
+    Raw bits of the single or double held in reg, a single that is not NaN-boxed reads as the canonical NaN
+*/
+unsigned long rawBits(int reg, bool isDouble);
+
+/*
+    Whether the raw bits of a single or double are a signaling NaN
+*/
+bool isSignalingNan(unsigned long bits, bool isDouble);
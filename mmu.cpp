@@ -0,0 +1,384 @@
+/**
+ * This file contains Sv39 address translation. The simulated TLBs and the page walk cache only
+ * decide which accesses walk the page tables and what the walks cost; the translations
+ * themselves come from a direct mapped software TLB so the host does not walk on every access
+ */
+
+#include <iomanip>
+#include "simulator.h"
+#include "dram.h"
+#include "mmu.h"
+#include "atomics.h"
+#include "settings.h"
+
+using namespace std;
+
+#define PAGE_BITS 12
+#define PAGE_SIZE (1UL << PAGE_BITS)
+#define SOFT_TLB_ENTRIES 1024 // pages whose translation the host keeps, a power of two
+#define PTE_V 0x01
+#define PTE_R 0x02
+#define PTE_W 0x04
+#define PTE_X 0x08
+#define PTE_A 0x40
+#define PTE_D 0x80
+#define SATP_SV39 8UL
+
+/*
+    Set associative TLB of page numbers, replaced LRU
+*/
+class tlb_model
+{
+public:
+    int entries;
+    int ways;
+    vector<unsigned long> keys; // page numbers, ~0 when empty
+    vector<long> used;
+    long now;
+    long accesses;
+    long misses;
+
+    void reset()
+    {
+        keys.assign(entries, ~0UL);
+        used.assign(entries, 0);
+        now = 0;
+        accesses = 0;
+        misses = 0;
+    }
+
+    void flush()
+    {
+        keys.assign(entries, ~0UL);
+    }
+
+    /*
+        Counts an access to key and returns whether it hit
+    */
+    bool lookup(unsigned long key)
+    {
+        accesses++;
+        int base = (key % (entries / ways)) * ways;
+        for (int i = base; i < base + ways; i++)
+        {
+            if (keys[i] == key)
+            {
+                used[i] = ++now;
+                return true;
+            }
+        }
+        misses++;
+        return false;
+    }
+
+    void insert(unsigned long key)
+    {
+        int base = (key % (entries / ways)) * ways;
+        int victim = base;
+        for (int i = base; i < base + ways; i++)
+        {
+            if (used[i] < used[victim])
+            {
+                victim = i;
+            }
+        }
+        keys[victim] = key;
+        used[victim] = ++now;
+    }
+};
+
+/*
+    Translation of one 4 KiB page kept by the host
+*/
+class soft_tlb_entry
+{
+public:
+    unsigned long vpn; // ~0 when empty
+    unsigned long base; // physical address of the page
+    int flags;          // permission bits of the leaf entry
+};
+
+thread_local bool translationEnabled = false;
+thread_local unsigned long satp = 0;
+thread_local tlb_model itlb = {32, 4};
+thread_local tlb_model dtlb = {32, 4};
+thread_local tlb_model l2tlb = {512, 8};
+thread_local tlb_model pwc = {16, 16}; // keys are the level and the virtual address bits above it
+thread_local int pteLatency = 20;
+thread_local soft_tlb_entry softTlb[SOFT_TLB_ENTRIES];
+thread_local long translatedInstructions;
+thread_local long walks;
+thread_local long walkCycles;
+thread_local long pageFaults;
+
+bool configureTlbs(string file)
+{
+    tlb_model newItlb = itlb, newDtlb = dtlb, newL2tlb = l2tlb, newPwc = pwc;
+    int newPteLatency = pteLatency;
+    auto apply = [&](string name, const vector<string> &values)
+    {
+        vector<int> numbers;
+        for (const string &value : values)
+        {
+            numbers.push_back(settingNumber(value));
+        }
+        int count = numbers.size();
+        tlb_model *tlb = name == "itlb" ? &newItlb : name == "dtlb" ? &newDtlb : name == "l2tlb" ? &newL2tlb : NULL;
+        if (tlb != NULL && count == 2 && numbers[1] > 0 && numbers[0] > 0 && numbers[0] % numbers[1] == 0)
+        {
+            tlb->entries = numbers[0];
+            tlb->ways = numbers[1];
+        }
+        else if (name == "pwc" && count == 1 && numbers[0] >= 0)
+        {
+            newPwc.entries = newPwc.ways = numbers[0];
+        }
+        else if (name == "pte_latency" && count == 1 && numbers[0] >= 0)
+        {
+            newPteLatency = numbers[0];
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    };
+    if (!readSettings(file, "TLB", apply))
+    {
+        return false;
+    }
+    itlb = newItlb;
+    dtlb = newDtlb;
+    l2tlb = newL2tlb;
+    pwc = newPwc;
+    pteLatency = newPteLatency;
+    resetMmu();
+    return true;
+}
+
+void flushTlbs()
+{
+    itlb.flush();
+    dtlb.flush();
+    l2tlb.flush();
+    if (pwc.entries > 0)
+    {
+        pwc.flush();
+    }
+    for (soft_tlb_entry &entry : softTlb)
+    {
+        entry.vpn = ~0UL;
+    }
+}
+
+void resetMmu()
+{
+    satp = 0;
+    translationEnabled = false;
+    itlb.reset();
+    dtlb.reset();
+    l2tlb.reset();
+    pwc.reset();
+    flushTlbs();
+    translatedInstructions = 0;
+    walks = 0;
+    walkCycles = 0;
+    pageFaults = 0;
+}
+
+unsigned long readSatp()
+{
+    return satp;
+}
+
+void writeSatp(unsigned long value)
+{
+    unsigned long mode = value >> 60;
+    if (mode != 0 && mode != SATP_SV39)
+    {
+        return;
+    }
+    satp = value;
+    translationEnabled = mode == SATP_SV39;
+    flushTlbs();
+}
+
+/*
+    Reads the page table entry at address without counting an access
+*/
+unsigned long peekPte(unsigned long address, bool cacheEnabled, cache *newCache)
+{
+    if (cacheEnabled)
+    {
+        return cachePeek(newCache, address, 8, memory);
+    }
+    unsigned long pte = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        pte |= (unsigned long)memory[address + i] << (i * 8);
+    }
+    return pte;
+}
+
+/*
+    Reads the page table entry at address for a walk and returns the cycles it took
+*/
+long readPte(unsigned long address, bool cacheEnabled, cache *newCache, unsigned long &pte)
+{
+    if (!cacheEnabled)
+    {
+        pte = peekPte(address, false, newCache);
+        return dramEnabled ? dramAccess(address, 8, DRAM_READ) : pteLatency;
+    }
+    int misses = newCache->misses;
+    long latency = newCache->memory_latency;
+    cacheRead(newCache, address, 8, memory, pte);
+    if (newCache->misses == misses)
+    {
+        return 1;
+    }
+    return 1 + (dramEnabled ? newCache->memory_latency - latency : pteLatency);
+}
+
+/*
+    Walks the page tables for the virtual address va and returns the leaf entry and its level.
+    A timed walk reads the levels below the deepest page walk cache hit through the data cache;
+    all other entries are read without side effects. Returns false on a page fault
+*/
+bool walkPageTable(unsigned long va, bool timed, bool cacheEnabled, cache *newCache, unsigned long &pte, int &level)
+{
+    // level of the first entry read by a timed walk, the ones above come from the page walk cache
+    int timedLevel = 2;
+    for (int l = 0; timed && pwc.entries > 0 && l < 2; l++)
+    {
+        unsigned long key = (va >> (PAGE_BITS + 9 * (l + 1))) << 2 | l;
+        if (pwc.lookup(key))
+        {
+            timedLevel = l;
+            break;
+        }
+    }
+    unsigned long table = (satp & ((1UL << 44) - 1)) << PAGE_BITS;
+    for (level = 2; level >= 0; level--)
+    {
+        unsigned long address = table + ((va >> (PAGE_BITS + 9 * level)) & 511) * 8;
+        if (address + 8 > memsize)
+        {
+            return false;
+        }
+        if (timed && level <= timedLevel)
+            walkCycles += readPte(address, cacheEnabled, newCache, pte);
+        else
+            pte = peekPte(address, cacheEnabled, newCache);
+        if (!(pte & PTE_V) || (!(pte & PTE_R) && (pte & PTE_W)))
+        {
+            return false;
+        }
+        unsigned long ppn = (pte >> 10) & ((1UL << 44) - 1);
+        if (pte & (PTE_R | PTE_X))
+        {
+            // a superpage must be aligned to its size
+            return (ppn & ((1UL << (9 * level)) - 1)) == 0;
+        }
+        table = ppn << PAGE_BITS;
+        if (timed && pwc.entries > 0 && level > 0 && level <= timedLevel)
+        {
+            pwc.insert((va >> (PAGE_BITS + 9 * level)) << 2 | (level - 1));
+        }
+    }
+    return false;
+}
+
+bool translate(unsigned long &address, int size, int access, bool cacheEnabled, cache *newCache)
+{
+    unsigned long va = address;
+    unsigned long vpn = va >> PAGE_BITS;
+    string kind = access == ACCESS_FETCH ? "Instruction" : access == ACCESS_LOAD ? "Load" : "Store";
+    bool valid = ((long)va << 25 >> 25) == (long)va; // bits 63-39 copy bit 38
+
+    // simulated TLBs, for the walk statistics and cycles
+    bool timedWalk = false;
+    tlb_model &l1 = access == ACCESS_FETCH ? itlb : dtlb;
+    if (access == ACCESS_FETCH)
+    {
+        translatedInstructions++;
+    }
+    bool l1Miss = valid && !l1.lookup(vpn);
+    if (l1Miss)
+    {
+        if (!l2tlb.lookup(vpn))
+        {
+            timedWalk = true;
+            walks++;
+        }
+    }
+
+    soft_tlb_entry &entry = softTlb[vpn & (SOFT_TLB_ENTRIES - 1)];
+    if (valid && (entry.vpn != vpn || timedWalk))
+    {
+        unsigned long pte;
+        int level;
+        entry.vpn = ~0UL;
+        unique_lock<recursive_mutex> guard = lockMemory(); // other harts may be writing the page tables
+        valid = walkPageTable(va, timedWalk, cacheEnabled, newCache, pte, level);
+        if (valid)
+        {
+            unsigned long offset = va & ((1UL << (PAGE_BITS + 9 * level)) - 1) & ~(PAGE_SIZE - 1);
+            entry.vpn = vpn;
+            entry.base = (((pte >> 10) & ((1UL << 44) - 1)) << PAGE_BITS) + offset;
+            entry.flags = pte & 0xff;
+        }
+    }
+    if (valid)
+    {
+        int needed = PTE_A | (access == ACCESS_FETCH ? PTE_X : access == ACCESS_LOAD ? PTE_R : PTE_W | PTE_D);
+        valid = (entry.flags & needed) == needed;
+    }
+    if (!valid)
+    {
+        pageFaults++;
+        cout << "Line " << mainPC / 4 + 1 << ": " << kind << " page fault at 0x" << hex << va << dec << endl;
+        return false;
+    }
+    if (timedWalk)
+    {
+        l2tlb.insert(vpn);
+    }
+    if (l1Miss)
+    {
+        l1.insert(vpn);
+    }
+    address = entry.base + (va & (PAGE_SIZE - 1));
+    if ((va & (PAGE_SIZE - 1)) + size > PAGE_SIZE || address + size > memsize)
+    {
+        cout << "Line " << mainPC / 4 + 1 << ": " << kind << " access fault at 0x" << hex << va << dec << endl;
+        return false;
+    }
+    return true;
+}
+
+void printTlbStats()
+{
+    long instructions = translatedInstructions;
+    cout << "TLB statistics: Instructions=" << instructions;
+    cout << " ,Page Walks=" << walks;
+    cout << " ,Walk Cycles=" << walkCycles;
+    cout << " ,Average Walk=" << fixed << setprecision(2) << (walks != 0 ? (float)walkCycles / walks : 0) << " cycles";
+    cout << " ,Page Faults=" << pageFaults << endl;
+    string names[] = {"ITLB", "DTLB", "L2 TLB"};
+    tlb_model *tlbs[] = {&itlb, &dtlb, &l2tlb};
+    for (int i = 0; i < 3; i++)
+    {
+        tlb_model &tlb = *tlbs[i];
+        cout << names[i] << " (" << tlb.entries << " entries, " << tlb.ways << " ways):";
+        cout << " Accesses=" << tlb.accesses;
+        cout << " ,Misses=" << tlb.misses;
+        cout << " ,MPKI=" << (instructions != 0 ? 1000.0 * tlb.misses / instructions : 0) << endl;
+    }
+    if (pwc.entries > 0)
+    {
+        cout << "Page walk cache (" << pwc.entries << " entries):";
+        cout << " Lookups=" << pwc.accesses;
+        cout << " ,Hit Rate=" << (pwc.accesses != 0 ? (float)(pwc.accesses - pwc.misses) / pwc.accesses : 0) << endl;
+    }
+}
\ No newline at end of file
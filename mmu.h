@@ -0,0 +1,57 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+class cache;
+
+// kinds of access checked against the permissions of a page
+#define ACCESS_LOAD 0
+#define ACCESS_STORE 1
+#define ACCESS_FETCH 2
+
+extern thread_local bool translationEnabled; // satp selects Sv39
+
+/*
+    Sizes the simulated TLBs and the page walk cache. The file lists one structure per line,
+    lines starting with ';' are comments:
+        itlb entries ways    L1 instruction TLB (default 32 4)
+        dtlb entries ways    L1 data TLB (default 32 4)
+        l2tlb entries ways   unified L2 TLB behind both (default 512 8)
+        pwc entries          fully associative cache of the non-leaf page table entries (default 16)
+        pte_latency n        cycles of a page table read missing the data cache or done without
+                             one, when the DRAM model is off (default 20)
+    Returns false if the file cannot be read or holds an invalid line
+*/
+bool configureTlbs(string file);
+
+/*
+    Turns translation off, empties the TLBs and clears the statistics, called when a program is loaded
+*/
+void resetMmu();
+
+unsigned long readSatp();
+
+/*
+    Writes satp. Modes other than Bare (0) and Sv39 (8) leave it unchanged. Every write flushes the TLBs
+*/
+void writeSatp(unsigned long value);
+
+/*
+    Empties every TLB and the page walk cache, executed by sfence.vma
+*/
+void flushTlbs();
+
+/*
+    Translates the virtual address of an access of size bytes to its physical address. Misses of
+    the simulated TLBs walk the page tables through the data cache when it is enabled. Accessed
+    and dirty bits are not set by the walk: an access to a page without A, or a store to a page
+    without D, faults. Returns false after printing the fault
+*/
+bool translate(unsigned long &address, int size, int access, bool cacheEnabled, cache *newCache);
+
+/*
+    Prints the accesses, misses and MPKI of every TLB, the page walk cache hit rate and the page walk cycles
+*/
+void printTlbStats();
\ No newline at end of file
@@ -0,0 +1,243 @@
+/**
+ * This file contains the multi hart simulation, every hart runs on its own host
+ * thread and all harts share one guest memory
+ */
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include "multicore.h"
+#include "atomics.h"
+
+using namespace std;
+
+string decToHex(long int num);
+
+/*
+    Reusable barrier the harts meet at after every quantum. The last hart to arrive
+    decides whether another quantum is needed, so all harts leave with the same answer
+*/
+class quantum_barrier
+{
+public:
+    mutex lock;
+    condition_variable cv;
+    int count;
+    int waiting;
+    int generation;
+    int active; // harts that have not finished yet
+    bool done;
+
+    quantum_barrier(int count)
+    {
+        this->count = count;
+        waiting = 0;
+        generation = 0;
+        active = count;
+        done = false;
+    }
+
+    /*
+        Waits for every hart, finished tells whether the calling hart has stopped running.
+        Returns true once every hart has stopped
+    */
+    bool wait(bool finished)
+    {
+        unique_lock<mutex> guard(lock);
+        if (finished)
+        {
+            active--;
+        }
+        int gen = generation;
+        waiting++;
+        if (waiting == count)
+        {
+            done = (active == 0);
+            waiting = 0;
+            generation++;
+            cv.notify_all();
+        }
+        else
+        {
+            cv.wait(guard, [&]
+                    { return gen != generation; });
+        }
+        return done;
+    }
+};
+
+/*
+    Token passed from hart to hart in deterministic mode
+*/
+class hart_turn
+{
+public:
+    mutex lock;
+    condition_variable cv;
+    int turn;
+
+    hart_turn()
+    {
+        turn = 0;
+    }
+
+    void acquire(int id)
+    {
+        unique_lock<mutex> guard(lock);
+        cv.wait(guard, [&]
+                { return turn == id; });
+    }
+
+    void release(int next)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            turn = next;
+        }
+        cv.notify_all();
+    }
+};
+
+void hartThread(string file, hart &curr, int numHarts, unsigned char *shared, atomic_domain *sharedAtomics, long quantum, bool deterministic, quantum_barrier &barrier, hart_turn &turn)
+{
+    bool loaded = loadProgram(file);
+    memory = shared; // loading used the thread's own memory, from now on the hart sees the shared one
+    atomics = sharedAtomics;
+    registers[10] = curr.id;
+    hartId = curr.id;
+    bool cacheEnabled = curr.l1 != NULL;
+    bool finished = false;
+    bool counted = false; // whether the barrier already knows this hart has stopped
+    if (!loaded)
+    {
+        curr.status = -1;
+        finished = true;
+    }
+    bool allDone = false;
+    while (!allDone)
+    {
+        if (deterministic)
+        {
+            turn.acquire(curr.id);
+        }
+        if (!finished)
+        {
+            int res = runQuantum(quantum, cacheEnabled, curr.l1, curr.instructions);
+            if (res != 0)
+            {
+                curr.status = res;
+                finished = true;
+            }
+        }
+        if (deterministic)
+        {
+            turn.release((curr.id + 1) % numHarts);
+        }
+        allDone = barrier.wait(finished && !counted);
+        counted = finished;
+    }
+    for (int i = 0; i < 32; i++)
+    {
+        curr.regs[i] = registers[i];
+    }
+    curr.pc = mainPC;
+}
+
+bool runHarts(string file, int numHarts, long quantum, bool deterministic, string cacheConfig, vector<hart> &harts)
+{
+    if (numHarts < 2 || numHarts > 64)
+    {
+        cout << "Number of harts must be between 2 and 64" << endl;
+        return false;
+    }
+    if (quantum <= 0)
+    {
+        cout << "Quantum must be positive" << endl;
+        return false;
+    }
+    // the calling thread loads the .data section once, the harts then share a copy of it
+    if (!loadProgram(file))
+    {
+        return false;
+    }
+    unsigned char *shared = new unsigned char[memsize];
+    memcpy(shared, memory, memsize);
+
+    harts.clear();
+    vector<cache *> caches;
+    for (int i = 0; i < numHarts; i++)
+    {
+        harts.push_back(hart(i));
+        if (cacheConfig != "")
+        {
+            harts[i].l1 = enableCache(cacheConfig);
+            if (harts[i].l1 == NULL)
+            {
+                releaseHarts(harts);
+                delete[] shared;
+                return false;
+            }
+            caches.push_back(harts[i].l1);
+        }
+    }
+    // the L1 caches are kept coherent by a snooping bus unless the config asks for NONE
+    if (caches.size() > 0 && caches[0]->coherence_protocol != "NONE")
+    {
+        connectCaches(caches, caches[0]->coherence_protocol);
+    }
+    atomic_domain sharedAtomics;
+    sharedAtomics.parallel = !deterministic;
+    quantum_barrier barrier(numHarts);
+    hart_turn turn;
+    vector<thread> threads;
+    for (int i = 0; i < numHarts; i++)
+    {
+        threads.push_back(thread(hartThread, file, ref(harts[i]), numHarts, shared, &sharedAtomics, quantum, deterministic, ref(barrier), ref(turn)));
+    }
+    for (int i = 0; i < numHarts; i++)
+    {
+        threads[i].join();
+    }
+
+    // write the dirty lines back and leave the final shared memory visible to printMem() on the calling thread
+    for (int i = 0; i < caches.size(); i++)
+    {
+        flushCache(caches[i], shared);
+    }
+    memcpy(memory, shared, memsize);
+    delete[] shared;
+    atomics->stats = sharedAtomics.stats;
+    return true;
+}
+
+void printHarts(vector<hart> &harts)
+{
+    for (int i = 0; i < harts.size(); i++)
+    {
+        cout << "Hart " << harts[i].id << ": Instructions=" << harts[i].instructions;
+        cout << " ,Status=" << (harts[i].status == 1 ? "Finished" : "Error") << endl;
+        for (int j = 0; j < 32; j++)
+        {
+            cout << "0x" << decToHex(harts[i].regs[j]) << endl;
+        }
+        if (harts[i].l1 != NULL)
+        {
+            printCacheStats(harts[i].l1);
+        }
+        cout << endl;
+    }
+}
+
+void releaseHarts(vector<hart> &harts)
+{
+    if (harts.size() > 0 && harts[0].l1 != NULL)
+    {
+        delete harts[0].l1->bus;
+    }
+    for (int i = 0; i < harts.size(); i++)
+    {
+        delete harts[i].l1;
+        harts[i].l1 = NULL;
+    }
+}
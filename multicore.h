@@ -0,0 +1,57 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include "simulator.h"
+
+using namespace std;
+
+/*
+    State of one simulated hart collected after the run. The live register file, PC and
+    call stack are the thread_local simulator globals of the host thread running the hart
+*/
+class hart
+{
+public:
+    int id;
+    long int regs[32];
+    int pc;
+    long instructions;
+    int status; // 1: finished, -1: error
+    cache *l1;
+
+    hart(int id)
+    {
+        this->id = id;
+        for (int i = 0; i < 32; i++)
+        {
+            regs[i] = 0;
+        }
+        pc = 0;
+        instructions = 0;
+        status = 0;
+        l1 = NULL;
+    }
+};
+
+/*
+    Runs the program on numHarts harts (2-64) sharing one guest memory, each on its own host thread
+    with its own registers, PC and L1 cache (cacheConfig, empty for no cache). The L1 caches are kept
+    coherent with the protocol named on line 6 of the config (MESI by default, MOESI or NONE). Every hart starts at
+    main with its hart id in a0. Harts synchronise every quantum instructions; when deterministic is
+    set they also take turns in hart order inside a quantum so shared memory is always updated in the
+    same order; otherwise every access to the shared memory holds one lock, cached or not
+*/
+bool runHarts(string file, int numHarts, long quantum, bool deterministic, string cacheConfig, vector<hart> &harts);
+
+/*
+    Prints the final registers, instruction counts and cache statistics of every hart
+*/
+void printHarts(vector<hart> &harts);
+
+/*
+    Frees the per hart caches and their bus
+*/
+void releaseHarts(vector<hart> &harts);
@@ -0,0 +1,647 @@
+/**
+ * This file contains the out-of-order superscalar timing model. Instructions arrive in program
+ * order from the functional simulator, so the cycles of every instruction are computed once
+ * from the resources left by the instructions before it
+ */
+
+#include <iomanip>
+#include <queue>
+#include <deque>
+#include <map>
+#include <climits>
+#include <functional>
+#include <unordered_map>
+#include "pipeline.h"
+#include "ooo_core.h"
+#include "settings.h"
+
+using namespace std;
+
+#define CYCLE_WINDOW 65536 // cycles tracked by the reservation tables, a power of two
+#define ALU_UNIT 0
+#define MUL_UNIT 1
+#define MEM_UNIT 2
+#define FP_UNIT 3
+
+class ooo_config
+{
+public:
+    int fetchWidth;
+    int issueWidth;
+    int commitWidth;
+    int robSize;
+    int iqSize;
+    int physRegs;
+    int lqSize;
+    int sqSize;
+    int units[4];
+    int frontendDepth;
+    int missPenalty;
+    int fetchMissPenalty;
+    int mshrs;       // 0 for misses that never wait for each other
+    int mshrTargets; // accesses an MSHR serves, the miss included
+    bool conservative;
+
+    ooo_config()
+    {
+        fetchWidth = 4;
+        issueWidth = 4;
+        commitWidth = 4;
+        robSize = 128;
+        iqSize = 48;
+        physRegs = 128;
+        lqSize = 32;
+        sqSize = 24;
+        units[ALU_UNIT] = 3;
+        units[MUL_UNIT] = 1;
+        units[MEM_UNIT] = 2;
+        units[FP_UNIT] = 2;
+        frontendDepth = 4;
+        missPenalty = 20;
+        fetchMissPenalty = 20;
+        mshrs = 0;
+        mshrTargets = 4;
+        conservative = false;
+    }
+};
+
+/*
+    Instructions issued in each cycle, for the issue width or one class of functional units.
+    A slot is reused once the cycle it held is CYCLE_WINDOW cycles in the past
+*/
+class cycle_table
+{
+public:
+    vector<long> stamp;
+    vector<int> count;
+
+    void reset()
+    {
+        stamp.assign(CYCLE_WINDOW, -1);
+        count.assign(CYCLE_WINDOW, 0);
+    }
+
+    int get(long cycle)
+    {
+        int slot = cycle & (CYCLE_WINDOW - 1);
+        return stamp[slot] == cycle ? count[slot] : 0;
+    }
+
+    void add(long cycle)
+    {
+        int slot = cycle & (CYCLE_WINDOW - 1);
+        if (stamp[slot] != cycle)
+        {
+            stamp[slot] = cycle;
+            count[slot] = 0;
+        }
+        count[slot]++;
+    }
+};
+
+/*
+    Cycles spent at every occupancy of a structure. Entries are added at dispatch together with
+    the cycle they leave, and the cycles before the current dispatch cycle are accounted for as
+    dispatch moves forward
+*/
+class occupancy_histogram
+{
+public:
+    vector<long> cycles; // cycles spent with i entries in use
+    priority_queue<long, vector<long>, greater<long> > releases;
+    long last;
+
+    void reset(int capacity)
+    {
+        cycles.assign(capacity + 1, 0);
+        releases = priority_queue<long, vector<long>, greater<long> >();
+        last = 0;
+    }
+
+    void account(long cycle)
+    {
+        if (cycle > last)
+        {
+            cycles[min(releases.size(), cycles.size() - 1)] += cycle - last;
+            last = cycle;
+        }
+    }
+
+    // an entry occupied from cycle now until release
+    void insert(long now, long release)
+    {
+        while (!releases.empty() && releases.top() <= now)
+        {
+            account(releases.top());
+            releases.pop();
+        }
+        account(now);
+        releases.push(release);
+    }
+
+    // accounts for every entry still in use
+    void drain()
+    {
+        while (!releases.empty())
+        {
+            account(releases.top());
+            releases.pop();
+        }
+    }
+};
+
+/*
+    Misses outstanding over time. Loads issue out of order, so the starts and fills of their
+    misses are kept as events until dispatch passes them: no later miss can start before
+*/
+class miss_timeline
+{
+public:
+    map<long, int> events; // cycle -> change of the outstanding misses
+    int outstanding;
+    occupancy_histogram histogram;
+
+    void reset(int capacity)
+    {
+        events.clear();
+        outstanding = 0;
+        histogram.reset(capacity);
+    }
+
+    void add(long start, long fill)
+    {
+        events[start]++;
+        events[fill]--;
+    }
+
+    // accounts for the cycles up to cycle
+    void account(long cycle)
+    {
+        while (!events.empty() && events.begin()->first <= cycle)
+        {
+            long at = events.begin()->first;
+            histogram.cycles[min(outstanding, (int)histogram.cycles.size() - 1)] += at - histogram.last;
+            histogram.last = at;
+            outstanding += events.begin()->second;
+            events.erase(events.begin());
+        }
+    }
+};
+
+/*
+    Miss status holding register: a block being filled and the accesses waiting for it
+*/
+class mshr_entry
+{
+public:
+    unsigned long block;
+    long start; // cycle the miss is sent
+    long fill;  // cycle the data arrives
+    int targets;
+};
+
+/*
+    A store that has not committed yet, loads to the same bytes take their data from it
+*/
+class inflight_store
+{
+public:
+    unsigned long address;
+    int size;
+    long ready; // cycle its address and data are known
+    long commit;
+};
+
+thread_local bool oooEnabled = false;
+thread_local ooo_config core;
+
+thread_local long fetchGroupCycle, fetchedInGroup, fetchAllowed;
+thread_local long dispatchCycle, dispatchedInCycle;
+thread_local long commitCycle, committedInCycle;
+thread_local vector<long> robRelease, lqRelease, sqRelease; // commit cycle of the last occupant of every entry
+thread_local long dispatched, dispatchedLoads, dispatchedStores;
+thread_local priority_queue<long, vector<long>, greater<long> > iqRelease;      // issue cycles of the issue queue entries
+thread_local priority_queue<long, vector<long>, greater<long> > regRelease[2]; // cycles the free physical x and f registers become free
+thread_local long valueReady[96];
+thread_local cycle_table issueSlots, unitSlots[4];
+thread_local deque<inflight_store> inflightStores;
+thread_local vector<mshr_entry> mshrFile; // misses whose fill may still be waited for
+thread_local miss_timeline missTimeline;
+
+thread_local long mispredictions, storeForwards;
+thread_local long primaryMisses, mergedMisses, mshrStalls, targetStalls;
+thread_local long robStalls, iqStalls, lqStalls, sqStalls, regStalls;
+thread_local occupancy_histogram robOccupancy, iqOccupancy, lqOccupancy, sqOccupancy;
+
+bool enableOoo(string file)
+{
+    core = ooo_config();
+    unordered_map<string, int *> settings = {
+        {"fetch_width", &core.fetchWidth}, {"issue_width", &core.issueWidth}, {"commit_width", &core.commitWidth},
+        {"rob_size", &core.robSize}, {"iq_size", &core.iqSize}, {"phys_regs", &core.physRegs},
+        {"lq_size", &core.lqSize}, {"sq_size", &core.sqSize},
+        {"alu_units", &core.units[ALU_UNIT]}, {"mul_units", &core.units[MUL_UNIT]},
+        {"mem_units", &core.units[MEM_UNIT]}, {"fp_units", &core.units[FP_UNIT]},
+        {"frontend_depth", &core.frontendDepth}, {"miss_penalty", &core.missPenalty},
+        {"fetch_miss_penalty", &core.fetchMissPenalty}, {"mshrs", &core.mshrs}, {"mshr_targets", &core.mshrTargets}};
+    auto apply = [&](string setting, const vector<string> &values)
+    {
+        if (setting == "disambiguation" && values.size() == 1 && (values[0] == "oracle" || values[0] == "conservative"))
+        {
+            core.conservative = values[0] == "conservative";
+            return true;
+        }
+        bool penalty = setting == "miss_penalty" || setting == "fetch_miss_penalty" || setting == "frontend_depth" || setting == "mshrs";
+        return setNumber(settings, setting, values, penalty ? 0 : 1);
+    };
+    if (file != "" && !readSettings(file, "core", apply))
+    {
+        return false;
+    }
+    if (core.physRegs <= 32)
+    {
+        cout << "The core needs more than 32 physical registers" << endl;
+        return false;
+    }
+    oooEnabled = true;
+    resetOoo();
+    return true;
+}
+
+void disableOoo()
+{
+    oooEnabled = false;
+}
+
+void resetOoo()
+{
+    fetchGroupCycle = fetchedInGroup = fetchAllowed = 0;
+    dispatchCycle = dispatchedInCycle = 0;
+    commitCycle = committedInCycle = 0;
+    robRelease.assign(core.robSize, 0);
+    lqRelease.assign(core.lqSize, 0);
+    sqRelease.assign(core.sqSize, 0);
+    dispatched = dispatchedLoads = dispatchedStores = 0;
+    iqRelease = priority_queue<long, vector<long>, greater<long> >();
+    for (int file = 0; file < 2; file++)
+    {
+        regRelease[file] = priority_queue<long, vector<long>, greater<long> >();
+        for (int i = 32; i < core.physRegs; i++)
+        {
+            regRelease[file].push(0);
+        }
+    }
+    for (int i = 0; i < 96; i++)
+    {
+        valueReady[i] = 0;
+    }
+    issueSlots.reset();
+    for (int i = 0; i < 4; i++)
+    {
+        unitSlots[i].reset();
+    }
+    inflightStores.clear();
+    mshrFile.clear();
+    // a miss holds its load queue entry, so no more than lq_size are outstanding
+    missTimeline.reset(core.mshrs != 0 ? min(core.mshrs, core.lqSize) : core.lqSize);
+    mispredictions = storeForwards = 0;
+    primaryMisses = mergedMisses = mshrStalls = targetStalls = 0;
+    robStalls = iqStalls = lqStalls = sqStalls = regStalls = 0;
+    robOccupancy.reset(core.robSize);
+    iqOccupancy.reset(core.iqSize);
+    lqOccupancy.reset(core.lqSize);
+    sqOccupancy.reset(core.sqSize);
+}
+
+/*
+    Functional unit class used by the instruction
+*/
+int unitClass(const timing_instruction &inst)
+{
+    string prefix = inst.instr.substr(0, 3);
+    if (inst.isLoad || inst.isStore)
+        return MEM_UNIT;
+    if (prefix == "mul" || prefix == "div" || prefix == "rem")
+        return MUL_UNIT;
+    if ((inst.instr[0] == 'f' && inst.instr != "fence") || inst.instr[0] == 'v')
+        return FP_UNIT;
+    return ALU_UNIT;
+}
+
+/*
+    Moves cycle to the first cycle at least as late as limit, counting the difference as a stall
+*/
+void waitFor(long &cycle, long limit, long &stalls)
+{
+    if (limit > cycle)
+    {
+        stalls += limit - cycle;
+        cycle = limit;
+    }
+}
+
+/*
+    Cycle a load issued at issue completes. Without MSHRs every miss adds the miss penalty. With
+    them a miss is sent once an MSHR is free for its whole fill, and an access to a block being
+    filled waits for that fill, merged into its MSHR while targets are left or replayed after it
+*/
+long loadComplete(const timing_instruction &inst, long issue)
+{
+    long complete = issue + inst.latency;
+    long length = inst.latency + inst.dataMisses * core.missPenalty;
+    if (core.mshrs == 0)
+    {
+        if (inst.dataMisses > 0)
+        {
+            primaryMisses++;
+            missTimeline.add(issue, issue + length);
+        }
+        return issue + length;
+    }
+    for (mshr_entry &entry : mshrFile)
+    {
+        // the miss may still wait for an MSHR, the access waits for its fill all the same
+        if (entry.block != inst.block || entry.fill <= issue)
+        {
+            continue;
+        }
+        if (entry.targets < core.mshrTargets)
+        {
+            entry.targets++;
+            mergedMisses++;
+            return max(complete, entry.fill);
+        }
+        targetStalls += entry.fill - issue;
+        return entry.fill + inst.latency;
+    }
+    if (inst.dataMisses == 0)
+    {
+        return complete;
+    }
+
+    // the most MSHRs in use at once during the fill must leave one free
+    long start = issue;
+    while (true)
+    {
+        vector<mshr_entry *> overlapping;
+        long next = LONG_MAX;
+        for (mshr_entry &entry : mshrFile)
+        {
+            if (entry.start < start + length && start < entry.fill)
+            {
+                overlapping.push_back(&entry);
+                next = min(next, entry.fill);
+            }
+        }
+        int busiest = 0;
+        for (mshr_entry *entry : overlapping)
+        {
+            long at = max(entry->start, start);
+            int busy = 0;
+            for (mshr_entry *other : overlapping)
+            {
+                busy += other->start <= at && at < other->fill;
+            }
+            busiest = max(busiest, busy);
+        }
+        if (busiest < core.mshrs)
+        {
+            break;
+        }
+        start = next;
+    }
+    primaryMisses++;
+    mshrStalls += start - issue;
+    mshrFile.push_back(mshr_entry{inst.block, start, start + length, 1});
+    missTimeline.add(start, start + length);
+    return start + length;
+}
+
+void oooRetire(const timing_instruction &inst)
+{
+    // fetch: fetch_width instructions a cycle, a taken branch ends the group
+    long fetch = max(fetchGroupCycle, fetchAllowed) + inst.fetchMisses * core.fetchMissPenalty;
+    if (fetch == fetchGroupCycle && fetchedInGroup >= core.fetchWidth)
+        fetch++;
+    if (fetch != fetchGroupCycle)
+    {
+        fetchGroupCycle = fetch;
+        fetchedInGroup = 0;
+    }
+    fetchedInGroup++;
+
+    // dispatch in order once the ROB, load/store queue, issue queue and a physical register have room
+    long dispatch = max(fetch + core.frontendDepth, dispatchCycle);
+    waitFor(dispatch, robRelease[dispatched % core.robSize], robStalls);
+    if (inst.isLoad)
+        waitFor(dispatch, lqRelease[dispatchedLoads % core.lqSize], lqStalls);
+    if (inst.isStore)
+        waitFor(dispatch, sqRelease[dispatchedStores % core.sqSize], sqStalls);
+    while (!iqRelease.empty() && (iqRelease.top() <= dispatch || iqRelease.size() >= core.iqSize))
+    {
+        waitFor(dispatch, iqRelease.top(), iqStalls);
+        iqRelease.pop();
+    }
+    int file = (inst.dest >= 0 && inst.dest < 32) ? 0 : (inst.dest >= 32 && inst.dest < 64) ? 1 : -1;
+    if (file != -1)
+    {
+        waitFor(dispatch, regRelease[file].top(), regStalls);
+        regRelease[file].pop();
+    }
+    if (dispatch == dispatchCycle && dispatchedInCycle >= core.fetchWidth)
+        dispatch++;
+    if (dispatch != dispatchCycle)
+    {
+        dispatchCycle = dispatch;
+        dispatchedInCycle = 0;
+    }
+    dispatchedInCycle++;
+
+    // issue once the operands are ready, older stores allow it and a unit is free
+    long issue = dispatch + 1;
+    for (int reg : inst.sources)
+    {
+        issue = max(issue, valueReady[reg]);
+    }
+    bool forwarded = false;
+    while (!inflightStores.empty() && inflightStores.front().commit <= dispatch)
+    {
+        inflightStores.pop_front();
+    }
+    if (inst.isLoad)
+    {
+        for (inflight_store &store : inflightStores)
+        {
+            bool overlaps = store.address < inst.address + inst.size && inst.address < store.address + store.size;
+            if (core.conservative || overlaps)
+            {
+                issue = max(issue, store.ready);
+            }
+            forwarded = forwarded || (overlaps && store.commit > issue);
+        }
+    }
+    int unit = unitClass(inst);
+    string prefix = inst.instr.substr(0, 4);
+    int busy = (prefix.substr(0, 3) == "div" || prefix.substr(0, 3) == "rem" || prefix == "fdiv" || prefix == "fsqr") ? inst.latency : 1;
+    while (true)
+    {
+        bool free = issueSlots.get(issue) < core.issueWidth;
+        for (int i = 0; i < busy && free; i++)
+        {
+            free = unitSlots[unit].get(issue + i) < core.units[unit];
+        }
+        if (free)
+        {
+            break;
+        }
+        issue++;
+    }
+    issueSlots.add(issue);
+    for (int i = 0; i < busy; i++)
+    {
+        unitSlots[unit].add(issue + i);
+    }
+    // every later instruction issues after this dispatch, so the fills before it are over
+    for (int i = 0; i < mshrFile.size(); i++)
+    {
+        if (mshrFile[i].fill <= dispatch)
+        {
+            mshrFile[i--] = mshrFile.back();
+            mshrFile.pop_back();
+        }
+    }
+    missTimeline.account(dispatch);
+    long complete = issue + inst.latency;
+    if (inst.isLoad && !forwarded)
+        complete = loadComplete(inst, issue);
+    storeForwards += forwarded;
+
+    // commit in order, commit_width a cycle
+    long commit = max(complete, commitCycle);
+    if (commit == commitCycle && committedInCycle >= core.commitWidth)
+        commit++;
+    if (commit != commitCycle)
+    {
+        commitCycle = commit;
+        committedInCycle = 0;
+    }
+    committedInCycle++;
+
+    robRelease[dispatched++ % core.robSize] = commit;
+    robOccupancy.insert(dispatch, commit);
+    iqRelease.push(issue);
+    iqOccupancy.insert(dispatch, issue);
+    if (inst.isLoad)
+    {
+        lqRelease[dispatchedLoads++ % core.lqSize] = commit;
+        lqOccupancy.insert(dispatch, commit);
+    }
+    if (inst.isStore)
+    {
+        sqRelease[dispatchedStores++ % core.sqSize] = commit;
+        sqOccupancy.insert(dispatch, commit);
+        inflight_store store;
+        store.address = inst.address;
+        store.size = inst.size;
+        store.ready = issue + 1;
+        store.commit = commit;
+        inflightStores.push_back(store);
+    }
+    if (file != -1)
+    {
+        regRelease[file].push(commit); // the register of the previous value of dest is free once this commits
+    }
+    if (inst.dest != -1)
+    {
+        valueReady[inst.dest] = complete;
+    }
+
+    // a correctly predicted taken branch ends the fetch group. A mispredicted jal is redirected by
+    // the decoder a cycle later, other mispredictions once the branch completes
+    if (inst.isBranch && inst.mispredicted && inst.instr != "jal")
+    {
+        mispredictions++;
+        fetchAllowed = complete + 1;
+    }
+    else if (inst.isBranch && inst.mispredicted)
+    {
+        fetchAllowed = fetch + 2;
+    }
+    else if (inst.isBranch && inst.taken)
+    {
+        fetchAllowed = fetch + 1;
+    }
+}
+
+long oooCycles()
+{
+    return dispatched == 0 ? 0 : commitCycle + 1;
+}
+
+/*
+    Prints the mean occupancy and the share of cycles spent in eight occupancy ranges
+*/
+void printOccupancy(string name, occupancy_histogram histogram)
+{
+    histogram.drain();
+    long total = 0;
+    double sum = 0;
+    int capacity = histogram.cycles.size() - 1;
+    for (int i = 0; i <= capacity; i++)
+    {
+        total += histogram.cycles[i];
+        sum += (double)i * histogram.cycles[i];
+    }
+    cout << name << " occupancy: Mean=" << fixed << setprecision(2) << (total != 0 ? sum / total : 0);
+    cout << " ,Full=" << setprecision(1) << (total != 0 ? 100.0 * histogram.cycles[capacity] / total : 0) << "%" << endl;
+    for (int bucket = 0; bucket < 8; bucket++)
+    {
+        int low = bucket * (capacity + 1) / 8, high = (bucket + 1) * (capacity + 1) / 8 - 1;
+        if (high < low)
+        {
+            continue;
+        }
+        long cycles = 0;
+        for (int i = low; i <= high; i++)
+        {
+            cycles += histogram.cycles[i];
+        }
+        cout << "  [" << low << "-" << high << "]=" << setprecision(1) << (total != 0 ? 100.0 * cycles / total : 0) << "%";
+    }
+    cout << endl;
+}
+
+void printOooStats()
+{
+    long cycles = oooCycles();
+    cout << "Out-of-order core statistics:";
+    cout << " Cycles=" << cycles;
+    cout << " ,Instructions=" << dispatched;
+    cout << " ,IPC=" << fixed << setprecision(2) << (cycles != 0 ? (float)dispatched / cycles : 0);
+    cout << " ,Mispredictions=" << mispredictions;
+    cout << " ,Store to load forwards=" << storeForwards << endl;
+    cout << "Dispatch stalls: ROB=" << robStalls << " ,IQ=" << iqStalls << " ,LQ=" << lqStalls;
+    cout << " ,SQ=" << sqStalls << " ,Registers=" << regStalls << endl;
+    printOccupancy("ROB", robOccupancy);
+    printOccupancy("IQ", iqOccupancy);
+    printOccupancy("LQ", lqOccupancy);
+    printOccupancy("SQ", sqOccupancy);
+
+    // memory-level parallelism: the misses outstanding while at least one is
+    miss_timeline timeline = missTimeline;
+    timeline.account(LONG_MAX);
+    long missCycles = 0;
+    double sum = 0;
+    for (int i = 1; i < timeline.histogram.cycles.size(); i++)
+    {
+        missCycles += timeline.histogram.cycles[i];
+        sum += (double)i * timeline.histogram.cycles[i];
+    }
+    cout << "Load misses: Primary=" << primaryMisses << " ,Merged=" << mergedMisses;
+    cout << " ,MSHR Full Stalls=" << mshrStalls << " ,Target Stalls=" << targetStalls;
+    cout << " ,Miss Cycles=" << missCycles << " ,MLP=" << setprecision(2) << (missCycles != 0 ? sum / missCycles : 0) << endl;
+    if (core.mshrs != 0)
+    {
+        printOccupancy("MSHR", timeline.histogram);
+    }
+}
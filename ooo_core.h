@@ -0,0 +1,60 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+class timing_instruction;
+
+extern thread_local bool oooEnabled;
+
+/*
+    Turns on the out-of-order superscalar timing model. The functional simulator acts as an
+    execute-at-fetch oracle: every retired instruction arrives with its operands, effective
+    address and branch outcome and the model computes its fetch, dispatch, issue, complete and
+    commit cycles. The optional file holds "setting value" lines:
+        fetch_width, issue_width, commit_width   instructions per cycle (default 4, 4, 4)
+        rob_size, iq_size                        reorder buffer and issue queue entries (default 128, 48)
+        phys_regs                                physical registers of each of the x and f files (default 128)
+        lq_size, sq_size                         load and store queue entries (default 32, 24)
+        alu_units, mul_units, mem_units, fp_units functional units of each class (default 3, 1, 2, 2)
+        frontend_depth                           cycles from fetch to dispatch (default 4)
+        miss_penalty, fetch_miss_penalty         extra cycles of a D-cache and I-cache miss (default 20, 20)
+        mshrs                                    miss status holding registers of the D-cache, 0 for
+                                                 misses that never wait for each other (default 0)
+        mshr_targets                             accesses one MSHR serves: a load to a block being
+                                                 filled merges into its MSHR or, once it is full,
+                                                 waits for the fill and replays (default 4)
+        disambiguation oracle|conservative       loads wait only for older stores to the same bytes,
+                                                 or for every older store address (default oracle)
+    Execute latencies come from getLatency(); dividers are not pipelined. Load misses hold an MSHR
+    from the cycle they are sent until their fill; stores do not use them. Branches are predicted
+    by the first branch predictor, or all taken ones mispredicted when predictors are off, and a
+    mispredicted branch redirects fetch once it completes.
+    Returns false if the file cannot be read or holds an invalid setting
+*/
+bool enableOoo(string file);
+
+void disableOoo();
+
+/*
+    Clears the core and its statistics, called when a program is loaded
+*/
+void resetOoo();
+
+/*
+    Runs one retired instruction through the core
+*/
+void oooRetire(const timing_instruction &inst);
+
+/*
+    Cycle after the last commit
+*/
+long oooCycles();
+
+/*
+    Prints IPC, dispatch stalls by structure, the occupancy histogram of the ROB, issue queue,
+    load queue, store queue and MSHRs, and the memory-level parallelism: the mean number of load
+    misses outstanding over the cycles with at least one
+*/
+void printOooStats();
@@ -0,0 +1,196 @@
+/**
+ * This file contains the five stage in-order pipeline timing model. It follows the retired
+ * instruction stream of the functional simulator and computes the cycle in which every
+ * instruction enters each stage
+ */
+
+#include <iomanip>
+#include <algorithm>
+#include <unordered_map>
+#include "simulator.h"
+#include "pipeline.h"
+#include "settings.h"
+
+using namespace std;
+
+#define TIMING_REGISTERS 96
+
+thread_local bool pipelineEnabled = false;
+thread_local string forwarding = "full";
+thread_local int branchPenalty = 2;
+thread_local int missPenalty = 20;
+thread_local int fetchMissPenalty = 20;
+
+// stage entry cycles of the previous instruction
+thread_local long fetchCycle, decodeCycle, executeCycle, memoryCycle, writebackCycle;
+thread_local bool redirect; // the previous instruction was a mispredicted branch or jump
+// per register: earliest cycle a reader can enter EX, and the producer's MEM and WB entry cycles
+thread_local long available[TIMING_REGISTERS], producedMemory[TIMING_REGISTERS], producedWriteback[TIMING_REGISTERS];
+thread_local bool producedByLoad[TIMING_REGISTERS];
+
+thread_local long retired;
+thread_local long loadUseStalls, dataStalls, structuralStalls, controlStalls, memoryStalls, fetchStalls;
+thread_local long forwardedExMem, forwardedMemWb;
+thread_local unordered_map<int, pair<long, long> > lineCycles; // pc -> executions, cycles
+
+bool enablePipeline(string file)
+{
+    forwarding = "full";
+    branchPenalty = 2;
+    missPenalty = 20;
+    fetchMissPenalty = 20;
+    unordered_map<string, int *> settings = {
+        {"branch_penalty", &branchPenalty}, {"miss_penalty", &missPenalty}, {"fetch_miss_penalty", &fetchMissPenalty}};
+    auto apply = [&](string setting, const vector<string> &values)
+    {
+        if (setting == "forwarding" && values.size() == 1 && (values[0] == "full" || values[0] == "mem" || values[0] == "none"))
+        {
+            forwarding = values[0];
+            return true;
+        }
+        return setNumber(settings, setting, values, 0);
+    };
+    if (file != "" && !readSettings(file, "pipeline", apply))
+    {
+        return false;
+    }
+    pipelineEnabled = true;
+    resetPipeline();
+    return true;
+}
+
+void disablePipeline()
+{
+    pipelineEnabled = false;
+}
+
+void resetPipeline()
+{
+    // the first instruction is fetched in cycle 0
+    fetchCycle = decodeCycle = executeCycle = memoryCycle = writebackCycle = -1;
+    redirect = false;
+    for (int i = 0; i < TIMING_REGISTERS; i++)
+    {
+        available[i] = producedMemory[i] = producedWriteback[i] = 0;
+        producedByLoad[i] = false;
+    }
+    retired = 0;
+    loadUseStalls = dataStalls = structuralStalls = controlStalls = memoryStalls = fetchStalls = 0;
+    forwardedExMem = forwardedMemWb = 0;
+    lineCycles.clear();
+}
+
+/*
+    Takes up to stall cycles of the unexplained delay for one cause
+*/
+long charge(long &delay, long stall)
+{
+    long part = min(delay, max(stall, 0L));
+    delay -= part;
+    return part;
+}
+
+void pipelineRetire(const timing_instruction &inst)
+{
+    int fetchStall = inst.fetchMisses * fetchMissPenalty;
+    int memoryStall = inst.dataMisses * missPenalty;
+
+    // every stage waits for the previous instruction to leave it. A mispredicted branch resolves in
+    // EX and the correct path is fetched branchPenalty cycles after the next sequential fetch slot
+    long fetch = max(fetchCycle + 1, decodeCycle);
+    long bubbles = redirect ? max(executeCycle - 1 + branchPenalty - fetch, 0L) : 0;
+    fetch += bubbles;
+    long decode = max(fetch + 1 + fetchStall, executeCycle);
+    long operands = 0;
+    int producer = -1;
+    for (int reg : inst.sources)
+    {
+        if (available[reg] > operands)
+        {
+            operands = available[reg];
+            producer = reg;
+        }
+    }
+    long execute = max(max(decode + 1, memoryCycle), operands);
+    long memory = max(execute + inst.latency, writebackCycle);
+    long writeback = memory + 1 + memoryStall;
+
+    // operands still in flight when this instruction reads them were forwarded
+    for (int reg : inst.sources)
+    {
+        if (forwarding != "none" && producedWriteback[reg] > decode)
+        {
+            if (execute == producedMemory[reg] && !producedByLoad[reg])
+                forwardedExMem++;
+            else if (execute <= producedWriteback[reg])
+                forwardedMemWb++;
+        }
+    }
+
+    // the cycles between this instruction and the previous one leaving WB are stalls, split by cause
+    long delay = writeback - max(writebackCycle, 3L) - 1;
+    memoryStalls += charge(delay, memoryStall);
+    long hazard = charge(delay, operands - max(decode + 1, memoryCycle));
+    (producer != -1 && producedByLoad[producer] ? loadUseStalls : dataStalls) += hazard;
+    structuralStalls += charge(delay, max(memoryCycle - decode - 1, writebackCycle - execute - inst.latency));
+    controlStalls += charge(delay, bubbles);
+    fetchStalls += charge(delay, fetchStall);
+    structuralStalls += delay;
+
+    pair<long, long> &line = lineCycles[inst.pc];
+    line.first++;
+    line.second += writeback - max(writebackCycle, 3L);
+
+    if (inst.dest != -1)
+    {
+        producedMemory[inst.dest] = memory;
+        producedWriteback[inst.dest] = writeback;
+        producedByLoad[inst.dest] = inst.isLoad;
+        if (forwarding == "none")
+            available[inst.dest] = writeback + 1; // written in the first half of WB, read in ID of the next cycle
+        else if (forwarding == "mem" || inst.isLoad)
+            available[inst.dest] = writeback;
+        else
+            available[inst.dest] = memory;
+    }
+    fetchCycle = fetch;
+    decodeCycle = decode;
+    executeCycle = execute;
+    memoryCycle = memory;
+    writebackCycle = writeback;
+    redirect = inst.isBranch && inst.mispredicted;
+    retired++;
+}
+
+long pipelineCycles()
+{
+    return writebackCycle + 1;
+}
+
+void printPipelineStats(int count)
+{
+    long cycles = pipelineCycles();
+    cout << "Pipeline statistics:";
+    cout << " Cycles=" << cycles;
+    cout << " ,Instructions=" << retired;
+    cout << " ,CPI=" << fixed << setprecision(2) << (retired != 0 ? (float)cycles / retired : 0) << endl;
+    cout << "Stalls: Load-use=" << loadUseStalls << " ,RAW=" << dataStalls << " ,Structural=" << structuralStalls;
+    cout << " ,Control=" << controlStalls << " ,D-cache=" << memoryStalls << " ,I-cache=" << fetchStalls << endl;
+    cout << "Forwarding (" << forwarding << "): EX/MEM=" << forwardedExMem << " ,MEM/WB=" << forwardedMemWb << endl;
+
+    vector<pair<long, int> > order;
+    for (auto it = lineCycles.begin(); it != lineCycles.end(); it++)
+    {
+        order.push_back(make_pair(it->second.second, it->first));
+    }
+    sort(order.rbegin(), order.rend());
+    cout << "Cycles per static instruction:" << endl;
+    for (int i = 0; i < order.size() && i < count; i++)
+    {
+        int pc = order[i].second;
+        pair<long, long> line = lineCycles[pc];
+        cout << "Line " << pc / 4 + 1 << ": " << (pc / 4 < lines.size() ? lines[pc / 4].second : "");
+        cout << " ,Executions=" << line.first << " ,Cycles=" << line.second;
+        cout << " ,CPI=" << fixed << setprecision(2) << (float)line.second / line.first << endl;
+    }
+}
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+// kinds of control transfer, jal and jalr link through ra or t0 as the RISC-V calling convention hints
+#define BRANCH_NONE 0
+#define BRANCH_CONDITIONAL 1
+#define BRANCH_JUMP 2     // jal without a link register
+#define BRANCH_CALL 3     // jal or jalr writing ra or t0
+#define BRANCH_RETURN 4   // jalr through ra or t0 that does not link
+#define BRANCH_INDIRECT 5 // any other jalr
+
+/*
+    One executed instruction as seen by the timing models. The simulator decodes the operands
+    of every line once and fills in the outcome of each execution
+*/
+class timing_instruction
+{
+public:
+    int pc;
+    string instr;        // mnemonic, compressed instructions appear as their expansion
+    vector<int> sources; // registers read: x1-x31 as 1-31, f0-f31 as 32-63, v0-v31 as 64-95
+    int dest;            // register written in the same numbering, -1 for none or x0
+    bool isLoad;
+    bool isStore;
+    bool isBranch;  // conditional branches and jumps
+    int branchKind; // one of the BRANCH_ kinds
+    int latency;    // execute cycles, from getLatency()
+    // outcome of this execution
+    bool taken;
+    int target;            // pc reached when taken
+    bool mispredicted;     // the next pc differed from the prediction, every taken branch without predictors
+    int dataMisses;        // D-cache misses of its memory accesses
+    int fetchMisses;       // I-cache misses of its fetch
+    unsigned long address; // first byte accessed by a load or store
+    int size;              // bytes accessed
+    unsigned long block;   // D-cache block holding address
+
+    timing_instruction()
+    {
+        pc = 0;
+        instr = "";
+        dest = -1;
+        isLoad = false;
+        isStore = false;
+        isBranch = false;
+        branchKind = BRANCH_NONE;
+        latency = 1;
+        taken = false;
+        target = 0;
+        mispredicted = false;
+        dataMisses = 0;
+        fetchMisses = 0;
+        address = 0;
+        size = 0;
+        block = 0;
+    }
+};
+
+extern thread_local bool pipelineEnabled;
+
+/*
+    Turns on the five stage in-order pipeline model (IF ID EX MEM WB). The optional file holds
+    "setting value" lines:
+        forwarding full|mem|none   paths into EX: EX/MEM and MEM/WB, MEM/WB only, or none (default full)
+        branch_penalty n           bubbles after a mispredicted branch or jump (default 2)
+        miss_penalty n             extra MEM cycles of a D-cache miss (default 20)
+        fetch_miss_penalty n       extra IF cycles of an I-cache miss (default 20)
+    Returns false if the file cannot be read or holds an invalid setting
+*/
+bool enablePipeline(string file);
+
+void disablePipeline();
+
+/*
+    Clears the pipeline and its statistics, called when a program is loaded
+*/
+void resetPipeline();
+
+/*
+    Advances the pipeline by one retired instruction
+*/
+void pipelineRetire(const timing_instruction &inst);
+
+/*
+    Cycle in which the last retired instruction left WB
+*/
+long pipelineCycles();
+
+/*
+    Prints the cycles, CPI, stalls by cause, forwarded operands and the count static
+    instructions that took the most cycles
+*/
+void printPipelineStats(int count);
@@ -0,0 +1,289 @@
+/**
+ * This file contains the hardware prefetchers of the cache simulator. A prefetcher watches the
+ * demand accesses of one cache and fills blocks ahead of them; the cache counts how many of
+ * those blocks were demanded, arrived too late or were evicted unused
+ */
+
+#include <iomanip>
+#include <deque>
+#include "simulator.h"
+#include "prefetcher.h"
+#include "settings.h"
+#include "dram.h"
+
+using namespace std;
+
+#define DELTA_HISTORY 16 // block deltas remembered per pc by the delta prefetcher
+
+/*
+    Reference prediction table entry: the last address of a pc and the stride between its accesses
+*/
+class stride_entry
+{
+public:
+    int pc;
+    unsigned long last;
+    long stride;
+    int confidence; // 0 to 3, prefetches from 2
+};
+
+class delta_entry
+{
+public:
+    int pc;
+    unsigned long last; // last block accessed
+    vector<long> deltas; // circular, in blocks
+    int count;           // deltas recorded so far
+};
+
+class stream_buffer
+{
+public:
+    deque<pair<unsigned long, int> > blocks; // base address and arrival of the prefetched blocks
+    unsigned long next;                      // next block to fetch
+    long used;                               // last allocation or hit, for LRU
+};
+
+class prefetcher
+{
+public:
+    string type;
+    int degree;
+    int distance;
+    int tableEntries;
+    int streams;
+    int latency;
+    vector<stride_entry> strideTable;
+    vector<delta_entry> deltaTable;
+    vector<stream_buffer> buffers;
+    long now;
+
+    prefetcher()
+    {
+        type = "next_line";
+        degree = 2;
+        distance = 1;
+        tableEntries = 64;
+        streams = 4;
+        latency = 10;
+        now = 0;
+    }
+};
+
+bool enablePrefetcher(cache *newCache, string file)
+{
+    prefetcher *config = new prefetcher();
+    unordered_map<string, int *> settings = {
+        {"degree", &config->degree}, {"distance", &config->distance}, {"table_entries", &config->tableEntries},
+        {"streams", &config->streams}, {"latency", &config->latency}};
+    auto apply = [&](string setting, const vector<string> &values)
+    {
+        string type = values.size() == 1 ? values[0] : "";
+        if (setting == "type" && (type == "next_line" || type == "stride" || type == "stream" || type == "delta"))
+        {
+            config->type = type;
+            return true;
+        }
+        return setNumber(settings, setting, values, setting == "latency" ? 0 : 1);
+    };
+    if (file != "" && !readSettings(file, "prefetcher", apply))
+    {
+        delete config;
+        return false;
+    }
+    disablePrefetcher(newCache);
+    newCache->prefetch = config;
+    resetPrefetcher(newCache);
+    return true;
+}
+
+void disablePrefetcher(cache *newCache)
+{
+    delete newCache->prefetch;
+    newCache->prefetch = NULL;
+}
+
+void resetPrefetcher(cache *newCache)
+{
+    prefetcher *p = newCache->prefetch;
+    p->strideTable.assign(p->type == "stride" ? p->tableEntries : 0, stride_entry{-1, 0, 0, 0});
+    p->deltaTable.assign(p->type == "delta" ? p->tableEntries : 0, delta_entry{-1, 0, vector<long>(DELTA_HISTORY, 0), 0});
+    p->buffers.assign(p->type == "stream" ? p->streams : 0, stream_buffer());
+    p->now = 0;
+}
+
+/*
+    Prefetches the block holding address into the cache if it lies in memory
+*/
+void issuePrefetch(cache *newCache, unsigned long address, unsigned char *memory)
+{
+    unsigned long baseaddress = address - address % newCache->block_size;
+    if (baseaddress + newCache->block_size > memsize)
+    {
+        return; // also catches addresses below 0 wrapping around
+    }
+    int ready = newCache->hits + newCache->misses + newCache->prefetch->latency;
+    if (prefetchBlock(newCache, baseaddress, ready, memory))
+    {
+        newCache->prefetches++;
+        if (dramEnabled)
+        {
+            dramAccess(baseaddress, newCache->block_size, DRAM_PREFETCH);
+        }
+    }
+}
+
+/*
+    Refills the stream buffer up to degree blocks
+*/
+void fillStream(cache *newCache, stream_buffer &buffer)
+{
+    prefetcher *p = newCache->prefetch;
+    while (buffer.blocks.size() < p->degree && buffer.next + newCache->block_size <= memsize)
+    {
+        buffer.blocks.push_back(make_pair(buffer.next, newCache->hits + newCache->misses + p->latency));
+        if (dramEnabled)
+        {
+            dramAccess(buffer.next, newCache->block_size, DRAM_PREFETCH);
+        }
+        buffer.next += newCache->block_size;
+        newCache->prefetches++;
+    }
+}
+
+bool prefetchLookup(cache *newCache, unsigned long baseaddress, unsigned char *memory)
+{
+    prefetcher *p = newCache->prefetch;
+    p->now++;
+    for (stream_buffer &buffer : p->buffers)
+    {
+        for (int i = 0; i < buffer.blocks.size(); i++)
+        {
+            if (buffer.blocks[i].first != baseaddress)
+            {
+                continue;
+            }
+            // blocks skipped over by the stream are dropped
+            newCache->unused_prefetches += i;
+            int ready = buffer.blocks[i].second;
+            buffer.blocks.erase(buffer.blocks.begin(), buffer.blocks.begin() + i + 1);
+            if (!prefetchBlock(newCache, baseaddress, ready, memory))
+            {
+                return false;
+            }
+            buffer.used = p->now;
+            fillStream(newCache, buffer);
+            return true;
+        }
+    }
+    return false;
+}
+
+void prefetchTrain(cache *newCache, unsigned long address, bool miss, bool prefetchHit, unsigned char *memory)
+{
+    prefetcher *p = newCache->prefetch;
+    unsigned long block = address / newCache->block_size;
+    if (p->type == "next_line" && (miss || prefetchHit))
+    {
+        for (int i = 0; i < p->degree; i++)
+        {
+            issuePrefetch(newCache, (block + p->distance + i) * newCache->block_size, memory);
+        }
+    }
+    else if (p->type == "stream" && miss)
+    {
+        // the least recently used buffer follows the new stream
+        stream_buffer *victim = &p->buffers[0];
+        for (stream_buffer &buffer : p->buffers)
+        {
+            if (buffer.used < victim->used)
+            {
+                victim = &buffer;
+            }
+        }
+        newCache->unused_prefetches += victim->blocks.size();
+        victim->blocks.clear();
+        victim->next = (block + p->distance) * newCache->block_size;
+        victim->used = ++p->now;
+        fillStream(newCache, *victim);
+    }
+    else if (p->type == "stride")
+    {
+        stride_entry &entry = p->strideTable[(mainPC / 4) % p->tableEntries];
+        if (entry.pc != mainPC)
+        {
+            entry = stride_entry{mainPC, address, 0, 0};
+            return;
+        }
+        long stride = address - entry.last;
+        if (stride == entry.stride && stride != 0)
+            entry.confidence = min(entry.confidence + 1, 3);
+        else if (entry.confidence > 0)
+            entry.confidence--;
+        else
+            entry.stride = stride;
+        entry.last = address;
+        for (int i = 0; entry.confidence >= 2 && i < p->degree; i++)
+        {
+            issuePrefetch(newCache, address + entry.stride * (p->distance + i), memory);
+        }
+    }
+    else if (p->type == "delta")
+    {
+        delta_entry &entry = p->deltaTable[(mainPC / 4) % p->tableEntries];
+        if (entry.pc != mainPC)
+        {
+            entry.pc = mainPC;
+            entry.last = block;
+            entry.count = 0;
+            return;
+        }
+        if (block == entry.last)
+        {
+            return;
+        }
+        entry.deltas[entry.count % DELTA_HISTORY] = (long)(block - entry.last);
+        entry.count++;
+        entry.last = block;
+        int newest = entry.count - 1;
+        int oldest = max(entry.count - DELTA_HISTORY, 0);
+        if (newest - oldest < 2)
+        {
+            return;
+        }
+        long d1 = entry.deltas[(newest - 1) % DELTA_HISTORY];
+        long d2 = entry.deltas[newest % DELTA_HISTORY];
+        // the most recent earlier occurrence of the last two deltas starts the pattern to replay
+        for (int i = newest - 1; i > oldest; i--)
+        {
+            if (entry.deltas[(i - 1) % DELTA_HISTORY] != d1 || entry.deltas[i % DELTA_HISTORY] != d2)
+            {
+                continue;
+            }
+            int period = newest - i;
+            unsigned long next = block;
+            for (int k = 1; k < p->distance + p->degree; k++)
+            {
+                next += entry.deltas[(i + 1 + (k - 1) % period) % DELTA_HISTORY];
+                if (k >= p->distance)
+                {
+                    issuePrefetch(newCache, next * newCache->block_size, memory);
+                }
+            }
+            break;
+        }
+    }
+}
+
+void printPrefetchStats(cache *newCache)
+{
+    int useful = newCache->useful_prefetches;
+    cout << "Prefetcher statistics (" << newCache->prefetch->type << "):";
+    cout << " Issued=" << newCache->prefetches;
+    cout << " ,Useful=" << useful;
+    cout << " ,Late=" << newCache->late_prefetches;
+    cout << " ,Unused=" << newCache->unused_prefetches;
+    cout << " ,Accuracy=" << fixed << setprecision(2) << (newCache->prefetches != 0 ? (float)useful / newCache->prefetches : 0);
+    cout << " ,Coverage=" << (useful + newCache->misses != 0 ? (float)useful / (useful + newCache->misses) : 0);
+    cout << " ,Timeliness=" << (useful != 0 ? (float)(useful - newCache->late_prefetches) / useful : 0) << endl;
+}
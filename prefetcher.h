@@ -0,0 +1,50 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+class cache;
+
+/*
+    Attaches a hardware prefetcher to the cache. The optional file holds "setting value" lines:
+        type next_line|stride|stream|delta
+            next_line  the blocks after a missing block or the first demand of a prefetched one
+            stride     per-pc reference prediction table, prefetches once a stride repeats
+            stream     stream buffers allocated on misses, a miss found in a buffer moves the
+                       block into the cache and the buffer fetches one block further
+            delta      per-pc history of block deltas, replays the deltas that followed the last
+                       earlier occurrence of the two most recent ones
+        degree n          blocks prefetched per trigger, the depth of a stream buffer (default 2)
+        distance n        blocks (or strides) between the access and the first prefetch (default 1)
+        table_entries n   pcs tracked by stride and delta (default 64)
+        streams n         stream buffers (default 4)
+        latency n         accesses of the cache before a prefetched block arrives, a block
+                          demanded sooner is a late prefetch (default 10)
+    Returns false if the file cannot be read or holds an invalid setting
+*/
+bool enablePrefetcher(cache *newCache, string file);
+
+void disablePrefetcher(cache *newCache);
+
+/*
+    Clears the prefetcher tables, called by resetCache
+*/
+void resetPrefetcher(cache *newCache);
+
+/*
+    Called on a demand miss of the block at baseaddress. Returns true if a stream buffer held the
+    block and moved it into the cache
+*/
+bool prefetchLookup(cache *newCache, unsigned long baseaddress, unsigned char *memory);
+
+/*
+    Trains the prefetcher with a demand access and issues the prefetches it triggers. prefetchHit
+    tells whether the access was the first demand of a prefetched block
+*/
+void prefetchTrain(cache *newCache, unsigned long address, bool miss, bool prefetchHit, unsigned char *memory);
+
+/*
+    Prints the issued, useful, late and unused prefetches along with accuracy, coverage and timeliness
+*/
+void printPrefetchStats(cache *newCache);
@@ -0,0 +1,281 @@
+/**
+ * This file contains the reuse profiler. It sizes caches before any cache is simulated: a
+ * spatially sampled stream of the data blocks accessed by the program (as in SHARDS) feeds an
+ * LRU stack distance counter, and the blocks touched by every window of instructions give the
+ * working set over time
+ */
+
+#include <iomanip>
+#include <algorithm>
+#include <unordered_map>
+#include "simulator.h"
+#include "reuse_profiler.h"
+#include "settings.h"
+
+using namespace std;
+
+#define DISTANCE_BUCKETS 32 // reuse distances in blocks: 0, 1, 2-3, 4-7, ... and 2^30 or more
+#define INITIAL_TIMES 65536 // sampled accesses numbered before the first renumbering
+
+/*
+    Last access of a sampled block
+*/
+class block_entry
+{
+public:
+    long last;   // number of the access in the stack distance tree
+    long window; // working set window of the access
+};
+
+class reuse_profiler
+{
+public:
+    int blockSize;
+    int window;
+    int sampling;
+    unordered_map<unsigned long, block_entry> blocks;
+    vector<int> tree; // Fenwick tree over access numbers, 1 where a block was last accessed
+    long now;         // number of the last sampled access
+    long live;        // sampled blocks seen so far, the ones in the tree
+    long accesses;    // all block accesses
+    long sampled;
+    long cold;        // sampled first accesses
+    vector<long> histogram; // sampled reuses in DISTANCE_BUCKETS buckets
+    long instructions;
+    long windowBlocks; // sampled blocks touched in the current window
+    vector<long> workingSet;
+
+    reuse_profiler()
+    {
+        blockSize = 64;
+        window = 100000;
+        sampling = 64;
+    }
+};
+
+thread_local bool profilerEnabled = false;
+thread_local reuse_profiler profiler;
+
+bool enableReuseProfiler(string file)
+{
+    reuse_profiler config;
+    unordered_map<string, int *> settings = {
+        {"block_size", &config.blockSize}, {"window", &config.window}, {"sampling", &config.sampling}};
+    auto apply = [&](string setting, const vector<string> &values)
+    {
+        return setNumber(settings, setting, values, 1) && (config.blockSize & (config.blockSize - 1)) == 0;
+    };
+    if (file != "" && !readSettings(file, "profiler", apply))
+    {
+        return false;
+    }
+    profiler.blockSize = config.blockSize;
+    profiler.window = config.window;
+    profiler.sampling = config.sampling;
+    profilerEnabled = true;
+    resetReuseProfiler();
+    return true;
+}
+
+void disableReuseProfiler()
+{
+    profilerEnabled = false;
+}
+
+void resetReuseProfiler()
+{
+    profiler.blocks.clear();
+    profiler.tree.assign(INITIAL_TIMES + 1, 0);
+    profiler.now = 0;
+    profiler.live = 0;
+    profiler.accesses = 0;
+    profiler.sampled = 0;
+    profiler.cold = 0;
+    profiler.histogram.assign(DISTANCE_BUCKETS, 0);
+    profiler.instructions = 0;
+    profiler.windowBlocks = 0;
+    profiler.workingSet.clear();
+}
+
+void treeAdd(long time, int value)
+{
+    for (; time < profiler.tree.size(); time += time & -time)
+    {
+        profiler.tree[time] += value;
+    }
+}
+
+/*
+    Blocks whose last access is at or before time
+*/
+long treeCount(long time)
+{
+    long count = 0;
+    for (; time > 0; time -= time & -time)
+    {
+        count += profiler.tree[time];
+    }
+    return count;
+}
+
+/*
+    Numbers the last accesses of the sampled blocks again from 1 once the tree is full, keeping
+    their order, and grows the tree if they fill more than half of it
+*/
+void renumberAccesses()
+{
+    vector<pair<long, unsigned long> > order;
+    for (auto it = profiler.blocks.begin(); it != profiler.blocks.end(); it++)
+    {
+        order.push_back(make_pair(it->second.last, it->first));
+    }
+    sort(order.begin(), order.end());
+    long size = profiler.tree.size() - 1;
+    while (order.size() * 2 > size)
+    {
+        size *= 2;
+    }
+    profiler.tree.assign(size + 1, 0);
+    for (long i = 0; i < order.size(); i++)
+    {
+        profiler.blocks[order[i].second].last = i + 1;
+        treeAdd(i + 1, 1);
+    }
+    profiler.now = order.size();
+}
+
+/*
+    Mixes the bits of the block number so that sampling picks blocks independently of the layout
+*/
+unsigned long hashBlock(unsigned long block)
+{
+    block ^= block >> 33;
+    block *= 0xff51afd7ed558ccdUL;
+    block ^= block >> 33;
+    block *= 0xc4ceb9fe1a85ec53UL;
+    block ^= block >> 33;
+    return block;
+}
+
+void profileAccess(unsigned long address, unsigned long size)
+{
+    unsigned long first = address / profiler.blockSize;
+    unsigned long last = (address + max(size, 1UL) - 1) / profiler.blockSize;
+    for (unsigned long block = first; block <= last; block++)
+    {
+        profiler.accesses++;
+        if (hashBlock(block) % profiler.sampling != 0)
+        {
+            continue;
+        }
+        profiler.sampled++;
+        if (profiler.now + 1 == profiler.tree.size())
+        {
+            renumberAccesses();
+        }
+        long window = profiler.workingSet.size();
+        auto it = profiler.blocks.find(block);
+        if (it == profiler.blocks.end())
+        {
+            profiler.cold++;
+            profiler.live++;
+            profiler.windowBlocks++;
+            profiler.now++;
+            profiler.blocks[block] = block_entry{profiler.now, window};
+            treeAdd(profiler.now, 1);
+            continue;
+        }
+        block_entry &entry = it->second;
+        // sampled blocks accessed since, scaled to all blocks
+        long distance = (profiler.live - treeCount(entry.last)) * profiler.sampling;
+        int bucket = 0;
+        while (bucket < DISTANCE_BUCKETS - 1 && distance >= (1L << bucket))
+        {
+            bucket++;
+        }
+        profiler.histogram[bucket]++;
+        treeAdd(entry.last, -1);
+        profiler.now++;
+        entry.last = profiler.now;
+        treeAdd(profiler.now, 1);
+        if (entry.window != window)
+        {
+            entry.window = window;
+            profiler.windowBlocks++;
+        }
+    }
+}
+
+void profileInstruction()
+{
+    profiler.instructions++;
+    if (profiler.instructions % profiler.window == 0)
+    {
+        profiler.workingSet.push_back(profiler.windowBlocks * profiler.sampling);
+        profiler.windowBlocks = 0;
+    }
+}
+
+void printReuseProfile(int count)
+{
+    long sampling = profiler.sampling;
+    long reuses = profiler.sampled - profiler.cold;
+    cout << "Reuse profile (" << profiler.blockSize << "B blocks, 1 in " << sampling << " sampled):";
+    cout << " Instructions=" << profiler.instructions;
+    cout << " ,Block Accesses=" << profiler.accesses;
+    cout << " ,Sampled=" << profiler.sampled;
+    cout << " ,Distinct Blocks=" << profiler.cold * sampling;
+    cout << " ,Footprint=" << profiler.cold * sampling * profiler.blockSize << "B" << endl;
+    cout << "Reuse distance in blocks:" << endl;
+    for (int bucket = 0; bucket < DISTANCE_BUCKETS; bucket++)
+    {
+        if (profiler.histogram[bucket] == 0)
+        {
+            continue;
+        }
+        long low = bucket == 0 ? 0 : 1L << (bucket - 1);
+        long high = bucket == 0 ? 0 : (1L << bucket) - 1;
+        cout << "  " << low;
+        if (bucket == DISTANCE_BUCKETS - 1)
+            cout << "+";
+        else if (high != low)
+            cout << "-" << high;
+        cout << ": " << profiler.histogram[bucket] * sampling;
+        cout << " (" << fixed << setprecision(2) << 100.0 * profiler.histogram[bucket] / profiler.sampled << "%)" << endl;
+    }
+    cout << "  cold: " << profiler.cold * sampling;
+    cout << " (" << fixed << setprecision(2) << (profiler.sampled != 0 ? 100.0 * profiler.cold / profiler.sampled : 0) << "%)" << endl;
+
+    // a fully associative LRU cache of c blocks hits the reuses at distances below c
+    cout << "LRU miss ratio:" << endl;
+    long hits = 0;
+    for (int bucket = 0; bucket < DISTANCE_BUCKETS - 1 && hits < reuses; bucket++)
+    {
+        hits += profiler.histogram[bucket];
+        long blocks = 1L << bucket;
+        cout << "  " << blocks << " blocks (" << blocks * profiler.blockSize << "B): ";
+        cout << (profiler.sampled != 0 ? (float)(profiler.sampled - hits) / profiler.sampled : 0) << endl;
+    }
+
+    vector<long> windows = profiler.workingSet;
+    if (profiler.instructions % profiler.window != 0)
+    {
+        windows.push_back(profiler.windowBlocks * sampling); // the last window is partial
+    }
+    long smallest = windows.empty() ? 0 : *min_element(windows.begin(), windows.end());
+    long largest = windows.empty() ? 0 : *max_element(windows.begin(), windows.end());
+    long total = 0;
+    for (long blocks : windows)
+    {
+        total += blocks;
+    }
+    cout << "Working set per " << profiler.window << " instructions in blocks:";
+    cout << " Windows=" << windows.size();
+    cout << " ,Min=" << smallest;
+    cout << " ,Average=" << (windows.empty() ? 0 : (float)total / windows.size());
+    cout << " ,Max=" << largest << endl;
+    for (int i = 0; i < windows.size() && (count == 0 || i < count); i++)
+    {
+        cout << "  Window " << i << ": " << windows[i] << " (" << windows[i] * profiler.blockSize << "B)" << endl;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+extern thread_local bool profilerEnabled;
+
+/*
+    Turns on the reuse profiler. It follows the data accesses of the program at block granularity,
+    independent of any cache, and measures the LRU stack distance of every reuse and the working
+    set of every window of instructions. Blocks are sampled by a hash of their address so the cost
+    stays low on long traces; the sampled distances and counts are scaled back up. The optional
+    file holds "setting value" lines:
+        block_size n   bytes per block, a power of two (default 64)
+        window n       instructions per working set window (default 100000)
+        sampling n     one block in n is followed, 1 follows every block exactly (default 64)
+    Returns false if the file cannot be read or holds an invalid setting
+*/
+bool enableReuseProfiler(string file);
+
+void disableReuseProfiler();
+
+/*
+    Clears the profile, called when a program is loaded
+*/
+void resetReuseProfiler();
+
+/*
+    Records a data access of size bytes at address
+*/
+void profileAccess(unsigned long address, unsigned long size);
+
+/*
+    Counts a retired instruction and closes the working set window when it is full
+*/
+void profileInstruction();
+
+/*
+    Prints the reuse distance histogram, the miss ratio of fully associative LRU caches of
+    power of two sizes and the working set of the first count windows (all of them when count is 0)
+*/
+void printReuseProfile(int count = 0);
\ No newline at end of file
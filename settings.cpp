@@ -0,0 +1,69 @@
+/**
+ * This file contains the reader of the "setting value" files shared by the timing models,
+ * the prefetcher, the reuse profiler, the DRAM model and the TLBs
+ */
+
+#include <fstream>
+#include <sstream>
+#include "settings.h"
+
+using namespace std;
+
+int settingNumber(string value)
+{
+    try
+    {
+        size_t pos = 0;
+        int num = stoi(value, &pos);
+        return pos == value.length() && num >= 0 ? num : -1;
+    }
+    catch (const exception &e)
+    {
+        return -1;
+    }
+}
+
+bool setNumber(unordered_map<string, int *> &settings, string setting, const vector<string> &values, int minimum)
+{
+    int num = values.size() == 1 ? settingNumber(values[0]) : -1;
+    if (settings.find(setting) == settings.end() || num < minimum || num < 0)
+    {
+        return false;
+    }
+    *settings[setting] = num;
+    return true;
+}
+
+bool readSettings(string file, string name, function<bool(string, const vector<string> &)> apply)
+{
+    ifstream input(file);
+    if (!input.is_open())
+    {
+        cout << (char)toupper(name[0]) << name.substr(1) << " file " << file << " not found" << endl;
+        return false;
+    }
+    string line;
+    int lineNum = 0;
+    while (getline(input, line))
+    {
+        lineNum++;
+        stringstream ss(line);
+        string setting, value;
+        if (!(ss >> setting) || setting[0] == ';')
+        {
+            continue;
+        }
+        vector<string> values;
+        while (ss >> value)
+        {
+            values.push_back(value);
+        }
+        if (!apply(setting, values))
+        {
+            cout << "Line " << lineNum << ": Invalid " << name << " setting" << endl;
+            return false;
+        }
+    }
+    input.close();
+    return true;
+}
\ No newline at end of file
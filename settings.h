@@ -0,0 +1,26 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+using namespace std;
+
+/*
+    Parses value as a non-negative decimal integer, returns -1 if it is not one
+*/
+int settingNumber(string value);
+
+/*
+    Stores the single number in values into the setting of settings. Returns false if the setting
+    is unknown or values is not one number of at least minimum
+*/
+bool setNumber(unordered_map<string, int *> &settings, string setting, const vector<string> &values, int minimum);
+
+/*
+    Reads a configuration file of one setting per line: a name and the words after it, which are
+    handed to apply. Blank lines and lines starting with ';' are skipped. name tells which model
+    the file configures in the messages. Returns false after printing that the file was not found,
+    or "Line N: Invalid <name> setting" for the first line apply rejects
+*/
+bool readSettings(string file, string name, function<bool(string, const vector<string> &)> apply);
\ No newline at end of file
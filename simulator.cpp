@@ -10,30 +10,66 @@
 #include <unordered_map>
 #include <bitset>
 #include <stack>
+#include <iomanip>
+#include <algorithm>
 #include <math.h>
+#include <cerrno>
 #include "simulator.h"
+#include "atomics.h"
+#include "compressed.h"
+#include "vector_unit.h"
+#include "float_unit.h"
+#include "syscalls.h"
+#include "pipeline.h"
+#include "ooo_core.h"
+#include "branch_predictor.h"
+#include "reuse_profiler.h"
+#include "dram.h"
+#include "mmu.h"
 
 using namespace std;
 
-long int registers[32]; // 32 registers
+// every simulator global is thread_local so that each host thread owns an independent simulator instance
+thread_local long int registers[32]; // 32 registers
 unsigned long memsize = 0x50000;
-unsigned char memory[0x50000];   // byte addressable memory
-vector<pair<int, string> > lines; // stores the pc and the line
-int mainPC = 0;
-stack<pair<string, int> > st;          // stores the function name and the previous pc value
-unordered_map<int, bool> breakpoints; // stores breakpoint status for each line
-unordered_map<std::string, std::string> opcode;
-unordered_map<int, int> labelIndex;
-unordered_map<int, string> inverseLabel;
-unordered_map<string, string> alias;
-unordered_map<int, int> comments; // stores the pc and number and index where the comment starts
-unordered_map<string, int> label; // stores all the labels and their corresponding pc values
-bool funcCall = false;            // stores whether a function call is made or not and is changed after use
-bool funcReturn = false;          // stores whether a function return is made or not and is changed after use
-int memLines = 0;                 // number of lines for .data section (includes one line for .text )
-string fileName = "";
-
-int timer = 0;
+thread_local unsigned char localMemory[0x50000]; // byte addressable memory owned by this thread
+thread_local unsigned char *memory = localMemory;  // memory seen by this thread, harts point it at one shared buffer
+thread_local vector<pair<int, string> > lines; // stores the pc and the line
+thread_local int mainPC = 0;
+thread_local stack<pair<string, int> > st;          // stores the function name and the previous pc value
+thread_local unordered_map<int, bool> breakpoints; // stores breakpoint status for each line
+thread_local unordered_map<std::string, std::string> opcode;
+thread_local unordered_map<int, int> labelIndex;
+thread_local unordered_map<int, string> inverseLabel;
+thread_local unordered_map<string, string> alias;
+thread_local unordered_map<int, int> comments; // stores the pc and number and index where the comment starts
+thread_local unordered_map<string, int> label; // stores all the labels and their corresponding pc values
+thread_local bool funcCall = false;            // stores whether a function call is made or not and is changed after use
+thread_local bool funcReturn = false;          // stores whether a function return is made or not and is changed after use
+thread_local int memLines = 0;                 // number of lines for .data section (includes one line for .text )
+thread_local string fileName = "";
+thread_local int hartId = 0;                   // id of the hart simulated by this thread
+thread_local bool compressedEnabled = false;   // lay the text section out with RV64C, set before loadProgram()
+thread_local vector<long> lineAddress;         // byte address of every line followed by the end of the text section
+thread_local unordered_map<long, int> addressLine; // byte address -> pc of the line fetched there
+thread_local cache *iCache = NULL;             // instruction cache fed by every fetch, NULL when off
+thread_local long fetchedInstructions = 0;
+thread_local long fetchedCompressed = 0;
+thread_local long fetchedBytes = 0;
+thread_local unsigned long dataEnd = 0x10000;  // first address after the .data section
+thread_local vector<timing_instruction> timingLines; // operands of every line, decoded on its first execution
+thread_local unsigned long accessAddress = 0;       // first byte and size of the last data memory access
+thread_local int accessSize = 0;
+
+// execute latency in cycles of the multi cycle instructions, shared by every thread and read by the timing models
+unordered_map<string, int> latency = {
+    {"mul", 3}, {"mulh", 3}, {"mulhsu", 3}, {"mulhu", 3}, {"mulw", 3},
+    {"div", 20}, {"divu", 20}, {"rem", 20}, {"remu", 20},
+    {"divw", 12}, {"divuw", 12}, {"remw", 12}, {"remuw", 12},
+    {"fadd.s", 4}, {"fsub.s", 4}, {"fmul.s", 4}, {"fadd.d", 4}, {"fsub.d", 4}, {"fmul.d", 4},
+    {"fmadd.s", 5}, {"fmsub.s", 5}, {"fnmsub.s", 5}, {"fnmadd.s", 5},
+    {"fmadd.d", 5}, {"fmsub.d", 5}, {"fnmsub.d", 5}, {"fnmadd.d", 5},
+    {"fdiv.s", 12}, {"fsqrt.s", 12}, {"fdiv.d", 20}, {"fsqrt.d", 20}};
 
 void setPc(int pc)
 {
@@ -242,6 +278,7 @@ pair<bool, int> loadFile(string inputFile)
         }
     }
     file.close();
+    dataEnd = baseAddress;
     return make_pair(true, dataLines); // return true if file is loaded successfully
 }
 
@@ -349,6 +386,10 @@ bool getLabels(string file)
 void initialiseMaps()
 {
     inverseLabel[0] = "main";
+    if (!opcode.empty()) // tables are already built for this thread, only the label needs resetting
+    {
+        return;
+    }
     opcode["add"] = "0110011";
     opcode["sub"] = "0110011";
     opcode["and"] = "0110011";
@@ -389,6 +430,105 @@ void initialiseMaps()
     opcode["slti"] = "0010011";
     opcode["sltiu"] = "0010011";
     opcode["lwu"] = "0000011";
+    opcode["addw"] = "0111011";
+    opcode["subw"] = "0111011";
+    opcode["sllw"] = "0111011";
+    opcode["srlw"] = "0111011";
+    opcode["sraw"] = "0111011";
+    opcode["addiw"] = "0011011";
+    opcode["slliw"] = "0011011";
+    opcode["srliw"] = "0011011";
+    opcode["sraiw"] = "0011011";
+    opcode["fence"] = "0001111";
+    opcode["mul"] = "0110011";
+    opcode["mulh"] = "0110011";
+    opcode["mulhsu"] = "0110011";
+    opcode["mulhu"] = "0110011";
+    opcode["div"] = "0110011";
+    opcode["divu"] = "0110011";
+    opcode["rem"] = "0110011";
+    opcode["remu"] = "0110011";
+    opcode["mulw"] = "0111011";
+    opcode["divw"] = "0111011";
+    opcode["divuw"] = "0111011";
+    opcode["remw"] = "0111011";
+    opcode["remuw"] = "0111011";
+    opcode["lr.w"] = "0101111";
+    opcode["sc.w"] = "0101111";
+    opcode["amoswap.w"] = "0101111";
+    opcode["amoadd.w"] = "0101111";
+    opcode["amoxor.w"] = "0101111";
+    opcode["amoand.w"] = "0101111";
+    opcode["amoor.w"] = "0101111";
+    opcode["amomin.w"] = "0101111";
+    opcode["amomax.w"] = "0101111";
+    opcode["amominu.w"] = "0101111";
+    opcode["amomaxu.w"] = "0101111";
+    opcode["lr.d"] = "0101111";
+    opcode["sc.d"] = "0101111";
+    opcode["amoswap.d"] = "0101111";
+    opcode["amoadd.d"] = "0101111";
+    opcode["amoxor.d"] = "0101111";
+    opcode["amoand.d"] = "0101111";
+    opcode["amoor.d"] = "0101111";
+    opcode["amomin.d"] = "0101111";
+    opcode["amomax.d"] = "0101111";
+    opcode["amominu.d"] = "0101111";
+    opcode["amomaxu.d"] = "0101111";
+    opcode["flw"] = "0000111";
+    opcode["fld"] = "0000111";
+    opcode["fsw"] = "0100111";
+    opcode["fsd"] = "0100111";
+    string floatOps[] = {"fadd", "fsub", "fmul", "fdiv", "fsqrt", "fsgnj", "fsgnjn", "fsgnjx", "fmin", "fmax", "feq", "flt", "fle", "fclass"};
+    string fusedOps[] = {"fmadd", "fmsub", "fnmsub", "fnmadd"};
+    string fusedOpcodes[] = {"1000011", "1000111", "1001011", "1001111"};
+    string conversions[] = {"fcvt.w", "fcvt.wu", "fcvt.l", "fcvt.lu"};
+    string intTypes[] = {"w", "wu", "l", "lu"};
+    string fmts[] = {"s", "d"};
+    for (string fmt : fmts)
+    {
+        for (string op : floatOps)
+        {
+            opcode[op + "." + fmt] = "1010011";
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            opcode[fusedOps[i] + "." + fmt] = fusedOpcodes[i];
+            opcode[conversions[i] + "." + fmt] = "1010011";
+            opcode["fcvt." + fmt + "." + intTypes[i]] = "1010011";
+        }
+    }
+    opcode["fcvt.s.d"] = "1010011";
+    opcode["fcvt.d.s"] = "1010011";
+    opcode["fmv.x.w"] = "1010011";
+    opcode["fmv.w.x"] = "1010011";
+    opcode["fmv.x.d"] = "1010011";
+    opcode["fmv.d.x"] = "1010011";
+    string csrOps[] = {"csrrw", "csrrs", "csrrc", "csrrwi", "csrrsi", "csrrci", "frcsr", "fscsr", "frrm", "fsrm", "fsrmi", "frflags", "fsflags", "fsflagsi"};
+    for (string op : csrOps)
+    {
+        opcode[op] = "1110011";
+    }
+    opcode["ecall"] = "1110011";
+    opcode["ebreak"] = "1110011";
+    opcode["sfence.vma"] = "1110011";
+    opcode["vsetvli"] = "1010111";
+    string widths[] = {"8", "16", "32", "64"};
+    for (string w : widths)
+    {
+        opcode["vle" + w + ".v"] = "0000111";
+        opcode["vlse" + w + ".v"] = "0000111";
+        opcode["vse" + w + ".v"] = "0100111";
+        opcode["vsse" + w + ".v"] = "0100111";
+    }
+    string vectorOps[] = {"vadd.vv", "vadd.vx", "vadd.vi", "vsub.vv", "vsub.vx", "vmul.vv", "vmul.vx",
+                          "vand.vv", "vand.vx", "vand.vi", "vor.vv", "vor.vx", "vor.vi", "vxor.vv", "vxor.vx", "vxor.vi",
+                          "vredsum.vs", "vredand.vs", "vredor.vs", "vredxor.vs", "vredmin.vs", "vredmax.vs", "vredminu.vs", "vredmaxu.vs",
+                          "vmv.v.v", "vmv.v.x", "vmv.v.i", "vmv.x.s", "vmv.s.x"};
+    for (string op : vectorOps)
+    {
+        opcode[op] = "1010111";
+    }
 
     alias["zero"] = "x0";
     alias["ra"] = "x1";
@@ -425,6 +565,43 @@ void initialiseMaps()
     alias["t6"] = "x31";
 }
 
+bool loadLatencies(string file)
+{
+    ifstream input(file);
+    if (!input.is_open())
+    {
+        cout << "Latency file " << file << " not found" << endl;
+        return false;
+    }
+    string line;
+    int lineNum = 0;
+    while (getline(input, line))
+    {
+        lineNum++;
+        if (line.length() == 0 || line[0] == ';')
+        {
+            continue;
+        }
+        stringstream ss(line);
+        string instr;
+        int cycles = 0;
+        if (!(ss >> instr >> cycles) || cycles < 1)
+        {
+            cout << "Line " << lineNum << ": Invalid latency" << endl;
+            return false;
+        }
+        latency[instr] = cycles;
+    }
+    input.close();
+    return true;
+}
+
+int getLatency(string instr)
+{
+    auto it = latency.find(instr);
+    return it == latency.end() ? 1 : it->second;
+}
+
 /*
     Performs ALU operations for the R and I type instructions
 */
@@ -450,22 +627,126 @@ long int ALU(long int v1, long int v2, string instr)
     {
         return v1 ^ v2;
     }
-    else if (instr == "sll" || instr == "slli")
+    else if (instr == "sll" || instr == "slli") // only the low 6 bits of the shift amount are used
     {
-        return v1 << v2;
+        return (unsigned long)v1 << (v2 & 63);
     }
     else if (instr == "srl" || instr == "srli")
     {
-        return (unsigned long)v1 >> v2;
+        return (unsigned long)v1 >> (v2 & 63);
     }
     else if (instr == "sra" || instr == "srai")
     {
-        return v1 >> v2;
+        return v1 >> (v2 & 63);
     }
-    else if (instr == "slt" || instr == "slti" || instr == "slt" || instr == "slti")
+    else if (instr == "slt" || instr == "slti")
     {
         return v1 < v2;
     }
+    else if (instr == "sltu" || instr == "sltiu") // the immediate is sign extended, then compared unsigned
+    {
+        return (unsigned long)v1 < (unsigned long)v2;
+    }
+    else if (instr == "addw" || instr == "addiw") // 32 bit operations, the result is sign extended
+    {
+        return (int)((unsigned int)v1 + (unsigned int)v2);
+    }
+    else if (instr == "subw")
+    {
+        return (int)((unsigned int)v1 - (unsigned int)v2);
+    }
+    else if (instr == "sllw" || instr == "slliw")
+    {
+        return (int)((unsigned int)v1 << (v2 & 31));
+    }
+    else if (instr == "srlw" || instr == "srliw")
+    {
+        return (int)((unsigned int)v1 >> (v2 & 31));
+    }
+    else if (instr == "sraw" || instr == "sraiw")
+    {
+        return (int)v1 >> (v2 & 31);
+    }
+    else if (instr == "mul")
+    {
+        return (unsigned long)v1 * (unsigned long)v2;
+    }
+    else if (instr == "mulh")
+    {
+        return (long)(((__int128)v1 * (__int128)v2) >> 64);
+    }
+    else if (instr == "mulhsu")
+    {
+        return (long)(((__int128)v1 * (unsigned __int128)(unsigned long)v2) >> 64);
+    }
+    else if (instr == "mulhu")
+    {
+        return (long)(((unsigned __int128)(unsigned long)v1 * (unsigned long)v2) >> 64);
+    }
+    else if (instr == "div")
+    {
+        if (v2 == 0)
+            return -1;
+        if (v1 == LONG_MIN && v2 == -1) // overflow
+            return v1;
+        return v1 / v2;
+    }
+    else if (instr == "divu")
+    {
+        if (v2 == 0)
+            return -1;
+        return (unsigned long)v1 / (unsigned long)v2;
+    }
+    else if (instr == "rem")
+    {
+        if (v2 == 0)
+            return v1;
+        if (v1 == LONG_MIN && v2 == -1)
+            return 0;
+        return v1 % v2;
+    }
+    else if (instr == "remu")
+    {
+        if (v2 == 0)
+            return v1;
+        return (unsigned long)v1 % (unsigned long)v2;
+    }
+    else if (instr == "mulw")
+    {
+        return (int)((unsigned int)v1 * (unsigned int)v2);
+    }
+    else if (instr == "divw")
+    {
+        int a = v1, b = v2;
+        if (b == 0)
+            return -1;
+        if (a == INT_MIN && b == -1)
+            return a;
+        return a / b;
+    }
+    else if (instr == "divuw")
+    {
+        unsigned int a = v1, b = v2;
+        if (b == 0)
+            return -1;
+        return (int)(a / b);
+    }
+    else if (instr == "remw")
+    {
+        int a = v1, b = v2;
+        if (b == 0)
+            return a;
+        if (a == INT_MIN && b == -1)
+            return 0;
+        return a % b;
+    }
+    else if (instr == "remuw")
+    {
+        unsigned int a = v1, b = v2;
+        if (b == 0)
+            return (int)a;
+        return (int)(a % b);
+    }
     else
     {
         return 0;
@@ -588,7 +869,7 @@ bool checkRegister(int reg, int line)
     It also checks if the register is in the range of 0 to 31
     and returns with an error if the register is not found.
 */
-int getRegister(string reg, unordered_map<string, string> alias, int line)
+int getRegister(string reg, unordered_map<string, string> &alias, int line)
 {
     if (reg[0] == 'x')
     {
@@ -733,7 +1014,7 @@ pair<vector<string>, bool> getArguments(int line, int count, string args, bool f
     The boolean value is true if there is an error in the immediate value.
     The integer value is the immediate value extracted from the string.
 */
-pair<int, bool> getImmediate(string str, int pc, unordered_map<string, int> label, bool flag)
+pair<int, bool> getImmediate(string str, int pc, unordered_map<string, int> &label, bool flag)
 {
     int imm, neg = 0;
     int line = pc / 4 + 1 + memLines;
@@ -801,200 +1082,1411 @@ string addZeroes(string hex, int num)
 }
 
 /*
-    Performs tasks, manipulate the memory and register for the given instruction line
+    Checks that size bytes at the physical address lie in memory and, for a store, above the
+    text section. Prints the fault otherwise
 */
-pair<int, bool> convert(string line, int pc, bool step, bool cacheEnabled, cache *newCache)
+bool checkPhysical(unsigned long address, unsigned long size, bool store)
 {
-    bool flag = false;
-    int lineNum = pc / 4 + 1 + memLines;
-    if (breakpoints.find(lineNum) != breakpoints.end() && breakpoints[lineNum] && !step)
+    int line = mainPC / 4 + 1;
+    if (address > memsize || size > memsize - address)
     {
-        cout << "Execution stopped at breakpoint" << endl;
-        return make_pair(-2, flag);
+        cout << "Line: " << line << " Memory address out of bounds" << endl;
+        return false;
     }
-    if (line[0] == ';')
-    { // starting with semicolon is treated as a comment
-        return make_pair(0, flag);
+    if (store && address < 0x10000)
+    {
+        cout << "Line: " << line << ": Segmentation Fault" << endl;
+        return false;
     }
-    if (comments.find(pc) != comments.end())
+    return true;
+}
+
+/*
+    Reads size bytes at the physical address, through the cache if it is enabled. While harts run
+    in parallel the read holds the memory lock, so it never sees a store half written
+*/
+bool loadPhysical(unsigned long address, int size, bool cacheEnabled, cache *newCache, unsigned long &value)
+{
+    if (!checkPhysical(address, size, false))
     {
-        line = line.substr(0, comments[pc]);
+        return false;
     }
-    string instr = "";
-    string args = "";
-    int prev = -1;
-    int i = 0;
+    accessAddress = address;
+    accessSize = size;
+    if (profilerEnabled)
+    {
+        profileAccess(address, size);
+    }
+    unique_lock<recursive_mutex> guard = lockMemory();
+    if (cacheEnabled)
+    {
+        return cacheRead(newCache, address, size, memory, value);
+    }
+    value = 0;
+    for (int i = 0; i < size; i++)
+    {
+        value = value | ((unsigned long)memory[address + i] << (i * 8));
+    }
+    return true;
+}
 
-    while (line[i] == ' ' && i < line.length())
+/*
+    Reads size bytes at address, translated when virtual memory is on
+*/
+bool loadValue(unsigned long address, int size, bool cacheEnabled, cache *newCache, unsigned long &value)
+{
+    if (translationEnabled && !translate(address, size, ACCESS_LOAD, cacheEnabled, newCache))
     {
-        prev++;
-        i++;
+        return false;
     }
+    return loadPhysical(address, size, cacheEnabled, newCache, value);
+}
 
-    for (i; i < line.length(); i++) // extracting instruction and arguments
+/*
+    Reads size bytes at address into data with one cache access per cache line touched
+*/
+bool loadBlock(unsigned long address, unsigned long size, bool cacheEnabled, cache *newCache, unsigned char *data)
+{
+    if (translationEnabled)
     {
-        if (line[i] == ':' || line[i] == ' ' || line[i] == ',')
-        {
-            prev++;
-        }
-        else if (i + 1 < line.length() && line[i + 1] == ':')
-        {
-            prev = i;
-        }
-        else if (i + 1 < line.length() && (line[i + 1] == ' ' || line[i + 1] == ','))
+        // one translation per page
+        unsigned long first = min(size, 4096 - address % 4096);
+        if (first < size)
         {
-            instr = line.substr(prev + 1, i - prev);
-            args = line.substr(i + 1);
-            break;
+            return loadBlock(address, first, cacheEnabled, newCache, data) && loadBlock(address + first, size - first, cacheEnabled, newCache, data + first);
         }
-        else if (i == line.length() - 1)
+        if (!translate(address, size, ACCESS_LOAD, cacheEnabled, newCache))
         {
-            instr = line.substr(prev + 1, i - prev + 1);
-            args = "";
-            break;
+            return false;
         }
     }
-    if (instr == "")
+    if (!checkPhysical(address, size, false))
     {
-        cout << "Line " << (pc / 4 + 1) << ": Invalid Instruction" << endl;
-        return make_pair(-1, flag);
+        return false;
     }
-    if (opcode.find(instr) == opcode.end())
+    accessAddress = address;
+    accessSize = size;
+    if (profilerEnabled)
     {
-        cout << "Line " << (pc / 4 + 1) << ": Instruction " << instr << " not found" << endl;
-        return make_pair(-1, flag);
+        profileAccess(address, size);
     }
-    if (opcode[instr] == "0110011") // R type instructions and,xor,or,add,sub,sll,srl,sra,slt,sltu
+    unique_lock<recursive_mutex> guard = lockMemory();
+    if (!cacheEnabled)
     {
-        vector<string> arguments;
-        bool err;
-        pair<vector<string>, bool> res = getArguments(pc / 4 + 1, 3, args, false);
-        err = res.second;
-        arguments = res.first;
-        if (err)
+        for (unsigned long i = 0; i < size; i++)
         {
-            return make_pair(-1, flag);
+            data[i] = memory[address + i];
         }
-        int rd, rs1, rs2;
-        rd = getRegister(arguments[0], alias, pc / 4 + 1);
-        rs1 = getRegister(arguments[1], alias, pc / 4 + 1);
-        rs2 = getRegister(arguments[2], alias, pc / 4 + 1);
-        if (rd == -1 || rs1 == -1 || rs2 == -1)
+        return true;
+    }
+    for (unsigned long done = 0; done < size;)
+    {
+        unsigned long curr = address + done;
+        int part = min(size - done, (unsigned long)(newCache->block_size - curr % newCache->block_size));
+        if (!cacheReadBlock(newCache, curr, part, memory, data + done))
         {
-            return make_pair(-1, flag);
+            return false;
         }
+        done += part;
+    }
+    return true;
+}
 
-        if (checkRegister(rd, pc / 4 + 1) || checkRegister(rs1, pc / 4 + 1) || checkRegister(rs2, pc / 4 + 1))
+/*
+    Writes size bytes of data at address with one cache access per cache line touched
+*/
+bool storeBlock(unsigned long address, unsigned long size, const unsigned char *data, bool cacheEnabled, cache *newCache)
+{
+    if (translationEnabled)
+    {
+        unsigned long first = min(size, 4096 - address % 4096);
+        if (first < size)
         {
-            return make_pair(-1, flag);
+            return storeBlock(address, first, data, cacheEnabled, newCache) && storeBlock(address + first, size - first, data + first, cacheEnabled, newCache);
         }
-        if (rd == 0)
+        if (!translate(address, size, ACCESS_STORE, cacheEnabled, newCache))
         {
-            return make_pair(0, flag);
+            return false;
         }
-        registers[rd] = ALU(registers[rs1], registers[rs2], instr);
     }
-    else if (opcode[instr] == "0010011") // I type instructions addi, andi, ori, xori, slti, sltiu, slli, srli, srai
+    if (!checkPhysical(address, size, true))
     {
-        vector<string> arguments;
-        int count = 0;
-        int index = 0;
-        int prev = -1;
-        int rd, rs1;
-        int imm;
-        arguments = getArguments(pc / 4 + 1, 3, args, false).first;
-        rd = getRegister(arguments[0], alias, pc / 4 + 1);
-        rs1 = getRegister(arguments[1], alias, pc / 4 + 1);
-        if (rd == -1 || rs1 == -1)
-            return make_pair(-1, flag);
-
-        if (checkRegister(rd, pc / 4 + 1) || checkRegister(rs1, pc / 4 + 1))
-        {
-            return make_pair(-1, flag);
-        }
-
-        pair<int, bool> res;
-        res = getImmediate(arguments[2], pc, label, false);
-
-        imm = res.first;
-        if (imm > 2047 || imm < -2048)
-        {
-            cout << "Line " << (pc / 4 + 1) << ": Value cannot be stored in 12 bits" << endl;
-            return make_pair(-1, flag);
-        }
-
-        if (instr == "slli" || instr == "srli" || instr == "srai")
+        return false;
+    }
+    accessAddress = address;
+    accessSize = size;
+    if (profilerEnabled)
+    {
+        profileAccess(address, size);
+    }
+    unique_lock<recursive_mutex> guard = lockMemory();
+    for (unsigned long done = 0; done < size;)
+    {
+        unsigned long curr = address + done;
+        int part = size - done;
+        if (cacheEnabled)
         {
-            if (imm > 63 || imm < 0)
+            part = min(size - done, (unsigned long)(newCache->block_size - curr % newCache->block_size));
+            if (!cacheWriteBlock(newCache, curr, part, data + done, memory))
             {
-                cout << "Line " << (pc / 4 + 1) << ": Cannot shift by " << imm << " bits" << endl;
-                return make_pair(-1, flag);
+                return false;
             }
         }
-        if (instr == "srai") // special case of srai where the 6 MSB bits are always having value 16
+        else
         {
-            pair<int, bool> res = hexToInt("0x10", pc / 4 + 1);
-            if (res.second)
+            for (int i = 0; i < part; i++)
             {
-                cout << "Line " << (pc / 4 + 1) << ": Invalid immediate" << endl;
-                return make_pair(-1, flag);
+                memory[curr + i] = data[done + i];
             }
-
-            int imm_6_11 = res.first;
-
-            int imm_0_5 = imm & 63;
-
-            imm = imm_0_5 | (imm_6_11 << 6);
         }
-        if (rd == 0)
+        done += part;
+    }
+    clearReservations(address, size, hartId);
+    return true;
+}
+
+/*
+    Writes the low size bytes of value at the physical address, through the cache if it is enabled,
+    and drops the LR reservations of the other harts on those bytes. While harts run in parallel
+    both happen under the memory lock, so the store cannot split an AMO or an SC
+*/
+bool storePhysical(unsigned long address, int size, unsigned long value, bool cacheEnabled, cache *newCache)
+{
+    if (!checkPhysical(address, size, true))
+    {
+        return false;
+    }
+    accessAddress = address;
+    accessSize = size;
+    if (profilerEnabled)
+    {
+        profileAccess(address, size);
+    }
+    unique_lock<recursive_mutex> guard = lockMemory();
+    if (cacheEnabled)
+    {
+        if (!cacheWrite(newCache, address, size, value, memory))
         {
-            return make_pair(0, flag);
+            return false;
         }
-        registers[rd] = ALU(registers[rs1], imm, instr);
     }
-    else if (opcode[instr] == "0000011" || opcode[instr] == "1100111") // Load type ld lh lw ....
+    else
     {
-        vector<string> arguments;
-        int count = 0;
-        int index = 0;
-        int prev = -1;
-        arguments = getArguments(pc / 4 + 1, 3, args, true).first;
-        int rd, rs1, imm;
-        rd = getRegister(arguments[0], alias, pc / 4 + 1);
-        rs1 = getRegister(arguments[2], alias, pc / 4 + 1);
-        if (rd == -1 || rs1 == -1)
-            return make_pair(-1, flag);
-
-        if (checkRegister(rd, pc / 4 + 1) || checkRegister(rs1, pc / 4 + 1))
+        for (unsigned long i = 0; i < size; ++i)
         {
-            return make_pair(-1, flag);
+            memory[i + address] = (value >> (i * 8)) & 0xff; // little endian format
         }
-        pair<int, bool> res = getImmediate(arguments[1], pc, label, false);
-        imm = res.first;
+    }
+    clearReservations(address, size, hartId);
+    return true;
+}
 
-        if (imm > 2047 || imm < -2048)
-        {
+/*
+    Writes the low size bytes of value at address, translated when virtual memory is on
+*/
+bool storeValue(unsigned long address, int size, unsigned long value, bool cacheEnabled, cache *newCache)
+{
+    if (translationEnabled && !translate(address, size, ACCESS_STORE, cacheEnabled, newCache))
+    {
+        return false;
+    }
+    return storePhysical(address, size, value, cacheEnabled, newCache);
+}
+
+/*
+    Executes the A extension instructions. AMOs and SC hold the atomics lock so they are atomic
+    with respect to the other harts, an SC only succeeds while the reservation is held and,
+    with the cache enabled, the reserved block is still in this hart's cache
+*/
+pair<int, bool> atomicOp(string instr, string args, int pc, bool cacheEnabled, cache *newCache)
+{
+    bool isLr = instr.substr(0, 3) == "lr.";
+    pair<vector<string>, bool> res = getArguments(pc / 4 + 1, isLr ? 2 : 3, args, true);
+    if (res.second)
+    {
+        return make_pair(-1, false);
+    }
+    vector<string> arguments = res.first;
+    int rd = getRegister(arguments[0], alias, pc / 4 + 1);
+    int rs2 = isLr ? 0 : getRegister(arguments[1], alias, pc / 4 + 1);
+    int rs1 = getRegister(arguments[isLr ? 1 : 2], alias, pc / 4 + 1);
+    if (rd == -1 || rs1 == -1 || rs2 == -1)
+    {
+        return make_pair(-1, false);
+    }
+    if (checkRegister(rd, pc / 4 + 1) || checkRegister(rs1, pc / 4 + 1) || checkRegister(rs2, pc / 4 + 1))
+    {
+        return make_pair(-1, false);
+    }
+    int size = (instr[instr.length() - 1] == 'd') ? 8 : 4;
+    unsigned long address = registers[rs1];
+    if (address % size != 0)
+    {
+        cout << "Line: " << (pc / 4 + 1) << " Misaligned atomic access" << endl;
+        return make_pair(-1, false);
+    }
+    // reservations and the accesses below use the physical address
+    if (translationEnabled && !translate(address, size, isLr ? ACCESS_LOAD : ACCESS_STORE, cacheEnabled, newCache))
+    {
+        return make_pair(-1, false);
+    }
+    if (address < 0x10000 || address + size > memsize)
+    {
+        cout << "Line: " << (pc / 4 + 1) << ": Segmentation Fault" << endl;
+        return make_pair(-1, false);
+    }
+
+    lock_guard<recursive_mutex> guard(atomics->lock);
+    string op = instr.substr(0, instr.find('.'));
+    unsigned long old = 0;
+    long result = 0;
+    if (op == "sc")
+    {
+        bool success = takeReservation(hartId, address);
+        if (success && cacheEnabled)
+        {
+            // the reservation is lost once the block has left the cache
+            success = cacheContains(newCache, address);
+        }
+        recordSc(address, success);
+        if (success)
+        {
+            if (!storePhysical(address, size, registers[rs2], cacheEnabled, newCache))
+            {
+                return make_pair(-1, false);
+            }
+        }
+        result = success ? 0 : 1;
+    }
+    else
+    {
+        if (!loadPhysical(address, size, cacheEnabled, newCache, old))
+        {
+            return make_pair(-1, false);
+        }
+        long sold = (size == 4) ? (long)(int)old : (long)old; // sign extended old value
+        long src = (size == 4) ? (long)(int)registers[rs2] : registers[rs2];
+        unsigned long uold = (size == 4) ? (unsigned int)old : old;
+        unsigned long usrc = (size == 4) ? (unsigned int)registers[rs2] : (unsigned long)registers[rs2];
+        result = sold;
+        if (op == "lr")
+        {
+            recordLr(address);
+            setReservation(hartId, address);
+        }
+        else
+        {
+            long value = 0;
+            if (op == "amoswap")
+                value = src;
+            else if (op == "amoadd")
+                value = sold + src;
+            else if (op == "amoxor")
+                value = sold ^ src;
+            else if (op == "amoand")
+                value = sold & src;
+            else if (op == "amoor")
+                value = sold | src;
+            else if (op == "amomin")
+                value = sold < src ? sold : src;
+            else if (op == "amomax")
+                value = sold > src ? sold : src;
+            else if (op == "amominu")
+                value = uold < usrc ? uold : usrc;
+            else if (op == "amomaxu")
+                value = uold > usrc ? uold : usrc;
+            recordAmo(address);
+            if (!storePhysical(address, size, value, cacheEnabled, newCache))
+            {
+                return make_pair(-1, false);
+            }
+        }
+    }
+    if (rd != 0)
+    {
+        registers[rd] = result;
+    }
+    return make_pair(0, false);
+}
+
+/*
+    Reads the NUL terminated string at address, at most 4096 bytes
+*/
+bool loadString(unsigned long address, bool cacheEnabled, cache *newCache, string &str)
+{
+    str = "";
+    for (unsigned long i = 0; i < 4096; i++)
+    {
+        unsigned long c;
+        if (!loadValue(address + i, 1, cacheEnabled, newCache, c))
+        {
+            return false;
+        }
+        if (c == 0)
+        {
+            return true;
+        }
+        str += (char)c;
+    }
+    return false;
+}
+
+/*
+    Executes ecall like a proxy kernel: a7 holds the Linux system call number, a0-a3 the arguments
+    and the result or -errno is returned in a0. Guest buffers are moved through the data cache
+*/
+pair<int, bool> ecallOp(int pc, bool cacheEnabled, cache *newCache)
+{
+    int line = pc / 4 + 1;
+    long number = registers[17];
+    long a0 = registers[10], a1 = registers[11], a2 = registers[12], a3 = registers[13];
+    long result = 0;
+    if (number == 63 || number == 64) // read, write
+    {
+        unsigned long address = a1;
+        // translated buffers are checked page by page as they are accessed
+        if (a2 < 0 || (!translationEnabled && (address > memsize || a2 > memsize - address)))
+        {
+            result = -EFAULT;
+        }
+        else
+        {
+            vector<unsigned char> buffer(a2);
+            if (number == 64)
+            {
+                if (!loadBlock(address, a2, cacheEnabled, newCache, buffer.data()))
+                {
+                    return make_pair(-1, false);
+                }
+                result = guestWrite(a0, buffer.data(), a2);
+            }
+            else
+            {
+                result = guestRead(a0, buffer.data(), a2);
+                if (result > 0 && !storeBlock(address, result, buffer.data(), cacheEnabled, newCache))
+                {
+                    return make_pair(-1, false);
+                }
+            }
+        }
+    }
+    else if (number == 56) // openat, paths are relative to the sandbox so only AT_FDCWD is accepted
+    {
+        string path;
+        if (a0 != -100)
+        {
+            result = -EBADF;
+        }
+        else if (!loadString(a1, cacheEnabled, newCache, path))
+        {
+            result = -EFAULT;
+        }
+        else
+        {
+            result = guestOpen(path, a2, a3);
+        }
+    }
+    else if (number == 57) // close
+    {
+        result = guestClose(a0);
+    }
+    else if (number == 93 || number == 94) // exit, exit_group: moves the PC past the last line
+    {
+        exited = true;
+        exitCode = a0;
+        flushGuestFiles();
+        return make_pair(lines.size() * 4, true);
+    }
+    else if (number == 214) // brk
+    {
+        result = setBreak(a0, memsize);
+    }
+    else if (number == 113) // clock_gettime, every clock reads the simulated one
+    {
+        long seconds, nanoseconds;
+        simulatedTime(oooEnabled ? oooCycles() : pipelineEnabled ? pipelineCycles() : fetchedInstructions, seconds, nanoseconds);
+        if (!translationEnabled && (unsigned long)a1 + 16 > memsize)
+        {
+            result = -EFAULT;
+        }
+        else if (!storeValue(a1, 8, seconds, cacheEnabled, newCache) || !storeValue(a1 + 8, 8, nanoseconds, cacheEnabled, newCache))
+        {
+            return make_pair(-1, false);
+        }
+    }
+    else
+    {
+        cout << "Line " << line << ": Unsupported system call " << number << endl;
+        result = -ENOSYS;
+    }
+    registers[10] = result;
+    return make_pair(0, false);
+}
+
+/*
+    Executes the CSR instructions on fflags, frm, fcsr and satp, the only CSRs simulated
+*/
+pair<int, bool> csrOp(vector<string> tokens, int pc)
+{
+    int line = pc / 4 + 1;
+    string instr = tokens[0];
+    if (tokens.size() != 4)
+    {
+        cout << "Line " << line << ": Wrong number of arguments" << endl;
+        return make_pair(-1, false);
+    }
+    int rd = getRegister(tokens[1], alias, line);
+    bool satp = tokens[2] == "satp" || tokens[2] == "0x180";
+    int csr = satp ? 0 : getFloatCsr(tokens[2]);
+    if (csr == -1)
+    {
+        cout << "Line " << line << ": CSR " << tokens[2] << " not supported" << endl;
+        return make_pair(-1, false);
+    }
+    bool immediate = instr[instr.length() - 1] == 'i';
+    unsigned long source;
+    bool writes = true;
+    if (immediate)
+    {
+        pair<int, bool> imm = getImmediate(tokens[3], pc, label, false);
+        if (imm.second || imm.first < 0 || imm.first > 31)
+        {
+            cout << "Line " << line << ": Immediate value cannot be stored in 5 bits" << endl;
+            return make_pair(-1, false);
+        }
+        source = imm.first;
+        writes = instr == "csrrwi" || imm.first != 0;
+    }
+    else
+    {
+        int rs1 = getRegister(tokens[3], alias, line);
+        if (rs1 == -1)
+        {
+            return make_pair(-1, false);
+        }
+        source = registers[rs1];
+        writes = instr == "csrrw" || rs1 != 0; // csrrs and csrrc with x0 only read
+    }
+    if (rd == -1)
+    {
+        return make_pair(-1, false);
+    }
+    unsigned long old = satp ? readSatp() : (csr == 1) ? fflags : (csr == 2) ? frm : ((frm << 5) | fflags);
+    unsigned long value = (instr[4] == 'w') ? source : (instr[4] == 's') ? (old | source) : (old & ~source);
+    if (writes && satp)
+    {
+        writeSatp(value);
+    }
+    else if (writes)
+    {
+        if (csr != 2)
+        {
+            fflags = value & 31;
+        }
+        if (csr != 1)
+        {
+            frm = (csr == 2 ? value : value >> 5) & 7;
+        }
+    }
+    if (rd != 0)
+    {
+        registers[rd] = old;
+    }
+    return make_pair(0, false);
+}
+
+/*
+    Executes the F and D extensions: loads and stores, arithmetic, fused multiply add,
+    sign injection, min/max, compares, fclass, moves and conversions
+*/
+pair<int, bool> floatOp(string instr, string args, int pc, bool cacheEnabled, cache *newCache)
+{
+    int line = pc / 4 + 1;
+    vector<string> tokens = expandFloatCsr(splitInstruction(instr + " " + args));
+    instr = tokens[0];
+    if (instr.substr(0, 4) == "csrr")
+    {
+        return csrOp(tokens, pc);
+    }
+    if (instr == "flw" || instr == "fld" || instr == "fsw" || instr == "fsd")
+    {
+        if (tokens.size() != 4)
+        {
+            cout << "Line " << line << ": Wrong number of arguments" << endl;
+            return make_pair(-1, false);
+        }
+        int freg = getFloatRegister(tokens[1], line);
+        int rs1 = getRegister(tokens[3], alias, line);
+        if (freg == -1 || rs1 == -1)
+        {
+            return make_pair(-1, false);
+        }
+        pair<int, bool> imm = getImmediate(tokens[2], pc, label, false);
+        if (imm.second || imm.first > 2047 || imm.first < -2048)
+        {
+            cout << "Line: " << line << " Value cannot be stored in 12 bits" << endl;
+            return make_pair(-1, false);
+        }
+        unsigned long address = registers[rs1] + imm.first;
+        int size = (instr[2] == 'w') ? 4 : 8;
+        if (instr[1] == 'l')
+        {
+            unsigned long value;
+            if (!loadValue(address, size, cacheEnabled, newCache, value))
+            {
+                return make_pair(-1, false);
+            }
+            fregs[freg] = (size == 4) ? (0xffffffff00000000UL | value) : value;
+            return make_pair(0, false);
+        }
+        return make_pair(storeValue(address, size, fregs[freg], cacheEnabled, newCache) ? 0 : -1, false);
+    }
+
+    int rm = 7;
+    if (tokens.size() > 1 && getRoundingMode(tokens.back()) != -1)
+    {
+        rm = getRoundingMode(tokens.back());
+        tokens.pop_back();
+    }
+    if ((rm == 7 ? frm : rm) > 4)
+    {
+        cout << "Line " << line << ": Invalid rounding mode" << endl;
+        return make_pair(-1, false);
+    }
+    string op = instr.substr(0, instr.find('.'));
+    string types = instr.substr(instr.find('.') + 1); // s, d, or destination.source for moves and conversions
+    string dst = types.substr(0, types.find('.'));
+    string src = types.substr(types.find('.') + 1);
+    bool isDouble = src == "d";
+    bool fused = op == "fmadd" || op == "fmsub" || op == "fnmsub" || op == "fnmadd";
+    int count = (op == "fsqrt" || op == "fclass" || op == "fmv" || op == "fcvt") ? 2 : fused ? 4 : 3;
+    if (tokens.size() != count + 1)
+    {
+        cout << "Line " << line << ": Wrong number of arguments" << endl;
+        return make_pair(-1, false);
+    }
+    // operands are floating point registers except the integer side of compares, fclass, moves and conversions
+    bool intDst = op == "feq" || op == "flt" || op == "fle" || op == "fclass" || (op == "fmv" && dst == "x") || (op == "fcvt" && dst != "s" && dst != "d");
+    bool intSrc = (op == "fmv" && src == "x") || (op == "fcvt" && src != "s" && src != "d");
+    int regs[4];
+    for (int i = 0; i < count; i++)
+    {
+        bool isInt = (i == 0 && intDst) || (i == 1 && intSrc);
+        regs[i] = isInt ? getRegister(tokens[i + 1], alias, line) : getFloatRegister(tokens[i + 1], line);
+        if (regs[i] == -1)
+        {
+            return make_pair(-1, false);
+        }
+    }
+    int rd = regs[0];
+
+    if (op == "fadd" || op == "fsub" || op == "fmul" || op == "fdiv" || op == "fsqrt" || fused)
+    {
+        char kernel = fused ? 'f' : (op == "fadd") ? '+' : (op == "fsub") ? '-' : (op == "fmul") ? '*' : (op == "fdiv") ? '/' : 's';
+        // the negated forms of the fused multiply add only flip signs, which is exact
+        bool negateProduct = op == "fnmsub" || op == "fnmadd";
+        bool negateAddend = op == "fmsub" || op == "fnmadd";
+        if (isDouble)
+        {
+            double a = getDouble(regs[1]), b = count > 2 ? getDouble(regs[2]) : 0, c = fused ? getDouble(regs[3]) : 0;
+            setDouble(rd, computeDouble(kernel, negateProduct ? -a : a, b, negateAddend ? -c : c, rm));
+        }
+        else
+        {
+            float a = getSingle(regs[1]), b = count > 2 ? getSingle(regs[2]) : 0, c = fused ? getSingle(regs[3]) : 0;
+            setSingle(rd, computeSingle(kernel, negateProduct ? -a : a, b, negateAddend ? -c : c, rm));
+        }
+    }
+    else if (op == "fsgnj" || op == "fsgnjn" || op == "fsgnjx")
+    {
+        unsigned long signBit = isDouble ? (1UL << 63) : (1UL << 31);
+        unsigned long a = rawBits(regs[1], isDouble), b = rawBits(regs[2], isDouble);
+        unsigned long sign = (op == "fsgnj") ? (b & signBit) : (op == "fsgnjn") ? (~b & signBit) : ((a ^ b) & signBit);
+        unsigned long result = (a & ~signBit) | sign;
+        fregs[rd] = isDouble ? result : (0xffffffff00000000UL | result);
+    }
+    else if (op == "fmin" || op == "fmax" || op == "feq" || op == "flt" || op == "fle")
+    {
+        double a = isDouble ? getDouble(regs[1]) : getSingle(regs[1]);
+        double b = isDouble ? getDouble(regs[2]) : getSingle(regs[2]);
+        if (op != "flt" && op != "fle" && (isSignalingNan(rawBits(regs[1], isDouble), isDouble) || isSignalingNan(rawBits(regs[2], isDouble), isDouble)))
+        {
+            raiseFlags(16);
+        }
+        if (op == "fmin" || op == "fmax")
+        {
+            double r = floatMinMax(a, b, op == "fmax");
+            isDouble ? setDouble(rd, r) : setSingle(rd, (float)r);
+        }
+        else if (rd != 0)
+        {
+            registers[rd] = floatCompare(op, a, b);
+        }
+    }
+    else if (op == "fclass")
+    {
+        if (rd != 0)
+        {
+            registers[rd] = floatClass(rawBits(regs[1], isDouble), isDouble);
+        }
+    }
+    else if (op == "fmv")
+    {
+        // moves copy bits, fmv.x.w ignores the NaN-boxing and sign extends the low word
+        if (intDst && rd != 0)
+        {
+            registers[rd] = (src == "d") ? (long)fregs[regs[1]] : (long)(int)fregs[regs[1]];
+        }
+        else if (!intDst)
+        {
+            fregs[rd] = (dst == "d") ? (unsigned long)registers[regs[1]] : (0xffffffff00000000UL | (unsigned int)registers[regs[1]]);
+        }
+    }
+    else if (intDst) // fcvt.w.s, fcvt.lu.d, ...
+    {
+        double value = isDouble ? getDouble(regs[1]) : getSingle(regs[1]);
+        long result = floatToInt(value, dst[0] == 'w' ? 32 : 64, dst.back() == 'u', rm);
+        if (rd != 0)
+        {
+            registers[rd] = result;
+        }
+    }
+    else if (intSrc) // fcvt.s.w, fcvt.d.lu, ...
+    {
+        long value = registers[regs[1]];
+        if (src == "w")
+            value = (int)value;
+        else if (src == "wu")
+            value = (unsigned int)value;
+        bool isUnsigned = src.back() == 'u';
+        if (dst == "d")
+            setDouble(rd, intToDouble(value, isUnsigned, rm));
+        else
+            setSingle(rd, intToSingle(value, isUnsigned, rm));
+    }
+    else if (dst == "s") // fcvt.s.d
+    {
+        setSingle(rd, narrowDouble(getDouble(regs[1]), rm));
+    }
+    else // fcvt.d.s is exact, only NaNs need care
+    {
+        if (isSignalingNan(rawBits(regs[1], false), false))
+        {
+            raiseFlags(16);
+        }
+        float value = getSingle(regs[1]);
+        setDouble(rd, isnan(value) ? NAN : (double)value);
+    }
+    return make_pair(0, false);
+}
+
+/*
+    Number of vector registers covered by bytes of a register group, at least one
+*/
+int groupRegisters(unsigned long bytes)
+{
+    unsigned long vlenb = vlen / 8;
+    return bytes <= vlenb ? 1 : (bytes + vlenb - 1) / vlenb;
+}
+
+/*
+    Executes the RVV subset: vsetvli, unit-stride and strided loads and stores, integer add, sub,
+    mul, and, or, xor, the reductions and the moves. Only unmasked forms are supported
+*/
+pair<int, bool> vectorOp(string instr, string args, int pc, bool cacheEnabled, cache *newCache)
+{
+    int line = pc / 4 + 1;
+    vector<string> tokens = splitInstruction(instr + " " + args);
+    if (instr == "vsetvli")
+    {
+        if (tokens.size() < 4)
+        {
+            cout << "Line " << line << ": Less arguments than required" << endl;
+            return make_pair(-1, false);
+        }
+        int rd = getRegister(tokens[1], alias, line);
+        int rs1 = getRegister(tokens[2], alias, line);
+        if (rd == -1 || rs1 == -1)
+        {
+            return make_pair(-1, false);
+        }
+        int vtypei = vtypeImmediate(vector<string>(tokens.begin() + 3, tokens.end()));
+        if (vtypei == -1)
+        {
+            cout << "Line " << line << ": Invalid vector type" << endl;
+            return make_pair(-1, false);
+        }
+        // rs1 = x0 asks for VLMAX, or keeps vl when rd is x0 too
+        unsigned long avl = (rs1 != 0) ? registers[rs1] : (rd != 0) ? ULONG_MAX : vl;
+        unsigned long newVl = configureVector(avl, vtypei);
+        if (rd != 0)
+        {
+            registers[rd] = newVl;
+        }
+        return make_pair(0, false);
+    }
+
+    bool isLoad = opcode[instr] == "0000111";
+    bool isStore = opcode[instr] == "0100111";
+    if (isLoad || isStore)
+    {
+        bool strided = instr[2] == 's' || instr[3] == 's'; // vlse, vsse
+        if (tokens.size() != (strided ? 4 : 3))
+        {
+            cout << "Line " << line << ": Wrong number of arguments" << endl;
+            return make_pair(-1, false);
+        }
+        int vd = getVectorRegister(tokens[1], line);
+        int rs1 = getRegister(tokens[2], alias, line);
+        int rs2 = strided ? getRegister(tokens[3], alias, line) : 0;
+        if (vd == -1 || rs1 == -1 || rs2 == -1)
+        {
+            return make_pair(-1, false);
+        }
+        int eew = stoi(instr.substr(strided ? 4 : 3));
+        int bytes = eew / 8;
+        if (vd + groupRegisters(vl * bytes) > 32)
+        {
+            cout << "Line " << line << ": Vector register group out of range" << endl;
+            return make_pair(-1, false);
+        }
+        unsigned char *reg = vectorRegister(vd);
+        unsigned long address = registers[rs1];
+        long stride = strided ? registers[rs2] : bytes;
+        if (!strided)
+        {
+            bool ok = isLoad ? loadBlock(address, vl * bytes, cacheEnabled, newCache, reg)
+                             : storeBlock(address, vl * bytes, reg, cacheEnabled, newCache);
+            return make_pair(ok ? 0 : -1, false);
+        }
+        for (unsigned long e = 0; e < vl; e++)
+        {
+            unsigned long value = readElement(reg, e, eew);
+            bool ok = isLoad ? loadValue(address + e * stride, bytes, cacheEnabled, newCache, value)
+                             : storeValue(address + e * stride, bytes, value, cacheEnabled, newCache);
+            if (!ok)
+            {
+                return make_pair(-1, false);
+            }
+            if (isLoad)
+            {
+                writeElement(reg, e, eew, value);
+            }
+        }
+        return make_pair(0, false);
+    }
+
+    string op = instr.substr(0, instr.find('.'));
+    string form = instr.substr(instr.find('.') + 1);
+    unsigned long bytes = vl * (vsew / 8);
+    if (instr == "vmv.x.s")
+    {
+        int rd = tokens.size() == 3 ? getRegister(tokens[1], alias, line) : -1;
+        int vs2 = tokens.size() == 3 ? getVectorRegister(tokens[2], line) : -1;
+        if (rd == -1 || vs2 == -1)
+        {
+            return make_pair(-1, false);
+        }
+        if (rd != 0)
+        {
+            registers[rd] = signExtend(readElement(vectorRegister(vs2), 0, vsew), vsew);
+        }
+        return make_pair(0, false);
+    }
+    if (instr == "vmv.s.x")
+    {
+        int vd = tokens.size() == 3 ? getVectorRegister(tokens[1], line) : -1;
+        int rs1 = tokens.size() == 3 ? getRegister(tokens[2], alias, line) : -1;
+        if (vd == -1 || rs1 == -1)
+        {
+            return make_pair(-1, false);
+        }
+        if (vl > 0)
+        {
+            writeElement(vectorRegister(vd), 0, vsew, registers[rs1]);
+        }
+        return make_pair(0, false);
+    }
+
+    // vmv.v.* has no vs2, the other instructions are vd, vs2, vs1/rs1/imm
+    bool isMove = op == "vmv";
+    if (tokens.size() != (isMove ? 3 : 4))
+    {
+        cout << "Line " << line << ": Wrong number of arguments" << endl;
+        return make_pair(-1, false);
+    }
+    int vd = getVectorRegister(tokens[1], line);
+    int vs2 = isMove ? 0 : getVectorRegister(tokens[2], line);
+    if (vd == -1 || vs2 == -1)
+    {
+        return make_pair(-1, false);
+    }
+    string source = tokens[tokens.size() - 1];
+    int regs = groupRegisters(bytes);
+    bool reduction = op.substr(0, 4) == "vred"; // writes element 0 of vd only
+    if ((!reduction && vd + regs > 32) || vs2 + regs > 32)
+    {
+        cout << "Line " << line << ": Vector register group out of range" << endl;
+        return make_pair(-1, false);
+    }
+    if (reduction)
+    {
+        int vs1 = getVectorRegister(source, line);
+        if (vs1 == -1)
+        {
+            return make_pair(-1, false);
+        }
+        if (vl > 0)
+        {
+            unsigned long init = readElement(vectorRegister(vs1), 0, vsew);
+            writeElement(vectorRegister(vd), 0, vsew, vectorReduce(op.substr(4), vectorRegister(vs2), vsew, vl, init));
+        }
+        return make_pair(0, false);
+    }
+
+    const unsigned char *operand;
+    thread_local unsigned char scalar[8 * MAX_VLEN / 8]; // .vx and .vi operands splatted across the group
+    char kernel = (op == "vadd") ? '+' : (op == "vsub") ? '-' : (op == "vmul") ? '*' : (op == "vand") ? '&' : (op == "vor") ? '|' : (op == "vxor") ? '^' : '=';
+    if (form == "vv" || form == "v.v")
+    {
+        int vs1 = getVectorRegister(source, line);
+        if (vs1 == -1 || vs1 + regs > 32)
+        {
+            return make_pair(-1, false);
+        }
+        operand = vectorRegister(vs1);
+    }
+    else
+    {
+        long value;
+        if (form == "vx" || form == "v.x")
+        {
+            int rs1 = getRegister(source, alias, line);
+            if (rs1 == -1)
+            {
+                return make_pair(-1, false);
+            }
+            value = registers[rs1];
+        }
+        else
+        {
+            pair<int, bool> imm = getImmediate(source, pc, label, false);
+            if (imm.second || imm.first < -16 || imm.first > 15)
+            {
+                cout << "Line " << line << ": Immediate value cannot be stored in 5 bits" << endl;
+                return make_pair(-1, false);
+            }
+            value = imm.first;
+        }
+        for (unsigned long e = 0; e < vl; e++)
+        {
+            writeElement(scalar, e, vsew, value);
+        }
+        operand = scalar;
+    }
+    vectorKernel(kernel, vectorRegister(vd), vectorRegister(vs2), operand, vsew, vl);
+    return make_pair(0, false);
+}
+
+/*
+    Byte address of the line at pc. Without RV64C every line takes 4 bytes and this is pc itself
+*/
+long instrAddress(int pc)
+{
+    if (!compressedEnabled || pc < 0 || pc / 4 >= lineAddress.size())
+    {
+        return pc;
+    }
+    return lineAddress[pc / 4];
+}
+
+/*
+    Byte address of the instruction following the line at pc, the return address of a jump from it
+*/
+long nextAddress(int pc)
+{
+    if (!compressedEnabled || pc < 0 || pc / 4 + 1 >= lineAddress.size())
+    {
+        return pc + 4;
+    }
+    return lineAddress[pc / 4 + 1];
+}
+
+/*
+    pc of the line fetched at the byte address, -1 if no instruction starts there
+*/
+int linePc(long address)
+{
+    if (!compressedEnabled)
+    {
+        return address;
+    }
+    if (addressLine.find(address) == addressLine.end())
+    {
+        return -1;
+    }
+    return addressLine[address];
+}
+
+/*
+    Counts the fetch of the line at pc, translates it when virtual memory is on and sends it
+    through the instruction cache, an instruction crossing a block boundary needs two accesses.
+    Page table reads go through the data cache. Returns false on a page fault
+*/
+bool fetchInstruction(int pc, bool cacheEnabled, cache *newCache)
+{
+    long address = instrAddress(pc);
+    int size = nextAddress(pc) - address;
+    fetchedInstructions++;
+    fetchedBytes += size;
+    if (size == 2)
+    {
+        fetchedCompressed++;
+    }
+    int first = min(size, (int)(4096 - address % 4096));
+    if (iCache != NULL)
+    {
+        first = min(first, (int)(iCache->block_size - address % iCache->block_size));
+    }
+    unsigned long low = address, high = address + first;
+    if (translationEnabled)
+    {
+        bool samePage = (address + first) / 4096 == address / 4096;
+        if (!translate(low, first, ACCESS_FETCH, cacheEnabled, newCache))
+        {
+            return false;
+        }
+        high = low + first;
+        if (first < size && !samePage && !translate(high, size - first, ACCESS_FETCH, cacheEnabled, newCache))
+        {
+            return false;
+        }
+    }
+    if (iCache != NULL)
+    {
+        unsigned long value;
+        cacheRead(iCache, low, first, memory, value);
+        if (first < size)
+        {
+            cacheRead(iCache, high, size - first, memory, value);
+        }
+    }
+    return true;
+}
+
+/*
+    Number of an x, f or v register in the numbering of the timing models, -1 if token is not a register
+*/
+int timingRegister(string token)
+{
+    if (alias.find(token) != alias.end())
+    {
+        token = alias[token];
+    }
+    if (token.length() >= 2 && token.length() <= 3 && token[0] == 'x' && safeStoi(token.substr(1), 10) && stoi(token.substr(1)) < 32)
+    {
+        return stoi(token.substr(1));
+    }
+    int num = floatRegisterNumber(token);
+    if (num != -1)
+    {
+        return num + 32;
+    }
+    num = vectorRegisterNumber(token);
+    return num == -1 ? -1 : num + 64;
+}
+
+/*
+    Decodes the registers read and written by the line at pc for the timing models
+*/
+timing_instruction decodeTiming(int pc)
+{
+    timing_instruction inst;
+    inst.pc = pc;
+    vector<string> tokens = splitInstruction(lines[pc / 4].second);
+    if (tokens.size() > 0 && tokens[0].substr(0, 2) == "c.")
+    {
+        tokens = expandCompressed(tokens);
+    }
+    if (tokens.size() == 0)
+    {
+        inst.instr = ";";
+        return inst;
+    }
+    string instr = tokens[0];
+    if (instr.length() > 5 && instr.substr(instr.length() - 5) == ".aqrl")
+    {
+        instr = instr.substr(0, instr.length() - 5);
+    }
+    else if (instr.length() > 3 && (instr.substr(instr.length() - 3) == ".aq" || instr.substr(instr.length() - 3) == ".rl"))
+    {
+        instr = instr.substr(0, instr.length() - 3);
+    }
+    string op = opcode[instr];
+    inst.instr = instr;
+    inst.isLoad = op == "0000011" || op == "0000111" || instr.substr(0, 3) == "lr.";
+    inst.isStore = op == "0100011" || op == "0100111" || instr.substr(0, 3) == "sc.";
+    inst.isBranch = op == "1100011" || op == "1101111" || op == "1100111";
+    inst.latency = getLatency(instr);
+    // stores and conditional branches only read their register operands
+    bool writes = op != "0100011" && op != "0100111" && op != "1100011" && instr != "ecall" && instr != "ebreak" && instr != "sfence.vma";
+    for (int i = 1; i < tokens.size(); i++)
+    {
+        int reg = timingRegister(tokens[i]);
+        if (reg <= 0)
+        {
+            continue;
+        }
+        if (i == 1 && writes)
+            inst.dest = reg;
+        else
+            inst.sources.push_back(reg);
+    }
+    bool link = inst.dest == 1 || inst.dest == 5;
+    if (op == "1100011")
+        inst.branchKind = BRANCH_CONDITIONAL;
+    else if (op == "1101111")
+        inst.branchKind = link ? BRANCH_CALL : BRANCH_JUMP;
+    else if (op == "1100111" && link)
+        inst.branchKind = BRANCH_CALL;
+    else if (op == "1100111")
+        inst.branchKind = inst.sources.size() > 0 && (inst.sources[0] == 1 || inst.sources[0] == 5) ? BRANCH_RETURN : BRANCH_INDIRECT;
+    return inst;
+}
+
+/*
+    Hands the instruction at pc to the timing models after it executed, blockSize is the block
+    size of the D-cache or 0 without one
+*/
+void retireTiming(int pc, bool taken, int target, int dataMisses, int fetchMisses, int blockSize)
+{
+    if (timingLines.size() != lines.size())
+    {
+        timingLines.assign(lines.size(), timing_instruction());
+    }
+    timing_instruction &inst = timingLines[pc / 4];
+    if (inst.instr == "")
+    {
+        inst = decodeTiming(pc);
+    }
+    inst.taken = taken;
+    inst.target = target;
+    inst.mispredicted = inst.isBranch && taken;
+    inst.dataMisses = dataMisses;
+    inst.fetchMisses = fetchMisses;
+    inst.address = accessAddress;
+    inst.size = accessSize;
+    inst.block = blockSize != 0 ? accessAddress / blockSize : accessAddress;
+    if (predictorsEnabled)
+    {
+        branchRetire(inst);
+    }
+    if (pipelineEnabled)
+    {
+        pipelineRetire(inst);
+    }
+    if (oooEnabled)
+    {
+        oooRetire(inst);
+    }
+}
+
+/*
+    Lays out the byte addresses of the text section with compressed instructions
+*/
+void layoutProgram()
+{
+    vector<vector<string> > tokens;
+    for (int i = 0; i < lines.size(); i++)
+    {
+        tokens.push_back(splitInstruction(lines[i].second));
+    }
+    unordered_map<string, int> labelLine;
+    for (auto it = label.begin(); it != label.end(); it++)
+    {
+        labelLine[it->first] = it->second / 4;
+    }
+    vector<string> encodings;
+    lineAddress = layoutText(tokens, labelLine, alias, encodings);
+    addressLine.clear();
+    for (int i = 0; i < lineAddress.size(); i++)
+    {
+        if (addressLine.find(lineAddress[i]) == addressLine.end()) // empty lines share the address of the next instruction
+        {
+            addressLine[lineAddress[i]] = i * 4;
+        }
+    }
+}
+
+void setCompressed(bool enable)
+{
+    compressedEnabled = enable;
+}
+
+void setInstructionCache(cache *newCache)
+{
+    iCache = newCache;
+}
+
+void printFetchStats()
+{
+    long textBytes = 0;
+    int instructions = 0;
+    for (int i = 0; i < lines.size(); i++)
+    {
+        if (lines[i].second[0] != '\0')
+        {
+            instructions++;
+            textBytes += nextAddress(i * 4) - instrAddress(i * 4);
+        }
+    }
+    cout << "Fetch statistics:";
+    cout << " Code Size=" << textBytes << "B (" << instructions * 4 << "B uncompressed)";
+    cout << " ,Fetched Instructions=" << fetchedInstructions;
+    cout << " ,Compressed=" << fetchedCompressed;
+    cout << " ,Fetched Bytes=" << fetchedBytes;
+    cout << " ,Fetch Savings=" << fixed << setprecision(2) << (fetchedInstructions != 0 ? 1 - (float)fetchedBytes / (4 * fetchedInstructions) : 0) << endl;
+    if (iCache != NULL)
+    {
+        printCacheStats(iCache, "I-cache");
+    }
+}
+
+/*
+    Performs tasks, manipulate the memory and register for the given instruction line
+*/
+pair<int, bool> convert(string line, int pc, bool step, bool cacheEnabled, cache *newCache)
+{
+    bool flag = false;
+    int lineNum = pc / 4 + 1 + memLines;
+    if (breakpoints.find(lineNum) != breakpoints.end() && breakpoints[lineNum] && !step)
+    {
+        cout << "Execution stopped at breakpoint" << endl;
+        return make_pair(-2, flag);
+    }
+    if (line[0] == ';')
+    { // starting with semicolon is treated as a comment
+        return make_pair(0, flag);
+    }
+    if (comments.find(pc) != comments.end())
+    {
+        line = line.substr(0, comments[pc]);
+    }
+    string instr = "";
+    string args = "";
+    int prev = -1;
+    int i = 0;
+
+    while (line[i] == ' ' && i < line.length())
+    {
+        prev++;
+        i++;
+    }
+
+    for (i; i < line.length(); i++) // extracting instruction and arguments
+    {
+        if (line[i] == ':' || line[i] == ' ' || line[i] == ',')
+        {
+            prev++;
+        }
+        else if (i + 1 < line.length() && line[i + 1] == ':')
+        {
+            prev = i;
+        }
+        else if (i + 1 < line.length() && (line[i + 1] == ' ' || line[i + 1] == ','))
+        {
+            instr = line.substr(prev + 1, i - prev);
+            args = line.substr(i + 1);
+            break;
+        }
+        else if (i == line.length() - 1)
+        {
+            instr = line.substr(prev + 1, i - prev + 1);
+            args = "";
+            break;
+        }
+    }
+    if (instr == "")
+    {
+        cout << "Line " << (pc / 4 + 1) << ": Invalid Instruction" << endl;
+        return make_pair(-1, flag);
+    }
+    // the aq and rl ordering bits do not change anything as atomics are already sequentially consistent
+    if (instr.length() > 5 && instr.substr(instr.length() - 5) == ".aqrl")
+    {
+        instr = instr.substr(0, instr.length() - 5);
+    }
+    else if (instr.length() > 3 && (instr.substr(instr.length() - 3) == ".aq" || instr.substr(instr.length() - 3) == ".rl"))
+    {
+        instr = instr.substr(0, instr.length() - 3);
+    }
+    if (instr.substr(0, 2) == "c.") // explicit RV64C mnemonics execute as the instruction they expand to
+    {
+        vector<string> expanded = expandCompressed(splitInstruction(instr + " " + args));
+        if (expanded.size() == 0)
+        {
+            cout << "Line " << (pc / 4 + 1) << ": Invalid compressed instruction " << instr << endl;
+            return make_pair(-1, flag);
+        }
+        instr = expanded[0];
+        args = expanded[1];
+        if (instr == "lw" || instr == "ld" || instr == "sw" || instr == "sd" || instr == "jalr")
+        {
+            args += ", " + expanded[2] + "(" + expanded[3] + ")";
+        }
+        else
+        {
+            for (int j = 2; j < expanded.size(); j++)
+            {
+                args += ", " + expanded[j];
+            }
+        }
+    }
+    if (opcode.find(instr) == opcode.end())
+    {
+        cout << "Line " << (pc / 4 + 1) << ": Instruction " << instr << " not found" << endl;
+        return make_pair(-1, flag);
+    }
+    if (opcode[instr] == "0110011" || opcode[instr] == "0111011") // R type instructions and,xor,or,add,sub,sll,srl,sra,slt,sltu and the M extension
+    {
+        vector<string> arguments;
+        bool err;
+        pair<vector<string>, bool> res = getArguments(pc / 4 + 1, 3, args, false);
+        err = res.second;
+        arguments = res.first;
+        if (err)
+        {
+            return make_pair(-1, flag);
+        }
+        int rd, rs1, rs2;
+        rd = getRegister(arguments[0], alias, pc / 4 + 1);
+        rs1 = getRegister(arguments[1], alias, pc / 4 + 1);
+        rs2 = getRegister(arguments[2], alias, pc / 4 + 1);
+        if (rd == -1 || rs1 == -1 || rs2 == -1)
+        {
+            return make_pair(-1, flag);
+        }
+
+        if (checkRegister(rd, pc / 4 + 1) || checkRegister(rs1, pc / 4 + 1) || checkRegister(rs2, pc / 4 + 1))
+        {
+            return make_pair(-1, flag);
+        }
+        if (rd == 0)
+        {
+            return make_pair(0, flag);
+        }
+        registers[rd] = ALU(registers[rs1], registers[rs2], instr);
+    }
+    else if (opcode[instr] == "0010011" || opcode[instr] == "0011011") // I type instructions addi, andi, ori, xori, slti, sltiu, slli, srli, srai and their W forms
+    {
+        vector<string> arguments;
+        int count = 0;
+        int index = 0;
+        int prev = -1;
+        int rd, rs1;
+        int imm;
+        arguments = getArguments(pc / 4 + 1, 3, args, false).first;
+        rd = getRegister(arguments[0], alias, pc / 4 + 1);
+        rs1 = getRegister(arguments[1], alias, pc / 4 + 1);
+        if (rd == -1 || rs1 == -1)
+            return make_pair(-1, flag);
+
+        if (checkRegister(rd, pc / 4 + 1) || checkRegister(rs1, pc / 4 + 1))
+        {
+            return make_pair(-1, flag);
+        }
+
+        pair<int, bool> res;
+        res = getImmediate(arguments[2], pc, label, false);
+
+        imm = res.first;
+        if (imm > 2047 || imm < -2048)
+        {
+            cout << "Line " << (pc / 4 + 1) << ": Value cannot be stored in 12 bits" << endl;
+            return make_pair(-1, flag);
+        }
+
+        if (instr == "slli" || instr == "srli" || instr == "srai")
+        {
+            if (imm > 63 || imm < 0)
+            {
+                cout << "Line " << (pc / 4 + 1) << ": Cannot shift by " << imm << " bits" << endl;
+                return make_pair(-1, flag);
+            }
+        }
+        if (instr == "slliw" || instr == "srliw" || instr == "sraiw")
+        {
+            if (imm > 31 || imm < 0)
+            {
+                cout << "Line " << (pc / 4 + 1) << ": Cannot shift by " << imm << " bits" << endl;
+                return make_pair(-1, flag);
+            }
+        }
+        if (instr == "srai") // special case of srai where the 6 MSB bits are always having value 16
+        {
+            pair<int, bool> res = hexToInt("0x10", pc / 4 + 1);
+            if (res.second)
+            {
+                cout << "Line " << (pc / 4 + 1) << ": Invalid immediate" << endl;
+                return make_pair(-1, flag);
+            }
+
+            int imm_6_11 = res.first;
+
+            int imm_0_5 = imm & 63;
+
+            imm = imm_0_5 | (imm_6_11 << 6);
+        }
+        if (rd == 0)
+        {
+            return make_pair(0, flag);
+        }
+        registers[rd] = ALU(registers[rs1], imm, instr);
+    }
+    else if (opcode[instr] == "0000011" || opcode[instr] == "1100111") // Load type ld lh lw ....
+    {
+        vector<string> arguments;
+        int count = 0;
+        int index = 0;
+        int prev = -1;
+        arguments = getArguments(pc / 4 + 1, 3, args, true).first;
+        int rd, rs1, imm;
+        rd = getRegister(arguments[0], alias, pc / 4 + 1);
+        rs1 = getRegister(arguments[2], alias, pc / 4 + 1);
+        if (rd == -1 || rs1 == -1)
+            return make_pair(-1, flag);
+
+        if (checkRegister(rd, pc / 4 + 1) || checkRegister(rs1, pc / 4 + 1))
+        {
+            return make_pair(-1, flag);
+        }
+        pair<int, bool> res = getImmediate(arguments[1], pc, label, false);
+        imm = res.first;
+
+        if (imm > 2047 || imm < -2048)
+        {
             cout << "Line: " << (pc / 4 + 1) << " Value cannot be stored in 12 bits" << endl;
             return make_pair(-1, flag);
         }
 
         if (instr == "jalr")
         {
+            int target = linePc(registers[rs1] + imm);
+            if (target == -1)
+            {
+                cout << "Line: " << (pc / 4 + 1) << " Jump target is not an instruction" << endl;
+                return make_pair(-1, flag);
+            }
             funcReturn = true;
             st.pop();
             if (rd == 0)
             {
-                return make_pair(registers[rs1] + imm, true);
+                return make_pair(target, true);
             }
-            registers[rd] = pc + 4;
-            return make_pair(registers[rs1] + imm, true);
+            registers[rd] = nextAddress(pc);
+            return make_pair(target, true);
         }
         unsigned long address = registers[rs1] + imm;
-        if (address > memsize)
-        {
-            cout << "Line: " << (pc / 4 + 1) << " Memory address out of bounds" << endl;
-            return make_pair(-1, flag);
-        }
 
         unsigned long extracted_num = 0;
         int size = 0;
@@ -1021,236 +2513,31 @@ pair<int, bool> convert(string line, int pc, bool step, bool cacheEnabled, cache
                 sign_extension = true;
             size = 1;
         }
-        if (!cacheEnabled)
-        {
-            for (int i = 0; i < size; i++)
-            {
-                extracted_num = extracted_num + (memory[address + i] << (i * 8));
-            }
-            if (sign_extension)
-            {
-                if (size == 1 && (extracted_num & 0x80))
-                {
-                    extracted_num = extracted_num | 0xffffffffffffff00;
-                }
-                else if (size == 2 && (extracted_num & 0x8000))
-                {
-                    extracted_num = extracted_num | 0xffffffffffff0000;
-                }
-                else if (size == 4 && (extracted_num & 0x80000000))
-                {
-                    extracted_num = extracted_num | 0xffffffff00000000;
-                }
-            }
-            if (rd == 0)
-            {
-                return make_pair(0, flag);
-            }
-            registers[rd] = extracted_num;
-            return make_pair(0, flag);
-        }
-        else
-        {
-            string binAddress = bitset<20>(address).to_string();
-            // extracting the sizes of the fields
-            int indexSize = (int)log2(newCache->cache_size / (newCache->block_size * newCache->associativity));
-            int offset = (int)log2(newCache->block_size);
-            int tagsize = 20 - offset - indexSize;
-            // extracting the tag, index and offset from the address
-            string tag = binAddress.substr(0, tagsize);
-            string index = binAddress.substr(tagsize, indexSize);
-            string offtag = binAddress.substr(indexSize + tagsize, offset);
-            int idx;
-            if (index == "")
-            {
-                idx = 0;
-            }
-            else
-            {
-                idx = stoi(index, 0, 2);
-            }
-
-            // make offset bits zero to get the base address of the block
-            unsigned long baseaddress = (unsigned long)address >> offset;
-            baseaddress = baseaddress << offset;
-            if (address + size > newCache->block_size + baseaddress)
-            {
-                cout << "Unaligned Memory Access" << endl;
-                return make_pair(-1, flag);
-            }
-
-            for (auto i : newCache->table[idx])
-            {
-                if (i->tag == tag && i->valid)
-                {
-                    string outputFile = fileName + ".output";
-
-                    newCache->hits++;
-
-                    // ofstream file(outputFile, ios::app);
-                    
-                    // file << "R: Address: " << hex << "0x" << address << ", Set: 0x" << idx << ", Hit, Tag: 0x" << stoul(tag, 0, 2) << ", " << (i->dirty ? "Dirty" : "Clean") << endl;
-                    // file.close();
-
-                    // updated the timer of access of the block
-                    if (newCache->replacement_policy == "LRU")
-                    {
-                        timer++;
-                        i->toa = timer;
-                    }
-
-                    if (rd == 0)
-                    {
-                        return make_pair(0, flag);
-                    }
-
-                    // extracting value from the block
-                    unsigned long extracted_num = 0;
-
-                    for (int k = 0; k < size; k++)
-                    {
-                        extracted_num = extracted_num + (i->data[stoi(offtag, 0, 2) + k] << (k * 8));
-                    }
-                    //cout << extracted_num << endl;
-                    if (sign_extension)
-                    {
-                        if (size == 1 && (extracted_num & 0x80))
-                        {
-                            extracted_num = extracted_num | 0xffffffffffffff00;
-                        }
-                        else if (size == 2 && (extracted_num & 0x8000))
-                        {
-                            extracted_num = extracted_num | 0xffffffffffff0000;
-                        }
-                        else if (size == 4 && (extracted_num & 0x80000000))
-                        {
-                            extracted_num = extracted_num | 0xffffffff00000000;
-                        }
-                    }
-                    registers[rd] = extracted_num;
-                    // registers[rd] = i->data[stoi(offtag, 0, 2)];
-                    return make_pair(0, flag);
-                }
-            }
-
-            newCache->misses++;
-
-            // search for empty block
-            int emptyBlock = -1;
-            for (int i = 0; i < newCache->associativity; i++)
-            {
-                if (!newCache->table[idx][i]->valid)
-                {
-                    emptyBlock = i;
-                    break;
-                }
-            }
-            //cout << "Found Empty Block: " << emptyBlock << endl;
-
-            // if empty block not found
-            if (emptyBlock == -1)
-            {
-                if (newCache->replacement_policy == "RANDOM")
-                {
-                    emptyBlock = rand() % newCache->associativity;
-                }
-
-                else if (newCache->replacement_policy == "LRU" || newCache->replacement_policy == "FIFO")
-                {
-                    int min = INT_MAX;
-                    for (auto i : newCache->table[idx])
-                    {
-                        if (i->toa < min)
-                        {
-                            min = i->toa;
-                        }
-                    }
-                    int it = 0;
-                    for (auto i : newCache->table[idx])
-                    {
-                        if (i->toa == min)
-                        {
-                            emptyBlock = it;
-                            break;
-                        }
-                        it++;
-                    }
-                }
-            }
-            //cout << "Found Empty Block 1: " << emptyBlock << endl;
-            // updating memory if the block is dirty
-            if (newCache->table[idx][emptyBlock]->valid && newCache->table[idx][emptyBlock]->dirty)
-            {
-                //cout << "Chosen block was Dirty" << endl;
-                string offTagZeroes(offtag.length(), '0'); // number of bytes in a block
-                unsigned long currBaseAddress = stoul(newCache->table[idx][emptyBlock]->tag + index + offTagZeroes, 0, 2);
-                //cout << "Current Base Address: " << hex << "0x" << currBaseAddress << endl;
-                for (int k = 0; k < newCache->block_size; k++)
-                {
-                    memory[currBaseAddress + k] = newCache->table[idx][emptyBlock]->data[k];
-                }
-            }
-
-            for (int k = 0; k < newCache->block_size; k++)
+        if (!loadValue(address, size, cacheEnabled, newCache, extracted_num))
+        {
+            return make_pair(-1, flag);
+        }
+        if (sign_extension)
+        {
+            if (size == 1 && (extracted_num & 0x80))
             {
-                newCache->table[idx][emptyBlock]->data[k] = memory[baseaddress + k];
+                extracted_num = extracted_num | 0xffffffffffffff00;
             }
-
-            newCache->table[idx][emptyBlock]->tag = tag;
-            newCache->table[idx][emptyBlock]->valid = true;
-
-            if (newCache->replacement_policy == "FIFO" || newCache->replacement_policy == "LRU")
+            else if (size == 2 && (extracted_num & 0x8000))
             {
-                timer++;
-                newCache->table[idx][emptyBlock]->toa = timer;
+                extracted_num = extracted_num | 0xffffffffffff0000;
             }
-
-            for (auto i : newCache->table[idx])
+            else if (size == 4 && (extracted_num & 0x80000000))
             {
-                if (i->tag == tag && i->valid)
-                {
-                    //cout << "mil gaya" << endl;
-                    // string outputFile = fileName + ".output";
-                    // ofstream file(outputFile, ios::app);
-                    
-                    // file << "R: Address: " << hex << "0x" << address << ", Set: 0x" << idx << ", Miss, Tag: 0x" << stoul(tag, 0, 2) << ", Clean" << endl;
-                    // file.close();
-
-                    if (rd == 0)
-                    {
-                        return make_pair(0, flag);
-                    }
-
-                    // extracting value from the block
-                    unsigned long extracted_num = 0;
-
-                    for (int k = 0; k < size; k++)
-                    {
-                        extracted_num = extracted_num + (i->data[stoi(offtag, 0, 2) + k] << (k * 8));
-                    }
-                    // cout << "Extracted num: " << extracted_num << endl;
-                    // extending sign
-                    if (sign_extension)
-                    {
-                        if (size == 1 && (extracted_num & 0x80))
-                        {
-                            extracted_num = extracted_num | 0xffffffffffffff00;
-                        }
-                        else if (size == 2 && (extracted_num & 0x8000))
-                        {
-                            extracted_num = extracted_num | 0xffffffffffff0000;
-                        }
-                        else if (size == 4 && (extracted_num & 0x80000000))
-                        {
-                            extracted_num = extracted_num | 0xffffffff00000000;
-                        }
-                    }
-                    registers[rd] = extracted_num;
-                    // registers[rd] = i->data[stoi(offtag, 0, 2)];
-                    return make_pair(0, flag);
-                }
+                extracted_num = extracted_num | 0xffffffff00000000;
             }
         }
+        if (rd == 0)
+        {
+            return make_pair(0, flag);
+        }
+        registers[rd] = extracted_num;
+        return make_pair(0, flag);
     }
     else if (opcode[instr] == "0100011") // S type
     {
@@ -1296,199 +2583,10 @@ pair<int, bool> convert(string line, int pc, bool step, bool cacheEnabled, cache
             size = 1;
         }
         unsigned long address = registers[rs1] + imm;
-        if (address < 0x10000)
-        {
-            cout << "Line: " << (pc / 4 + 1) << ": Segmentation Fault" << endl;
-            return make_pair(-1, flag);
-        }
 
-        if (!cacheEnabled)
-        {
-            for (unsigned long i = 0; i < size; ++i)
-            {
-                memory[i + address] = (num >> (i * 8)) & 0xff; // little endian format
-            }
-        }
-        else
+        if (!storeValue(address, size, num, cacheEnabled, newCache))
         {
-            string binAddress = bitset<20>(address).to_string();
-
-            int indexSize = (int)log2(newCache->cache_size / (newCache->block_size * newCache->associativity));
-            int offset = (int)log2(newCache->block_size);
-            int tagsize = 20 - offset - indexSize;
-            string offtag = binAddress.substr(indexSize + tagsize, offset);
-            string tag = binAddress.substr(0, tagsize);
-            //cout << "Tag: " << tag << endl;
-            string index = binAddress.substr(tagsize, indexSize);
-            //cout << "stoi test" << endl;
-            int idx;
-            if (index == "")
-            {
-                idx = 0;
-            }
-            else
-            {
-                idx = stoi(index, 0, 2);
-            }
-
-            unsigned long baseaddress = (unsigned long)address >> offset;
-            baseaddress = baseaddress << offset;
-            if (address + size > newCache->block_size + baseaddress)
-            {
-                cout << "Unaligned Memory Access" << endl;
-                return make_pair(-1, flag);
-            }
-
-            for (auto i : newCache->table[idx])
-            {
-                if (i->tag == tag && i->valid)
-                {
-                    //cout << "found" << endl;
-                    newCache->hits++;
-                    //string outputFile = fileName + ".output";
-                    //ofstream file(outputFile, ios::app);
-
-                    if (newCache->write_back_policy == "WB")
-                    {
-                        //file << "W: Address: " << hex << "0x" << address << ", Set: 0x" << idx << ", Hit, Tag: 0x" << stoul(tag, 0, 2) << ", Dirty" << endl;
-                    }
-                    else if (newCache->write_back_policy == "WT")
-                    {
-                        //file << "W: Address: " << hex << "0x" << address << ", Set: 0x" << idx << ", Hit, Tag: 0x" << stoul(tag, 0, 2) << ", Clean" << endl;
-
-                        // write through replaces the value in memory at the same timer
-                        for (unsigned long k = 0; k < size; k++)
-                        {
-                            memory[address + k] = (num >> (k * 8)) & 0xff; // little endian format
-                        }
-                    }
-
-                    //file.close();
-                    if (newCache->replacement_policy == "LRU")
-                    {
-                        timer++;
-                        i->toa = timer;
-                    }
-
-                    // change the value in the cache
-                    for (int k = 0; k < size; k++)
-                    {
-                        i->data[stoi(offtag, 0, 2) + k] = (num >> (k * 8)) & 0xff;
-                    }
-                    if (newCache->write_back_policy == "WB")
-                    {
-                        i->dirty = true;
-                    }
-                    return make_pair(0, flag);
-                }
-            }
-
-            //cout << "not found" << endl;
-
-            newCache->misses++;
-
-            // search for empty block
-            int emptyBlock = -1;
-            for (int i = 0; i < newCache->associativity; i++)
-            {
-                if (!newCache->table[idx][i]->valid)
-                {
-                    emptyBlock = i;
-                    break;
-                }
-            }
-
-            // if empty block not found
-            if (emptyBlock == -1)
-            {
-                if (newCache->replacement_policy == "RANDOM")
-                {
-                    emptyBlock = rand() % newCache->associativity;
-                }
-
-                else if (newCache->replacement_policy == "LRU" || newCache->replacement_policy == "FIFO")
-                {
-                    int min = INT_MAX;
-                    for (auto i : newCache->table[idx])
-                    {
-                        if (i->toa < min)
-                        {
-                            min = i->toa;
-                        }
-                    }
-                    int it = 0;
-                    for (auto i : newCache->table[idx])
-                    {
-                        if (i->toa == min)
-                        {
-                            emptyBlock = it;
-                            break;
-                        }
-                        it++;
-                    }
-                }
-            }
-
-            if (newCache->write_back_policy == "WB") // follow write allocate policy if write back
-            {
-                if (newCache->table[idx][emptyBlock]->valid && newCache->table[idx][emptyBlock]->dirty)
-                {
-                    string offTagZeroes(offtag.length(), '0'); // number of dwords in a block
-                    unsigned long currBaseAddress = stoul(newCache->table[idx][emptyBlock]->tag + index + offTagZeroes, 0, 2);
-                    for (int k = 0; k < newCache->block_size; k++)
-                    {
-                        memory[currBaseAddress + k] = newCache->table[idx][emptyBlock]->data[k];
-                    }
-                }
-
-                unsigned long baseaddress = (unsigned long)address >> (offset);
-                baseaddress = baseaddress << (offset);
-                for (int k = 0; k < newCache->block_size; k++)
-                {
-                    newCache->table[idx][emptyBlock]->data[k] = memory[baseaddress + k];
-                }
-
-                newCache->table[idx][emptyBlock]->tag = tag;
-                //cout << "empty block " << emptyBlock << endl;
-                newCache->table[idx][emptyBlock]->valid = true;
-                newCache->table[idx][emptyBlock]->dirty = true;
-
-                if (newCache->replacement_policy == "FIFO" || newCache->replacement_policy == "LRU")
-                {
-                    timer++;
-                    newCache->table[idx][emptyBlock]->toa = timer;
-                }
-
-                for (auto i : newCache->table[idx])
-                {
-                    if (i->tag == tag && i->valid)
-                    {
-                        string outputFile = fileName + ".output";
-                        // ofstream file(outputFile, ios::app);
-
-                        // file << "W: Address: " << hex << "0x" << address << ", Set: 0x" << idx << ", Hit, Tag: 0x" << stoul(tag, 0, 2) << ", Dirty" << endl;
-
-                        // file.close();
-
-                        // put the value from the register to the cache
-                        for (int k = 0; k < size; k++)
-                        {
-                            i->data[stoi(offtag, 0, 2) + k] = (num >> (k * 8)) & 0xff;
-                        }
-                    }
-                }
-            }
-            else if (newCache->write_back_policy == "WT") // follow no write allocate policy if write through
-            {
-
-                // string outputFile = fileName + ".output";
-                // ofstream file(outputFile, ios::app);
-                // file << "W: Address: " << hex << "0x" << address << ", Set: 0x" << idx << ", Miss, Tag 0x" << stoul(tag, 0, 2) << ", Clean" << endl;
-                for (unsigned long k = 0; k < size; k++)
-                {
-                    memory[address + k] = (num >> (k * 8)) & 0xff; // little endian format
-                }
-            }
+            return make_pair(-1, flag);
         }
     }
     else if (opcode[instr] == "1100011") // B type beq,bge,blt,bne,bltu,bgeu
@@ -1513,6 +2611,17 @@ pair<int, bool> convert(string line, int pc, bool step, bool cacheEnabled, cache
 
         pair<int, bool> res1 = getImmediate(arguments[2], pc, label, true);
         int curr_label = res1.first;
+        if (compressedEnabled && label.find(arguments[2]) == label.end() && !res1.second)
+        {
+            // numeric offsets count bytes of the compressed layout, turn them into the line distance used below
+            int target = linePc(instrAddress(pc) + curr_label);
+            if (target == -1)
+            {
+                cout << "Line: " << (pc / 4 + 1) << " Branch target is not an instruction" << endl;
+                return make_pair(-1, flag);
+            }
+            curr_label = target - pc;
+        }
         if (curr_label > 4095 || curr_label < -4096)
         {
             cout << "Line: " << (pc / 4 + 1) << " value cannot be stored in 13 bits" << endl;
@@ -1584,6 +2693,16 @@ pair<int, bool> convert(string line, int pc, bool step, bool cacheEnabled, cache
         int neg = (arguments[1][0] == '-' ? 1 : 0);
         int curr_label = getImmediate(arguments[1], pc, label, true).first;
         bool flag = getImmediate(arguments[1], pc, label, true).second;
+        if (compressedEnabled && label.find(arguments[1]) == label.end() && !flag)
+        {
+            int target = linePc(instrAddress(pc) + curr_label);
+            if (target == -1)
+            {
+                cout << "Line: " << (pc / 4 + 1) << " Jump target is not an instruction" << endl;
+                return make_pair(-1, flag);
+            }
+            curr_label = target - pc;
+        }
         if (curr_label > 1048575 || curr_label < -1048576)
         {
             cout << "Line: " << (pc / 4 + 1) << " value cannot be stored in 21 bits" << endl;
@@ -1606,9 +2725,75 @@ pair<int, bool> convert(string line, int pc, bool step, bool cacheEnabled, cache
         // cout << "imm is " << imm << endl;
         // cout << "pc is " << pc << endl;
         funcCall = true;
-        registers[rd] = pc + 4;
+        registers[rd] = nextAddress(pc);
         return make_pair(pc + imm, true);
     }
+    else if (opcode[instr] == "0010111") // auipc
+    {
+        pair<vector<string>, bool> res = getArguments(pc / 4 + 1, 2, args, false);
+        if (res.second)
+            return make_pair(-1, flag);
+        vector<string> arguments = res.first;
+        int rd = getRegister(arguments[0], alias, pc / 4 + 1);
+        if (rd == -1)
+            return make_pair(-1, flag);
+        if (checkRegister(rd, pc / 4 + 1))
+        {
+            return make_pair(-1, flag);
+        }
+        pair<int, bool> imm = getImmediate(arguments[1], pc, label, false);
+        if (imm.second)
+        {
+            cout << "Line " << (pc / 4 + 1) << " : Wrong immediate value " << endl;
+            return make_pair(-1, flag);
+        }
+        if (imm.first > 1048575 || imm.first < -524288)
+        {
+            cout << "Line " << (pc / 4 + 1) << " Immediate value cannot be stored in 20 bits" << endl;
+            return make_pair(-1, flag);
+        }
+        // upper 20 bits of a sign extended 32 bit offset added to the address of this instruction
+        long int offset = (int)((unsigned int)(imm.first & 0xfffff) << 12);
+        if (rd == 0)
+        {
+            return make_pair(0, flag);
+        }
+        registers[rd] = instrAddress(pc) + offset;
+    }
+    else if (opcode[instr] == "0001111") // fence, memory is always sequentially consistent so nothing to order
+    {
+        return make_pair(0, flag);
+    }
+    else if (opcode[instr] == "0101111") // A type lr, sc, amo
+    {
+        return atomicOp(instr, args, pc, cacheEnabled, newCache);
+    }
+    else if (instr == "ecall")
+    {
+        return ecallOp(pc, cacheEnabled, newCache);
+    }
+    else if (instr == "sfence.vma") // flushes every translation whatever its operands
+    {
+        flushTlbs();
+        return make_pair(0, flag);
+    }
+    else if (instr == "ebreak") // stops like a breakpoint, stepping executes it as a no-op
+    {
+        if (step)
+        {
+            return make_pair(0, flag);
+        }
+        cout << "Execution stopped at ebreak" << endl;
+        return make_pair(-2, flag);
+    }
+    else if (opcode[instr] == "1010011" || opcode[instr] == "1000011" || opcode[instr] == "1000111" || opcode[instr] == "1001011" || opcode[instr] == "1001111" || opcode[instr] == "1110011" || ((opcode[instr] == "0000111" || opcode[instr] == "0100111") && instr[0] == 'f')) // F and D, fcsr
+    {
+        return floatOp(instr, args, pc, cacheEnabled, newCache);
+    }
+    else if (opcode[instr] == "1010111" || opcode[instr] == "0000111" || opcode[instr] == "0100111") // V vector subset
+    {
+        return vectorOp(instr, args, pc, cacheEnabled, newCache);
+    }
     else if (opcode[instr] == "0110111") // lui
     {
         pair<vector<string>, bool> res = getArguments(pc / 4 + 1, 2, args, false);
@@ -1696,6 +2881,8 @@ void setup()
         registers[i] = 0;
     }
     initialiseMemory();
+    resetVector();
+    resetFloat();
 }
 
 /*
@@ -1734,6 +2921,8 @@ bool loadProgram(string file)
     label.clear();
     comments.clear();
     inverseLabel.clear();
+    labelIndex.clear();
+    takeReservation(hartId, 0);
     pair<bool, int> res = loadFile(file);
     if (!res.first)
         return false;
@@ -1742,9 +2931,160 @@ bool loadProgram(string file)
         return false;
     getComments(file);
     memLines = res.second;
+    resetSyscalls(dataEnd);
+    timingLines.clear();
+    resetPipeline();
+    resetOoo();
+    resetBranchPredictors();
+    resetReuseProfiler();
+    resetDram();
+    resetMmu();
+    for (int i = 0; i < lines.size(); i++) // rounding modes and flags are only tracked for programs that can see them
+    {
+        if (usesFloatCsr(splitInstruction(lines[i].second)))
+        {
+            fpExact = true;
+        }
+    }
+    lineAddress.clear();
+    if (compressedEnabled)
+    {
+        layoutProgram();
+    }
+    fetchedInstructions = 0;
+    fetchedCompressed = 0;
+    fetchedBytes = 0;
     return true;
 }
 
+/*
+    Charges the data cache accesses and misses made since the given counts to the instruction at pc
+*/
+void attributeAccesses(cache *newCache, int pc, int accesses, int misses)
+{
+    accesses = newCache->hits + newCache->misses - accesses;
+    if (accesses == 0)
+    {
+        return;
+    }
+    pair<long, long> &stats = newCache->pc_stats[pc];
+    stats.first += accesses;
+    stats.second += newCache->misses - misses;
+}
+
+void printDelinquentLoads(cache *newCache, int count)
+{
+    vector<pair<long, int> > order;
+    for (auto it = newCache->pc_stats.begin(); it != newCache->pc_stats.end(); it++)
+    {
+        if (it->second.second != 0)
+        {
+            order.push_back(make_pair(it->second.second, -it->first));
+        }
+    }
+    // most misses first, earlier lines first among equals
+    sort(order.rbegin(), order.rend());
+    cout << "Top delinquent loads and stores:" << endl;
+    for (int i = 0; i < order.size() && (count == 0 || i < count); i++)
+    {
+        int pc = -order[i].second;
+        pair<long, long> stats = newCache->pc_stats[pc];
+        int start = pc;
+        while (start > 0 && inverseLabel.find(start) == inverseLabel.end())
+        {
+            start -= 4;
+        }
+        string text = pc / 4 < lines.size() ? lines[pc / 4].second : "";
+        if (labelIndex.find(pc) != labelIndex.end())
+        {
+            text = text.substr(labelIndex[pc]);
+        }
+        cout << "  Line " << pc / 4 + 1 + memLines << " (" << inverseLabel[start];
+        if (pc != start)
+        {
+            cout << "+" << (pc - start) / 4;
+        }
+        cout << "): " << text;
+        cout << " ,Accesses=" << stats.first << " ,Misses=" << stats.second;
+        cout << " ,Miss Rate=" << fixed << setprecision(2) << (float)stats.second / stats.first;
+        cout << " ,Share=" << (float)stats.second / newCache->misses << endl;
+    }
+}
+
+/*
+    Executes the line at the current PC, moves the PC and keeps the call stack updated.
+    Returns 0 on normal execution, -1 on error and -2 on breakpoint
+*/
+int executeLine(bool cacheEnabled, cache *newCache)
+{
+    string &line = lines[mainPC / 4].second;
+    if (line[0] == '\0')
+    {
+        mainPC += 4;
+        return 0;
+    }
+    int fetchMisses = iCache != NULL ? iCache->misses : 0;
+    int walkMisses = cacheEnabled ? newCache->misses : 0;
+    if (!fetchInstruction(mainPC, cacheEnabled, newCache))
+    {
+        return -1;
+    }
+    // page table reads of the fetch go through the D-cache but are charged to the fetch
+    int dataMisses = cacheEnabled ? newCache->misses : 0;
+    int dataAccesses = cacheEnabled ? newCache->hits + newCache->misses : 0;
+    fetchMisses -= dataMisses - walkMisses;
+    pair<int, bool> ans = convert(line, mainPC, false, cacheEnabled, newCache);
+    int res = ans.first;
+    bool flag = ans.second;
+    if (cacheEnabled)
+    {
+        attributeAccesses(newCache, mainPC, dataAccesses, dataMisses);
+    }
+    if (profilerEnabled && res >= 0)
+    {
+        profileInstruction();
+    }
+    if (dramEnabled && res >= 0)
+    {
+        dramInstruction();
+    }
+    if (res == -2 || res == -1) // -2: breakpoint, -1: error
+    {
+        return res;
+    }
+    if (pipelineEnabled || oooEnabled || predictorsEnabled)
+    {
+        retireTiming(mainPC, res != 0 || flag, res, cacheEnabled ? newCache->misses - dataMisses : 0, (iCache != NULL ? iCache->misses : 0) - fetchMisses,
+                     cacheEnabled ? newCache->block_size : 0);
+    }
+    if (res != 0 || flag)
+    {
+        pair<string, int> temp(st.top().first, mainPC / 4 + 1 + memLines);
+        mainPC = res;
+        if (funcReturn)
+        {
+            funcReturn = false;
+            return 0;
+        }
+        st.pop();
+        st.push(temp);
+
+        if (funcCall)
+        {
+            funcCall = false;
+            st.push(pair<string, int>(inverseLabel[mainPC], mainPC / 4 + memLines));
+        }
+    }
+    else
+    {
+        pair<string, int> temp(st.top().first, mainPC / 4 + 1 + memLines);
+        st.pop();
+        st.push(temp);
+        mainPC += 4;
+    }
+    return 0;
+}
+
 /*
     Runs the entire code starting from the current PC
 */
@@ -1758,59 +3098,31 @@ void run(bool toPrint,bool cacheEnabled, cache* newCache)
     }
     while ((mainPC / 4) < numLines && mainPC >= 0)
     {
-        string line = lines[mainPC / 4].second;
-        if (line[0] == '\0')
-        {
-            mainPC += 4;
-            continue;
-        }
-        pair<int, bool> ans = convert(lines[mainPC / 4].second, mainPC, false, cacheEnabled,newCache);
-        int res = ans.first;
-        bool flag = ans.second;
+        int res = executeLine(cacheEnabled, newCache);
         if (res == -2) // -2: breakpoint, -1, 0: normal
         {
+            flushGuestFiles();
             return;
         }
         else if (res == -1)
         {
+            flushGuestFiles();
             while (!st.empty())
             {
                 st.pop();
             }
             return;
         }
-        else if (res != 0 || flag)
-        {
-            string hexPC = decToHex(mainPC);
-            pair<string, int> temp(st.top().first, mainPC / 4 + 1 + memLines);
-            mainPC = res;
-            if (funcReturn)
-            {
-                funcReturn = false;
-                continue;
-            }
-            st.pop();
-            st.push(temp);
-
-            if (funcCall)
-            {
-                funcCall = false;
-                st.push(pair<string, int>(inverseLabel[mainPC], mainPC / 4 + memLines));
-            }
-        }
-        else
-        {
-            pair<string, int> temp(st.top().first, mainPC / 4 + 1 + memLines);
-            st.pop();
-            st.push(temp);
-            string hexPC = decToHex(mainPC);
-            mainPC += 4;
-        }
     }
+    flushGuestFiles();
 
     if (toPrint)
     {
         cout << "Code executed successfully" << endl;
+        if (exited)
+        {
+            cout << "Exit code: " << exitCode << endl;
+        }
         printRegs();
         cout << endl;
         printMem(0x10000, 1);
@@ -1823,6 +3135,35 @@ void run(bool toPrint,bool cacheEnabled, cache* newCache)
     }
 }
 
+int runQuantum(long quantum, bool cacheEnabled, cache *newCache, long &executed)
+{
+    int numLines = lines.size();
+    for (long i = 0; i < quantum; i++)
+    {
+        if ((mainPC / 4) >= numLines || mainPC < 0)
+        {
+            return 1;
+        }
+        int res = executeLine(cacheEnabled, newCache);
+        if (res < 0)
+        {
+            flushGuestFiles();
+            while (!st.empty())
+            {
+                st.pop();
+            }
+            return -1;
+        }
+        executed++;
+    }
+    if ((mainPC / 4) >= numLines || mainPC < 0)
+    {
+        flushGuestFiles();
+        return 1;
+    }
+    return 0;
+}
+
 /*
     Step by step execution after the execution is stopped by breakpoint or from the start itself
 */
@@ -1851,9 +3192,40 @@ void step(bool toPrint,bool cacheEnabled, cache* newCache)
         }
         return;
     }
+    int fetchMisses = iCache != NULL ? iCache->misses : 0;
+    int walkMisses = cacheEnabled ? newCache->misses : 0;
+    if (!fetchInstruction(mainPC, cacheEnabled, newCache))
+    {
+        while (!st.empty())
+        {
+            st.pop();
+        }
+        return;
+    }
+    int dataMisses = cacheEnabled ? newCache->misses : 0;
+    int dataAccesses = cacheEnabled ? newCache->hits + newCache->misses : 0;
+    fetchMisses -= dataMisses - walkMisses;
     pair<int, bool> ans = convert(lines[mainPC / 4].second, mainPC, true,cacheEnabled,newCache);
+    flushGuestFiles(); // a stepped program shows its output right away
     int res = ans.first;
     bool flag = ans.second;
+    if (cacheEnabled)
+    {
+        attributeAccesses(newCache, mainPC, dataAccesses, dataMisses);
+    }
+    if (profilerEnabled && res >= 0)
+    {
+        profileInstruction();
+    }
+    if (dramEnabled && res >= 0)
+    {
+        dramInstruction();
+    }
+    if ((pipelineEnabled || oooEnabled || predictorsEnabled) && res >= 0)
+    {
+        retireTiming(mainPC, res != 0 || flag, res, cacheEnabled ? newCache->misses - dataMisses : 0, (iCache != NULL ? iCache->misses : 0) - fetchMisses,
+                     cacheEnabled ? newCache->block_size : 0);
+    }
     if (res == -2) // -2: breakpoint, -1, 0: normal
     {
         return;
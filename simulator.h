@@ -8,6 +8,13 @@
 
 using namespace std;
 
+extern thread_local long int registers[32];
+extern unsigned long memsize;
+extern thread_local unsigned char *memory;
+extern thread_local vector<pair<int, string> > lines;
+extern thread_local int mainPC;
+extern thread_local int hartId;
+
 /*
     Prints the registers
 */
@@ -23,6 +30,12 @@ bool loadProgram(string file);
 */
 void run(bool flag, bool cacheEnabled, cache *newCache);
 
+/*
+    Executes at most quantum instructions from the current PC, adding them to executed.
+    Returns 1 once the program has finished, 0 if the quantum expired and -1 on error or breakpoint
+*/
+int runQuantum(long quantum, bool cacheEnabled, cache *newCache, long &executed);
+
 /*
     Step by step execution after the execution is stopped by breakpoint or from the start itself
 */
@@ -54,4 +67,37 @@ void showStack();
 
 void printCacheRes(cache *newCache);
 
+/*
+    Prints the count instructions with the most misses in the data cache (all of them when count
+    is 0) with their line, enclosing label, accesses, miss rate and share of all misses
+*/
+void printDelinquentLoads(cache *newCache, int count = 10);
+
+/*
+    Reads execute latencies for the timing models, one "instruction cycles" pair per line.
+    Instructions not listed keep their default (3 for multiplies, 12-20 for divides, 1 otherwise)
+*/
+bool loadLatencies(string file);
+
+/*
+    Execute latency in cycles of the instruction
+*/
+int getLatency(string instr);
+
+/*
+    Turns RV64C on or off for the next loadProgram(). Compressible lines then take 2 bytes of the
+    byte addressed text section and return addresses, auipc and jalr targets use that layout
+*/
+void setCompressed(bool enable);
+
+/*
+    Sends every instruction fetch through the given cache, NULL turns the instruction cache off
+*/
+void setInstructionCache(cache *newCache);
+
+/*
+    Prints the code size, the bytes fetched and the share of compressed instructions
+*/
+void printFetchStats();
+
 void changeCacheConfigFile(string file);
\ No newline at end of file
@@ -0,0 +1,237 @@
+/**
+ * This file contains the host side of the ecall layer: descriptors opened by the guest,
+ * buffered output, the program break and the simulated clock
+ */
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <unordered_map>
+#include "syscalls.h"
+
+using namespace std;
+
+#define OUTPUT_BUFFER 65536
+
+/*
+    A guest descriptor, host is -1 for the standard streams which go through cin, cout and cerr
+*/
+class guest_file
+{
+public:
+    int host;
+    string pending; // output not yet written to the host
+
+    guest_file(int host = -1)
+    {
+        this->host = host;
+    }
+};
+
+thread_local bool exited = false;
+thread_local long exitCode = 0;
+thread_local unsigned long programBreak = 0;
+thread_local unsigned long heapStart = 0;
+thread_local unordered_map<int, guest_file> guestFiles;
+thread_local string sandbox = "";
+thread_local long clockRate = 1000000000;
+
+/*
+    Writes the pending output of fd to the host
+*/
+void flushFile(int fd)
+{
+    guest_file &file = guestFiles[fd];
+    if (file.pending.length() == 0)
+    {
+        return;
+    }
+    if (fd == 1 || fd == 2)
+    {
+        ostream &out = (fd == 1) ? cout : cerr;
+        out.write(file.pending.data(), file.pending.length());
+        out.flush();
+    }
+    else
+    {
+        size_t done = 0;
+        while (done < file.pending.length())
+        {
+            ssize_t n = ::write(file.host, file.pending.data() + done, file.pending.length() - done);
+            if (n <= 0)
+            {
+                break;
+            }
+            done += n;
+        }
+    }
+    file.pending.clear();
+}
+
+void flushGuestFiles()
+{
+    for (auto it = guestFiles.begin(); it != guestFiles.end(); it++)
+    {
+        flushFile(it->first);
+    }
+}
+
+void resetSyscalls(unsigned long base)
+{
+    flushGuestFiles();
+    for (auto it = guestFiles.begin(); it != guestFiles.end(); it++)
+    {
+        if (it->second.host != -1)
+        {
+            ::close(it->second.host);
+        }
+    }
+    guestFiles.clear();
+    for (int fd = 0; fd < 3; fd++)
+    {
+        guestFiles[fd] = guest_file();
+    }
+    exited = false;
+    exitCode = 0;
+    heapStart = (base + 7) & ~7UL;
+    programBreak = heapStart;
+}
+
+void setSandbox(string dir)
+{
+    sandbox = dir;
+}
+
+void setClockRate(long hz)
+{
+    if (hz > 0)
+    {
+        clockRate = hz;
+    }
+}
+
+void simulatedTime(long cycles, long &seconds, long &nanoseconds)
+{
+    seconds = cycles / clockRate;
+    nanoseconds = (long)((double)(cycles % clockRate) * 1e9 / clockRate);
+}
+
+unsigned long setBreak(unsigned long address, unsigned long memsize)
+{
+    if (address >= heapStart && address <= memsize)
+    {
+        programBreak = address;
+    }
+    return programBreak;
+}
+
+long guestWrite(int fd, const unsigned char *data, long size)
+{
+    if (guestFiles.find(fd) == guestFiles.end() || fd == 0)
+    {
+        return -EBADF;
+    }
+    guest_file &file = guestFiles[fd];
+    file.pending.append((const char *)data, size);
+    if (file.pending.length() >= OUTPUT_BUFFER)
+    {
+        flushFile(fd);
+    }
+    return size;
+}
+
+long guestRead(int fd, unsigned char *data, long size)
+{
+    if (guestFiles.find(fd) == guestFiles.end() || fd == 1 || fd == 2)
+    {
+        return -EBADF;
+    }
+    flushGuestFiles();
+    if (fd == 0)
+    {
+        long count = 0;
+        char c;
+        while (count < size && cin.get(c))
+        {
+            data[count++] = c;
+            if (c == '\n')
+            {
+                break;
+            }
+        }
+        return count;
+    }
+    ssize_t n = ::read(guestFiles[fd].host, data, size);
+    return n < 0 ? -errno : n;
+}
+
+/*
+    Host flags for the guest's O_ flags (RISC-V Linux values)
+*/
+int openFlags(int flags)
+{
+    int host = (flags & 3) == 1 ? O_WRONLY : (flags & 3) == 2 ? O_RDWR : O_RDONLY;
+    if (flags & 0100)
+        host |= O_CREAT;
+    if (flags & 0200)
+        host |= O_EXCL;
+    if (flags & 01000)
+        host |= O_TRUNC;
+    if (flags & 02000)
+        host |= O_APPEND;
+    return host;
+}
+
+long guestOpen(string path, int flags, int mode)
+{
+    if (sandbox == "")
+    {
+        return -EACCES;
+    }
+    // stay inside the sandbox: no absolute paths and no ".." components
+    if (path.length() == 0 || path[0] == '/')
+    {
+        return path.length() == 0 ? -ENOENT : -EACCES;
+    }
+    size_t start = 0;
+    while (start <= path.length())
+    {
+        size_t end = path.find('/', start);
+        if (end == string::npos)
+        {
+            end = path.length();
+        }
+        if (path.substr(start, end - start) == "..")
+        {
+            return -EACCES;
+        }
+        start = end + 1;
+    }
+    int host = ::open((sandbox + "/" + path).c_str(), openFlags(flags) | O_CLOEXEC, mode & 0777);
+    if (host < 0)
+    {
+        return -errno;
+    }
+    int fd = 3;
+    while (guestFiles.find(fd) != guestFiles.end())
+    {
+        fd++;
+    }
+    guestFiles[fd] = guest_file(host);
+    return fd;
+}
+
+long guestClose(int fd)
+{
+    if (guestFiles.find(fd) == guestFiles.end())
+    {
+        return -EBADF;
+    }
+    flushFile(fd);
+    if (guestFiles[fd].host != -1)
+    {
+        ::close(guestFiles[fd].host);
+    }
+    guestFiles.erase(fd);
+    return 0;
+}
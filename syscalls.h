@@ -0,0 +1,76 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+/*
+    Host side of the ecall layer: the guest's file descriptors, the program break and the
+    simulated clock. Like the rest of the simulator this state belongs to the host thread, so
+    every batch job and every hart has its own descriptors and program break.
+    Results follow the Linux system calls, a negative errno on failure
+*/
+
+extern thread_local bool exited;            // whether the program called exit
+extern thread_local long exitCode;          // status passed to exit
+extern thread_local unsigned long programBreak; // current end of the heap
+extern thread_local unsigned long heapStart;    // first address of the heap, the end of the .data section
+
+/*
+    Closes every descriptor but stdin, stdout and stderr, clears the exit status and places the
+    program break at base
+*/
+void resetSyscalls(unsigned long base);
+
+/*
+    Directory in which openat resolves the guest's paths. Only relative paths without ".."
+    components are accepted; an empty directory (the default) refuses every openat
+*/
+void setSandbox(string dir);
+
+/*
+    Frequency in Hz of the simulated clock read by clock_gettime, 1 GHz by default. The clock
+    counts the cycles of the out-of-order or pipeline model when one is on and one cycle per
+    instruction otherwise
+*/
+void setClockRate(long hz);
+
+/*
+    Time after the given number of cycles of the simulated clock
+*/
+void simulatedTime(long cycles, long &seconds, long &nanoseconds);
+
+/*
+    Moves the program break to address when it lies between the heap start and the end of
+    memory, returning the (possibly unchanged) break as brk does
+*/
+unsigned long setBreak(unsigned long address, unsigned long memsize);
+
+/*
+    Buffers size bytes for fd, output reaches the host once 64 KiB are pending or on flush
+    return: {long} bytes written or -errno
+*/
+long guestWrite(int fd, const unsigned char *data, long size);
+
+/*
+    Reads at most size bytes from fd after flushing the pending output, so prompts are
+    shown before input is awaited. stdin is read up to the end of the line like a terminal
+    return: {long} bytes read, 0 at end of file, or -errno
+*/
+long guestRead(int fd, unsigned char *data, long size);
+
+/*
+    Opens path inside the sandbox with the guest's O_ flags and mode
+    return: {long} new descriptor or -errno
+*/
+long guestOpen(string path, int flags, int mode);
+
+/*
+    Flushes and closes fd
+*/
+long guestClose(int fd);
+
+/*
+    Writes out the output pending on every descriptor
+*/
+void flushGuestFiles();
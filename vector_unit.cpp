@@ -0,0 +1,265 @@
+/**
+ * This file contains the vector register file of the RVV subset and the kernels
+ * executing vector instructions, written with host SIMD intrinsics when available
+ */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "vector_unit.h"
+
+using namespace std;
+
+thread_local int vlen = 256;
+thread_local unsigned long vl = 0;
+thread_local int vsew = 8;
+thread_local unsigned long vlmax = 32;
+alignas(32) thread_local unsigned char vregs[32 * MAX_VLEN / 8]; // register r starts at r * vlen / 8
+
+bool setVlen(int bits)
+{
+    if (bits < 64 || bits > MAX_VLEN || (bits & (bits - 1)) != 0)
+    {
+        cout << "VLEN must be a power of two between 64 and " << MAX_VLEN << endl;
+        return false;
+    }
+    vlen = bits;
+    resetVector();
+    return true;
+}
+
+void resetVector()
+{
+    for (int i = 0; i < 32 * MAX_VLEN / 8; i++)
+    {
+        vregs[i] = 0;
+    }
+    vl = 0;
+    vsew = 8;
+    vlmax = vlen / 8;
+}
+
+unsigned char *vectorRegister(int reg)
+{
+    return vregs + reg * (vlen / 8);
+}
+
+int vectorRegisterNumber(string reg)
+{
+    if (reg.length() >= 2 && reg.length() <= 3 && reg[0] == 'v')
+    {
+        bool digits = true;
+        for (int i = 1; i < reg.length(); i++)
+        {
+            digits = digits && reg[i] >= '0' && reg[i] <= '9';
+        }
+        if (digits && stoi(reg.substr(1)) < 32)
+        {
+            return stoi(reg.substr(1));
+        }
+    }
+    return -1;
+}
+
+int getVectorRegister(string reg, int line)
+{
+    int num = vectorRegisterNumber(reg);
+    if (num == -1)
+    {
+        cout << "Line " << line << ": Vector register " << reg << " not found" << endl;
+    }
+    return num;
+}
+
+int vtypeImmediate(vector<string> tokens)
+{
+    int sew = -1, lmul = 0, ta = 0, ma = 0;
+    for (int i = 0; i < tokens.size(); i++)
+    {
+        string t = tokens[i];
+        if (t == "e8" || t == "e16" || t == "e32" || t == "e64")
+            sew = (t == "e8") ? 0 : (t == "e16") ? 1 : (t == "e32") ? 2 : 3;
+        else if (t == "m1" || t == "m2" || t == "m4" || t == "m8")
+            lmul = (t == "m1") ? 0 : (t == "m2") ? 1 : (t == "m4") ? 2 : 3;
+        else if (t == "mf8" || t == "mf4" || t == "mf2")
+            lmul = (t == "mf8") ? 5 : (t == "mf4") ? 6 : 7;
+        else if (t == "ta" || t == "tu")
+            ta = (t == "ta");
+        else if (t == "ma" || t == "mu")
+            ma = (t == "ma");
+        else
+            return -1;
+    }
+    if (sew == -1)
+    {
+        return -1;
+    }
+    return (ma << 7) | (ta << 6) | (sew << 3) | lmul;
+}
+
+unsigned long configureVector(unsigned long avl, int vtypei)
+{
+    vsew = 8 << ((vtypei >> 3) & 7);
+    int lmul = vtypei & 7;
+    // VLMAX = LMUL * VLEN / SEW, fractional LMUL (5-7) divides instead
+    vlmax = (lmul < 4) ? ((unsigned long)vlen << lmul) / vsew : ((unsigned long)vlen >> (8 - lmul)) / vsew;
+    vl = avl < vlmax ? avl : vlmax;
+    return vl;
+}
+
+unsigned long readElement(const unsigned char *reg, unsigned long e, int sew)
+{
+    int bytes = sew / 8;
+    unsigned long value = 0;
+    for (int k = 0; k < bytes; k++)
+    {
+        value |= (unsigned long)reg[e * bytes + k] << (k * 8);
+    }
+    return value;
+}
+
+void writeElement(unsigned char *reg, unsigned long e, int sew, unsigned long value)
+{
+    int bytes = sew / 8;
+    for (int k = 0; k < bytes; k++)
+    {
+        reg[e * bytes + k] = (value >> (k * 8)) & 0xff;
+    }
+}
+
+long signExtend(unsigned long value, int sew)
+{
+    if (sew == 64)
+    {
+        return value;
+    }
+    int shift = 64 - sew;
+    return (long)(value << shift) >> shift;
+}
+
+/*
+    Whether the SIMD loop handles op at this element width, the rest uses the scalar loop
+*/
+bool simdSupported(char op, int sew)
+{
+    if (op != '*')
+    {
+        return true;
+    }
+#if defined(__AVX2__) || defined(__SSE4_1__)
+    return sew == 16 || sew == 32;
+#else
+    return sew == 16;
+#endif
+}
+
+void vectorKernel(char op, unsigned char *dst, const unsigned char *a, const unsigned char *b, int sew, unsigned long n)
+{
+    unsigned long bytes = n * (sew / 8);
+    unsigned long i = 0;
+    if (simdSupported(op, sew))
+    {
+#if defined(__AVX2__)
+        for (; i + 32 <= bytes; i += 32)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+            __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+            __m256i r;
+            if (op == '+')
+                r = sew == 8 ? _mm256_add_epi8(x, y) : sew == 16 ? _mm256_add_epi16(x, y) : sew == 32 ? _mm256_add_epi32(x, y) : _mm256_add_epi64(x, y);
+            else if (op == '-')
+                r = sew == 8 ? _mm256_sub_epi8(x, y) : sew == 16 ? _mm256_sub_epi16(x, y) : sew == 32 ? _mm256_sub_epi32(x, y) : _mm256_sub_epi64(x, y);
+            else if (op == '*')
+                r = sew == 16 ? _mm256_mullo_epi16(x, y) : _mm256_mullo_epi32(x, y);
+            else if (op == '&')
+                r = _mm256_and_si256(x, y);
+            else if (op == '|')
+                r = _mm256_or_si256(x, y);
+            else if (op == '^')
+                r = _mm256_xor_si256(x, y);
+            else
+                r = y;
+            _mm256_storeu_si256((__m256i *)(dst + i), r);
+        }
+#elif defined(__SSE2__)
+        for (; i + 16 <= bytes; i += 16)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+            __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+            __m128i r;
+            if (op == '+')
+                r = sew == 8 ? _mm_add_epi8(x, y) : sew == 16 ? _mm_add_epi16(x, y) : sew == 32 ? _mm_add_epi32(x, y) : _mm_add_epi64(x, y);
+            else if (op == '-')
+                r = sew == 8 ? _mm_sub_epi8(x, y) : sew == 16 ? _mm_sub_epi16(x, y) : sew == 32 ? _mm_sub_epi32(x, y) : _mm_sub_epi64(x, y);
+            else if (op == '*')
+#if defined(__SSE4_1__)
+                r = sew == 16 ? _mm_mullo_epi16(x, y) : _mm_mullo_epi32(x, y);
+#else
+                r = _mm_mullo_epi16(x, y);
+#endif
+            else if (op == '&')
+                r = _mm_and_si128(x, y);
+            else if (op == '|')
+                r = _mm_or_si128(x, y);
+            else if (op == '^')
+                r = _mm_xor_si128(x, y);
+            else
+                r = y;
+            _mm_storeu_si128((__m128i *)(dst + i), r);
+        }
+#endif
+    }
+    // portable loop for the remaining elements and the hosts without SIMD
+    for (unsigned long e = i / (sew / 8); e < n; e++)
+    {
+        unsigned long x = readElement(a, e, sew);
+        unsigned long y = readElement(b, e, sew);
+        unsigned long r;
+        if (op == '+')
+            r = x + y;
+        else if (op == '-')
+            r = x - y;
+        else if (op == '*')
+            r = x * y;
+        else if (op == '&')
+            r = x & y;
+        else if (op == '|')
+            r = x | y;
+        else if (op == '^')
+            r = x ^ y;
+        else
+            r = y;
+        writeElement(dst, e, sew, r);
+    }
+}
+
+unsigned long vectorReduce(string op, const unsigned char *a, int sew, unsigned long n, unsigned long init)
+{
+    // init comes from readElement too, so every value holds sew bits zero extended
+    unsigned long acc = init;
+    for (unsigned long e = 0; e < n; e++)
+    {
+        unsigned long x = readElement(a, e, sew);
+        if (op == "sum")
+            acc += x;
+        else if (op == "and")
+            acc &= x;
+        else if (op == "or")
+            acc |= x;
+        else if (op == "xor")
+            acc ^= x;
+        else if (op == "min")
+            acc = signExtend(x, sew) < signExtend(acc, sew) ? x : acc;
+        else if (op == "max")
+            acc = signExtend(x, sew) > signExtend(acc, sew) ? x : acc;
+        else if (op == "minu")
+            acc = x < acc ? x : acc;
+        else if (op == "maxu")
+            acc = x > acc ? x : acc;
+    }
+    return acc;
+}
@@ -0,0 +1,71 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+#define MAX_VLEN 1024 // largest vector register length in bits that can be simulated
+
+extern thread_local int vlen;              // vector register length in bits
+extern thread_local unsigned long vl;      // vector length set by vsetvli
+extern thread_local int vsew;              // selected element width in bits
+extern thread_local unsigned long vlmax;   // largest vl for the current vtype
+
+/*
+    Sets the vector register length for the next programs, a power of two between 64 and MAX_VLEN
+*/
+bool setVlen(int bits);
+
+/*
+    Zeroes the vector registers and resets vl and vtype
+*/
+void resetVector();
+
+/*
+    Start of vector register reg. A register group continues into the following registers
+*/
+unsigned char *vectorRegister(int reg);
+
+/*
+    Function to get the number of a vector register v0-v31
+    params: {string} reg, {int} line
+    return: {int} -1 if it is not a vector register
+*/
+int getVectorRegister(string reg, int line);
+
+/*
+    Same as getVectorRegister without reporting an error
+*/
+int vectorRegisterNumber(string reg);
+
+/*
+    Function to encode the vtype operands of vsetvli (e.g. e32, m2, ta, ma) as the 11 bit vtypei
+    params: {vector<string>} tokens
+    return: {int} -1 if the operands are invalid
+*/
+int vtypeImmediate(vector<string> tokens);
+
+/*
+    Applies vtypei and sets vl to the smaller of avl and VLMAX. Returns the new vl
+*/
+unsigned long configureVector(unsigned long avl, int vtypei);
+
+unsigned long readElement(const unsigned char *reg, unsigned long e, int sew);
+
+void writeElement(unsigned char *reg, unsigned long e, int sew, unsigned long value);
+
+/*
+    Sign extends a sew bit element
+*/
+long signExtend(unsigned long value, int sew);
+
+/*
+    Element-wise dst = a op b on the first n elements of sew bits, op is one of + - * & | ^ and =
+    (copy of b). Runs on AVX2 or SSE2 when the host has them, elements past n are left untouched
+*/
+void vectorKernel(char op, unsigned char *dst, const unsigned char *a, const unsigned char *b, int sew, unsigned long n);
+
+/*
+    Reduces the first n elements of a into init with the reduction op (sum, and, or, xor, min, max, minu, maxu)
+*/
+unsigned long vectorReduce(string op, const unsigned char *a, int sew, unsigned long n, unsigned long init);